@@ -0,0 +1,167 @@
+///////////////////////////////////////////////////////////////////////////////
+// This file packs the textures of every block type into one image, so that
+// the whole world can be drawn with a single texture bound. Each file named
+// in the block table is loaded once and given a tile in a square grid. Tiles
+// are surrounded by a gutter of pixels copied from their edges, so sampling
+// just outside of a tile picks up the tile's own colour rather than its
+// neighbour's.
+///////////////////////////////////////////////////////////////////////////////
+
+// Enable or disable debugging in this file.
+#define DEBUG_THIS
+
+#ifdef DEBUG_THIS
+#include "debug.h"
+#endif
+
+#include "atlas.h"
+#include "blocks.h" // mxBlockInfo, mxBlockInfoCount
+#include "targa.h" // tga_load, TGA_TRUECOLOR_32, tga_error_string, tga_get_last_error
+
+#include <stdio.h> // snprintf
+#include <stdlib.h> // malloc, calloc, free
+#include <string.h> // memcpy, memset, strcmp
+
+// Directory holding the block textures.
+#define TEXTURE_DIRECTORY "terrain/"
+
+///////////////////////////////////////////////////////////////////////////////
+static unsigned char* load_texture(const char* name, int* size)
+{
+    char filename[256];
+    snprintf(filename, sizeof(filename), "%s%s", TEXTURE_DIRECTORY, name);
+
+    int w, h;
+    unsigned char* tex = (unsigned char*) tga_load(filename, &w, &h, TGA_TRUECOLOR_32);
+    if (tex == NULL)
+    {
+#ifdef DEBUG_THIS
+        mxDebug("%s: %s", filename, tga_error_string(tga_get_last_error()));
+#endif
+        return NULL;
+    }
+    if (w != h)
+    {
+#ifdef DEBUG_THIS
+        mxDebug("%s: texture is not square (%d x %d)", filename, w, h);
+#endif
+        free(tex);
+        return NULL;
+    }
+    *size = w;
+    return tex;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Copies a tile into the atlas at the given cell, along with its gutter.
+///////////////////////////////////////////////////////////////////////////////
+static void blit_tile(MX_ATLAS_T* atlas, const unsigned char* tile, int cell_x, int cell_y)
+{
+    int size = atlas->tile_size;
+    for (int y = -MX_ATLAS_GUTTER; y < size + MX_ATLAS_GUTTER; y++)
+    {
+        int src_y = y < 0 ? 0 : (y >= size ? size - 1 : y);
+        unsigned char* dst = &atlas->pixels[((cell_y + y) * atlas->width + cell_x) * 4];
+        const unsigned char* src = &tile[src_y * size * 4];
+
+        memcpy(dst, src, size * 4);
+        for (int g = 1; g <= MX_ATLAS_GUTTER; g++)
+        {
+            memcpy(dst - g * 4, src, 4);
+            memcpy(dst + (size - 1 + g) * 4, src + (size - 1) * 4, 4);
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Loads every texture named in the block table and packs them into the atlas.
+// Returns false if a texture can't be loaded or there are too many.
+///////////////////////////////////////////////////////////////////////////////
+bool mxAtlasBuild(MX_ATLAS_T* atlas)
+{
+    const char* names[MX_ATLAS_MAX_TILES];
+    unsigned char* tiles[MX_ATLAS_MAX_TILES];
+    bool ok = true;
+
+    memset(atlas, 0, sizeof(MX_ATLAS_T));
+    if (mxBlockInfoCount > MX_ATLAS_MAX_BLOCKS) return false;
+
+    // Give each distinct file a tile.
+    for (int b = 0; b < mxBlockInfoCount && ok; b++)
+    {
+        for (int f = 0; f < MX_FACE_COUNT && ok; f++)
+        {
+            const char* name = mxBlockInfo[b].textures[f];
+            if (name == NULL) continue;
+
+            int t = 0;
+            while (t < atlas->tile_count && strcmp(names[t], name) != 0) t++;
+            if (t == atlas->tile_count)
+            {
+                if (t == MX_ATLAS_MAX_TILES)
+                {
+                    ok = false;
+                    break;
+                }
+
+                int size;
+                tiles[t] = load_texture(name, &size);
+                if (tiles[t] == NULL || (t > 0 && size != atlas->tile_size))
+                {
+                    free(tiles[t]);
+                    ok = false;
+                    break;
+                }
+                atlas->tile_size = size;
+                names[t] = name;
+                atlas->tile_count++;
+            }
+            atlas->face_tiles[b][f] = (unsigned char) t;
+        }
+    }
+
+    // Lay the tiles out in the smallest square power of two that fits them.
+    int cell = atlas->tile_size + 2 * MX_ATLAS_GUTTER;
+    int columns = 1;
+    while (columns * columns < atlas->tile_count) columns++;
+    atlas->width = 1;
+    while (atlas->width < columns * cell) atlas->width *= 2;
+    atlas->height = atlas->width;
+    columns = atlas->width / cell;
+
+    if (ok)
+    {
+        atlas->pixels = (unsigned char*) calloc(atlas->width * atlas->height, 4);
+        if (atlas->pixels == NULL) ok = false;
+    }
+
+    for (int t = 0; t < atlas->tile_count; t++)
+    {
+        if (ok)
+        {
+            int x = (t % columns) * cell + MX_ATLAS_GUTTER;
+            int y = (t / columns) * cell + MX_ATLAS_GUTTER;
+            blit_tile(atlas, tiles[t], x, y);
+
+            atlas->tile_rects[t][0] = (float) x / atlas->width;
+            atlas->tile_rects[t][1] = (float) y / atlas->height;
+            atlas->tile_rects[t][2] = (float) atlas->tile_size / atlas->width;
+            atlas->tile_rects[t][3] = (float) atlas->tile_size / atlas->height;
+        }
+        free(tiles[t]);
+    }
+
+#ifdef DEBUG_THIS
+    if (ok) mxDebug("Atlas of %d tiles is %d x %d", atlas->tile_count, atlas->width, atlas->height);
+#endif
+
+    if (!ok) mxAtlasFree(atlas);
+    return ok;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxAtlasFree(MX_ATLAS_T* atlas)
+{
+    free(atlas->pixels);
+    atlas->pixels = NULL;
+}
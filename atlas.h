@@ -0,0 +1,39 @@
+#ifndef MX_ATLAS_H
+#define MX_ATLAS_H
+
+#include "mesher.h" // MX_FACE_TEXTURES_T
+
+#include <stdbool.h> // bool
+
+// Maximum number of distinct tiles. Tile rectangles are passed to the shader
+// as a uniform array, so this is bounded by the available uniform vectors.
+#define MX_ATLAS_MAX_TILES 64
+
+// Maximum number of block types the atlas can describe.
+#define MX_ATLAS_MAX_BLOCKS 64
+
+// Tiles are surrounded by this many pixels copied from their edges.
+#define MX_ATLAS_GUTTER 1
+
+typedef struct
+{
+    // RGBA pixels, starting in the lower left corner.
+    unsigned char* pixels;
+    int width;
+    int height;
+
+    // Tiles are square and laid out in a grid.
+    int tile_size;
+    int tile_count;
+
+    // Position and size of each tile in texture coordinates.
+    float tile_rects[MX_ATLAS_MAX_TILES][4];
+
+    // The tile used by each face of each block type.
+    MX_FACE_TEXTURES_T face_tiles[MX_ATLAS_MAX_BLOCKS];
+} MX_ATLAS_T;
+
+bool mxAtlasBuild(MX_ATLAS_T* atlas);
+void mxAtlasFree(MX_ATLAS_T* atlas);
+
+#endif /* MX_ATLAS_H */
@@ -0,0 +1,240 @@
+///////////////////////////////////////////////////////////////////////////////
+// This program measures how fast the renderer draws a set of scenes, each
+// made by the generator: the normal hills, flat plains, dense caves, a
+// checkerboard where no face is hidden, an island of about a million blocks,
+// and the hills again seen from inside the rock beneath them. Each scene is
+// loaded and meshed in full, then the camera flies once around a closed
+// Catmull-Rom spline through it, set directly with mxGraphicsLookAt, while
+// every frame is timed.
+//
+// Frames are drawn offscreen with EGL, as in headless mode, so this runs on
+// any Linux box with Mesa. For each scene the profile of the flythrough is
+// written to stdout as JSON: frame, paint (CPU) and gpu (waiting on glFinish)
+// times, draw calls and triangles per frame, and the chunks drawn, culled and
+// hidden behind rock. --no-cave-culling draws the hidden chunks too, and
+// --lod-pixels sets how coarse distant chunks may be drawn, with 0 drawing
+// them all in full detail.
+//
+// Usage: flythrough_bench [--frames N] [--size WxH] [--radius N]
+//                         [--no-cave-culling] [--lod-pixels N] [scene ...]
+///////////////////////////////////////////////////////////////////////////////
+
+#include "../display.h" // mxDisplaySetupHeadless, mxDisplaySwapBuffers
+#include "../generator.h" // mxGeneratorSetup, mxGeneratorSetScene
+#include "../gfx_engine.h" // mxGraphicsSetup, mxGraphicsLookAt, mxGraphicsPaint, mxGraphicsSetCaveCulling, mxGraphicsSetLodPixels
+#include "../jobs.h" // mxJobsSetup, mxJobsCleanup
+#include "../loader.h" // mxLoaderCleanup
+#include "../player.h" // mxPlayerSetup, mxPlayerCleanup
+#include "../profiler.h" // mxProfileReset, mxProfileReport, MX_PROFILE
+#include "../region.h" // mxRegionSetup, mxRegionCleanup
+#include "../stream.h" // mxStreamSetup, mxStreamCleanup
+#include "../world.h" // mxWorldSetup, mxWorldChunkCount, mxWorldChunk
+
+#include <stdio.h> // printf, sscanf
+#include <stdlib.h> // atoi, atof
+#include <string.h> // strcmp
+#include <math.h> // cosf, sinf, floorf, sqrtf
+
+#include <GLES2/gl2.h>
+
+#define FRAMES 300
+#define WIDTH 640
+#define HEIGHT 480
+#define STREAM_RADIUS 10
+
+// The camera looks towards the point this far further round the path, as a
+// fraction of the whole loop, and down by this much for each unit ahead.
+#define LOOK_AHEAD 0.01f
+#define LOOK_DOWN 0.3f
+
+// The path goes through this many control points.
+#define PATH_POINTS 8
+
+// Each scene's path circles the origin, alternately at the full radius and
+// 70% of it, and rising and falling by swing blocks either side of height,
+// so that the camera sees the scene from different distances and angles.
+typedef struct
+{
+    const char* name;
+
+    // The generator's scene, see mxGeneratorSetScene.
+    const char* generator;
+    float radius;
+    float height;
+    float swing;
+} SCENE_T;
+
+static const SCENE_T _scenes[] = {
+    { "hills", "hills", 80.f, 40.f, 12.f },
+    { "plains", "plains", 80.f, 10.f, 6.f },
+    { "caves", "caves", 60.f, -8.f, 8.f },
+    { "checkerboard", "checkerboard", 80.f, 6.f, 4.f },
+    { "million", "million", 70.f, 30.f, 10.f },
+    { "underground", "hills", 60.f, -20.f, 6.f },
+};
+
+#define SCENE_COUNT ((int) (sizeof(_scenes) / sizeof(_scenes[0])))
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the point on the closed spline through the scene's control points
+// at t, from 0 to 1 around the loop, in world units.
+///////////////////////////////////////////////////////////////////////////////
+static void path_point(const SCENE_T* scene, float t, float* p)
+{
+    float control[PATH_POINTS][3];
+    for (int k = 0; k < PATH_POINTS; k++)
+    {
+        float angle = 6.2831853f * k / PATH_POINTS;
+        float r = scene->radius * (k & 1 ? 0.7f : 1.f);
+        control[k][0] = r * cosf(angle) * MX_BLOCK_SIZE;
+        control[k][1] = (scene->height + (k & 1 ? scene->swing : -scene->swing)) * MX_BLOCK_SIZE;
+        control[k][2] = r * sinf(angle) * MX_BLOCK_SIZE;
+    }
+
+    t -= floorf(t);
+    float s = t * PATH_POINTS;
+    int k = (int) s;
+    float u = s - k;
+    const float* p0 = control[(k + PATH_POINTS - 1) % PATH_POINTS];
+    const float* p1 = control[k % PATH_POINTS];
+    const float* p2 = control[(k + 1) % PATH_POINTS];
+    const float* p3 = control[(k + 2) % PATH_POINTS];
+    for (int i = 0; i < 3; i++)
+    {
+        p[i] = 0.5f * (2.f * p1[i] +
+                       (p2[i] - p0[i]) * u +
+                       (2.f * p0[i] - 5.f * p1[i] + 4.f * p2[i] - p3[i]) * u * u +
+                       (3.f * p1[i] - p0[i] - 3.f * p2[i] + p3[i]) * u * u * u);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Loads the scene, flies through it and writes its profile. The world is
+// loaded around the player's start position and stays loaded, as the player
+// doesn't move. Returns false if the scene couldn't be set up.
+///////////////////////////////////////////////////////////////////////////////
+static bool run_scene(const SCENE_T* scene, int frames, unsigned int width, unsigned int height,
+                      int radius, const char* separator)
+{
+    mxGeneratorSetScene(scene->generator);
+    bool ok = mxWorldSetup();
+    ok = ok && mxStreamSetup(radius);
+    ok = ok && mxJobsSetup(-1);
+    ok = ok && mxGraphicsSetup(width, height);
+    ok = ok && mxPlayerSetup();
+
+    if (ok)
+    {
+        uint64_t start = mxProfileNow();
+        mxGraphicsFinishLoading();
+        double load_ms = (mxProfileNow() - start) / 1e6;
+
+        int blocks = 0;
+        int chunk_count = mxWorldChunkCount();
+        for (int i = 0; i < chunk_count; i++) blocks += mxWorldChunk(i)->solid_count;
+
+        mxProfileReset();
+        for (int frame = 0; frame < frames; frame++)
+        {
+            float eye[3], centre[3];
+            float t = (float) frame / frames;
+            path_point(scene, t, eye);
+            path_point(scene, t + LOOK_AHEAD, centre);
+            centre[1] = eye[1] - LOOK_DOWN * sqrtf((centre[0] - eye[0]) * (centre[0] - eye[0]) +
+                                                   (centre[2] - eye[2]) * (centre[2] - eye[2]));
+            MX_PROFILE(MX_PROFILE_FRAME)
+            {
+                mxGraphicsLookAt(eye[0], eye[1], eye[2], centre[0], centre[1], centre[2]);
+                MX_PROFILE(MX_PROFILE_PAINT) mxGraphicsPaint();
+                MX_PROFILE(MX_PROFILE_GPU) glFinish();
+                MX_PROFILE(MX_PROFILE_SWAP) mxDisplaySwapBuffers();
+            }
+        }
+
+        printf("%s\n    \"%s\": {\n", separator, scene->name);
+        printf("    \"chunks\": %d, \"blocks\": %d, \"mesh_kb\": %d, \"load_ms\": %.1f,\n",
+               chunk_count, blocks, mxGraphicsMeshBytes() / 1024, load_ms);
+        printf("    \"stages\": ");
+        mxProfileReport(stdout, MX_PROFILE_JSON);
+        printf("    }");
+    }
+
+    mxJobsCleanup();
+    mxPlayerCleanup();
+    mxGraphicsCleanup();
+    mxStreamCleanup();
+    mxLoaderCleanup();
+    mxWorldCleanup();
+    return ok;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int main(int argc, char** argv)
+{
+    int frames = FRAMES;
+    unsigned int width = WIDTH;
+    unsigned int height = HEIGHT;
+    int radius = STREAM_RADIUS;
+    bool cave_culling = true;
+    int first_scene = argc;
+    for (int i = 1; i < argc; i++)
+    {
+        bool more = i + 1 < argc;
+        if (strcmp(argv[i], "--frames") == 0 && more) frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--size") == 0 && more &&
+                 sscanf(argv[++i], "%ux%u", &width, &height) == 2) continue;
+        else if (strcmp(argv[i], "--radius") == 0 && more) radius = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--no-cave-culling") == 0) cave_culling = false;
+        else if (strcmp(argv[i], "--lod-pixels") == 0 && more) mxGraphicsSetLodPixels((float) atof(argv[++i]));
+        else if (argv[i][0] != '-')
+        {
+            first_scene = i;
+            break;
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--frames N] [--size WxH] [--radius N] [--no-cave-culling] [--lod-pixels N] [scene ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (frames < 1) frames = 1;
+
+    // Scenes are checked before anything is drawn, so that a typing mistake
+    // doesn't waste a long run.
+    for (int i = first_scene; i < argc; i++)
+    {
+        int s = 0;
+        while (s < SCENE_COUNT && strcmp(argv[i], _scenes[s].name) != 0) s++;
+        if (s == SCENE_COUNT)
+        {
+            fprintf(stderr, "Unknown scene %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    mxGeneratorSetup(1);
+    mxGraphicsSetCaveCulling(cave_culling);
+    if (!mxRegionSetup(NULL) || !mxDisplaySetupHeadless(width, height))
+    {
+        fprintf(stderr, "Failed to set up an offscreen display\n");
+        return 1;
+    }
+
+    printf("{\n  \"frames\": %d, \"width\": %u, \"height\": %u,\n  \"scenes\": {", frames, width, height);
+    const char* separator = "";
+    bool ok = true;
+    for (int s = 0; s < SCENE_COUNT && ok; s++)
+    {
+        bool wanted = first_scene == argc;
+        for (int i = first_scene; i < argc && !wanted; i++) wanted = strcmp(argv[i], _scenes[s].name) == 0;
+        if (!wanted) continue;
+        ok = run_scene(&_scenes[s], frames, width, height, radius, separator);
+        separator = ",";
+    }
+    printf("\n  }\n}\n");
+
+    mxRegionCleanup();
+    mxDisplayCleanup();
+    if (!ok) fprintf(stderr, "Failed to set up a scene\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+///////////////////////////////////////////////////////////////////////////////
+// This program measures how many rays a second mxRaycast can follow through a
+// generated world, compared with simply marching along each ray in small
+// steps and looking up every point with mxWorldGetBlock. Rays start at random
+// points above and below the ground and go in random directions, so that some
+// hit the ground close by, some go a long way through caves and some leave
+// the world without hitting anything.
+//
+// Usage: raycast_bench [rays] [range in blocks]
+///////////////////////////////////////////////////////////////////////////////
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "../raycast.h" // mxRaycast, MX_RAYCAST_HIT_T
+#include "../world.h" // mxWorldSetup, mxWorldCreateChunk, mxWorldGetBlock
+#include "../generator.h" // mxGeneratorSetup, mxGeneratorFill, mxGeneratorHeight
+
+#include <stdio.h> // printf
+#include <stdlib.h> // malloc, free, atoi
+#include <math.h> // floorf, sqrtf
+#include <time.h> // clock_gettime, CLOCK_MONOTONIC
+
+// The world is this many chunks across, centred on the origin, and covers
+// the chunks from CHUNKS_BELOW to CHUNKS_ABOVE vertically.
+#define CHUNKS_ACROSS 24
+#define CHUNKS_BELOW (-4)
+#define CHUNKS_ABOVE 3
+
+// The marching steps are this fraction of a block.
+#define MARCH_STEPS_PER_BLOCK 64
+
+typedef struct
+{
+    float x, y, z;
+    float dx, dy, dz;
+} RAY_T;
+
+///////////////////////////////////////////////////////////////////////////////
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Numerical Recipes' linear congruential generator, as a float in [0, 1).
+///////////////////////////////////////////////////////////////////////////////
+static float random_float(unsigned int* state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return (float) (*state >> 8) / (float) (1u << 24);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static void make_rays(RAY_T* rays, int count, float range)
+{
+    unsigned int state = 1;
+    float half = (CHUNKS_ACROSS / 2) * MX_CHUNK_SIZE - range / MX_BLOCK_SIZE;
+    for (int i = 0; i < count; i++)
+    {
+        RAY_T* ray = &rays[i];
+        float bx = (random_float(&state) * 2.f - 1.f) * half;
+        float bz = (random_float(&state) * 2.f - 1.f) * half;
+        float by = mxGeneratorHeight((int) bx, (int) bz) + (random_float(&state) * 2.f - 1.f) * 8.f;
+        ray->x = bx * MX_BLOCK_SIZE;
+        ray->y = by * MX_BLOCK_SIZE;
+        ray->z = bz * MX_BLOCK_SIZE;
+
+        // Directions are spread evenly over the sphere.
+        float cos_theta = random_float(&state) * 2.f - 1.f;
+        float sin_theta = sqrtf(1.f - cos_theta * cos_theta);
+        float phi = random_float(&state) * 6.2831853f;
+        ray->dx = sin_theta * cosf(phi);
+        ray->dy = cos_theta;
+        ray->dz = sin_theta * sinf(phi);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// The simple way, which can step past the corner of a block.
+///////////////////////////////////////////////////////////////////////////////
+static bool march(const RAY_T* ray, float max_distance, MX_RAYCAST_HIT_T* hit)
+{
+    float step = (float) MX_BLOCK_SIZE / MARCH_STEPS_PER_BLOCK;
+    for (float t = 0.f; t <= max_distance; t += step)
+    {
+        int x = (int) floorf((ray->x + ray->dx * t) / MX_BLOCK_SIZE + 0.5f);
+        int y = (int) floorf((ray->y + ray->dy * t) / MX_BLOCK_SIZE + 0.5f);
+        int z = (int) floorf((ray->z + ray->dz * t) / MX_BLOCK_SIZE + 0.5f);
+        MX_BLOCK_T type = mxWorldGetBlock(x, y, z);
+        if (type != MX_BLOCK_AIR)
+        {
+            hit->x = x;
+            hit->y = y;
+            hit->z = z;
+            hit->distance = t;
+            hit->type = type;
+            return true;
+        }
+    }
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int main(int argc, char** argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    float range = (argc > 2 ? atoi(argv[2]) : 64) * (float) MX_BLOCK_SIZE;
+
+    mxGeneratorSetup(1);
+    if (!mxWorldSetup()) return 1;
+    int chunk_count = 0;
+    for (int cx = -CHUNKS_ACROSS / 2; cx < CHUNKS_ACROSS / 2; cx++)
+    {
+        for (int cz = -CHUNKS_ACROSS / 2; cz < CHUNKS_ACROSS / 2; cz++)
+        {
+            for (int cy = CHUNKS_BELOW; cy <= CHUNKS_ABOVE; cy++)
+            {
+                MX_CHUNK_T* chunk = mxWorldCreateChunk(cx, cy, cz);
+                if (chunk == NULL) return 1;
+                mxGeneratorFill(chunk);
+                chunk_count++;
+            }
+        }
+    }
+
+    RAY_T* rays = (RAY_T*) malloc(count * sizeof(RAY_T));
+    MX_RAYCAST_HIT_T* hits = (MX_RAYCAST_HIT_T*) malloc(count * sizeof(MX_RAYCAST_HIT_T));
+    bool* hit = (bool*) malloc(count * sizeof(bool));
+    make_rays(rays, count, range);
+
+    double start = now();
+    int hit_count = 0;
+    double distance = 0.0;
+    for (int i = 0; i < count; i++)
+    {
+        const RAY_T* ray = &rays[i];
+        hit[i] = mxRaycast(ray->x, ray->y, ray->z, ray->dx, ray->dy, ray->dz, range, &hits[i]);
+        if (hit[i])
+        {
+            hit_count++;
+            distance += hits[i].distance;
+        }
+    }
+    double seconds = now() - start;
+
+    // Marching is much slower, so only a sample of the rays are marched.
+    int marched = count / 100 > 0 ? count / 100 : 1;
+    int differ = 0;
+    double march_start = now();
+    for (int i = 0; i < marched; i++)
+    {
+        MX_RAYCAST_HIT_T h;
+        bool m = march(&rays[i], range, &h);
+        if (m != hit[i] || (m && (h.x != hits[i].x || h.y != hits[i].y || h.z != hits[i].z))) differ++;
+    }
+    double march_seconds = now() - march_start;
+
+    printf("%d chunks, %d rays up to %.0f blocks\n", chunk_count, count, range / MX_BLOCK_SIZE);
+    printf("%.1f%% hit, average distance %.1f blocks\n",
+           100.0 * hit_count / count, hit_count ? distance / hit_count / MX_BLOCK_SIZE : 0.0);
+    printf("%-10s %14s\n", "method", "rays/s");
+    printf("%-10s %14.0f\n", "march", marched / march_seconds);
+    printf("%-10s %14.0f\n", "raycast", count / seconds);
+    printf("%d of %d marched rays hit a different block (corners stepped over)\n", differ, marched);
+
+    free(rays);
+    free(hits);
+    free(hit);
+    mxWorldCleanup();
+    return 0;
+}
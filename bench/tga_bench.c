@@ -0,0 +1,187 @@
+///////////////////////////////////////////////////////////////////////////////
+// This program measures how fast TGA files are loaded by tga_load, compared
+// with the per-pixel loader it replaced (kept in tga_legacy.c). Test images
+// the size of a large texture atlas are written to a temporary directory in
+// each of the common encodings, then each is loaded repeatedly by both
+// loaders. Throughput is reported in MB/s of decoded image data.
+//
+// Usage: tga_bench [size] [iterations]
+///////////////////////////////////////////////////////////////////////////////
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "../targa.h" // tga_load, TGA_TRUECOLOR_32
+
+#include <stdio.h> // printf, fopen, fwrite
+#include <stdlib.h> // malloc, free, atoi
+#include <string.h> // memcmp
+#include <time.h> // clock_gettime, CLOCK_MONOTONIC
+
+void* tga_legacy_load(const char* filename, int* width, int* height, unsigned int format);
+
+typedef void* (*LOADER_T)(const char* filename, int* width, int* height, unsigned int format);
+
+///////////////////////////////////////////////////////////////////////////////
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns a repeatable pattern of colour with some flat areas, so that RLE
+// packets of both kinds are produced.
+///////////////////////////////////////////////////////////////////////////////
+static void pixel_at(int x, int y, unsigned char* bgra)
+{
+    int flat = ((x >> 4) + (y >> 4)) & 1;
+    bgra[0] = flat ? 40 : (unsigned char) (x * 7 + y);
+    bgra[1] = flat ? 120 : (unsigned char) (y * 3);
+    bgra[2] = flat ? 200 : (unsigned char) (x ^ y);
+    bgra[3] = flat ? 255 : (unsigned char) (x + y * 5);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static void write_header(FILE* f, int type, int cmap_length, int depth, int size)
+{
+    unsigned char hdr[18] = { 0 };
+    hdr[1] = cmap_length ? 1 : 0;
+    hdr[2] = (unsigned char) type;
+    hdr[5] = (unsigned char) (cmap_length & 0xFF);
+    hdr[6] = (unsigned char) (cmap_length >> 8);
+    hdr[7] = cmap_length ? 32 : 0;
+    hdr[12] = hdr[14] = (unsigned char) (size & 0xFF);
+    hdr[13] = hdr[15] = (unsigned char) (size >> 8);
+    hdr[16] = (unsigned char) depth;
+    hdr[17] = 8 | 0x20; // 8 alpha bits, upper left origin
+    fwrite(hdr, 1, sizeof(hdr), f);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static void write_truecolor(const char* filename, int size, int rle)
+{
+    FILE* f = fopen(filename, "wb");
+    write_header(f, rle ? 10 : 2, 0, 32, size);
+
+    unsigned char* row = (unsigned char*) malloc(size * 4);
+    for (int y = 0; y < size; y++)
+    {
+        for (int x = 0; x < size; x++) pixel_at(x, y, &row[x * 4]);
+        if (!rle)
+        {
+            fwrite(row, 4, size, f);
+            continue;
+        }
+
+        // Encode runs of up to 128 equal pixels, otherwise raw packets.
+        for (int x = 0; x < size;)
+        {
+            int n = 1;
+            while (x + n < size && n < 128 && memcmp(&row[x * 4], &row[(x + n) * 4], 4) == 0) n++;
+            if (n > 1)
+            {
+                fputc(0x80 | (n - 1), f);
+                fwrite(&row[x * 4], 4, 1, f);
+            }
+            else
+            {
+                while (x + n < size && n < 128 && memcmp(&row[(x + n - 1) * 4], &row[(x + n) * 4], 4) != 0) n++;
+                fputc(n - 1, f);
+                fwrite(&row[x * 4], 4, n, f);
+            }
+            x += n;
+        }
+    }
+    free(row);
+    fclose(f);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static void write_paletted(const char* filename, int size)
+{
+    FILE* f = fopen(filename, "wb");
+    write_header(f, 1, 256, 8, size);
+    for (int i = 0; i < 256; i++)
+    {
+        unsigned char bgra[4];
+        pixel_at(i, i * 3, bgra);
+        fwrite(bgra, 4, 1, f);
+    }
+    for (int y = 0; y < size; y++)
+        for (int x = 0; x < size; x++)
+            fputc((x * 3 + y) & 0xFF, f);
+    fclose(f);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static double measure(LOADER_T loader, const char* filename, int iterations, int size)
+{
+    double start = now();
+    for (int i = 0; i < iterations; i++)
+    {
+        int w, h;
+        void* data = loader(filename, &w, &h, TGA_TRUECOLOR_32);
+        if (data == NULL || w != size || h != size)
+        {
+            printf("%s: load failed\n", filename);
+            exit(1);
+        }
+        free(data);
+    }
+    double seconds = now() - start;
+    return (double) size * size * 4 * iterations / seconds / (1024.0 * 1024.0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Counts pixels where the two loaders disagree by more than rounding.
+///////////////////////////////////////////////////////////////////////////////
+static int compare(const char* filename)
+{
+    int w, h, lw, lh;
+    unsigned char* a = (unsigned char*) tga_load(filename, &w, &h, TGA_TRUECOLOR_32);
+    unsigned char* b = (unsigned char*) tga_legacy_load(filename, &lw, &lh, TGA_TRUECOLOR_32);
+    int differ = 0;
+    for (int i = 0; i < w * h; i++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            if (abs(a[i * 4 + c] - b[i * 4 + c]) > 1)
+            {
+                differ++;
+                break;
+            }
+        }
+    }
+    free(a);
+    free(b);
+    return differ;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int main(int argc, char** argv)
+{
+    int size = argc > 1 ? atoi(argv[1]) : 2048;
+    int iterations = argc > 2 ? atoi(argv[2]) : 5;
+
+    static const char* names[] = { "uncompressed", "rle", "paletted" };
+    static const char* files[] = {
+        "/tmp/tga_bench_unc.tga",
+        "/tmp/tga_bench_rle.tga",
+        "/tmp/tga_bench_pal.tga"
+    };
+    write_truecolor(files[0], size, 0);
+    write_truecolor(files[1], size, 1);
+    write_paletted(files[2], size);
+
+    printf("%d x %d, %d iterations\n", size, size, iterations);
+    printf("%-14s %12s %14s %8s %8s\n", "encoding", "legacy MB/s", "tga_load MB/s", "speedup", "differ");
+    for (int i = 0; i < 3; i++)
+    {
+        double legacy = measure(tga_legacy_load, files[i], iterations, size);
+        double current = measure(tga_load, files[i], iterations, size);
+        printf("%-14s %12.1f %14.1f %7.1fx %8d\n", names[i], legacy, current, current / legacy, compare(files[i]));
+        remove(files[i]);
+    }
+    return 0;
+}
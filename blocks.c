@@ -0,0 +1,33 @@
+#include "blocks.h"
+
+#include <stdlib.h> // NULL
+
+///////////////////////////////////////////////////////////////////////////////
+// Each entry gives the textures for the front, back, left, right, top and
+// bottom faces. Entries must be in the order of the MX_BLOCK_* types.
+///////////////////////////////////////////////////////////////////////////////
+const MX_BLOCK_INFO_T mxBlockInfo[] = {
+
+    // MX_BLOCK_AIR
+    { "air", { NULL, NULL, NULL, NULL, NULL, NULL } },
+
+    // MX_BLOCK_GRASS
+    { "grass", {
+        "block_dirt_side.tga",
+        "block_dirt_side.tga",
+        "block_dirt_side.tga",
+        "block_dirt_side.tga",
+        "block_dirt_top.tga",
+        "block_dirt_bottom.tga" } },
+
+    // MX_BLOCK_DIRT
+    { "dirt", {
+        "block_dirt_bottom.tga",
+        "block_dirt_bottom.tga",
+        "block_dirt_bottom.tga",
+        "block_dirt_bottom.tga",
+        "block_dirt_bottom.tga",
+        "block_dirt_bottom.tga" } },
+};
+
+const int mxBlockInfoCount = sizeof(mxBlockInfo) / sizeof(mxBlockInfo[0]);
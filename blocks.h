@@ -0,0 +1,20 @@
+#ifndef MX_BLOCKS_H
+#define MX_BLOCKS_H
+
+#include "world.h" // MX_BLOCK_T
+#include "mesher.h" // MX_FACE_COUNT
+
+// Describes how a block type looks. Textures are file names in the terrain
+// directory, one per face in the order of the MX_FACE_* indexes. Faces that
+// share a file share a single tile in the texture atlas.
+typedef struct
+{
+    const char* name;
+    const char* textures[MX_FACE_COUNT];
+} MX_BLOCK_INFO_T;
+
+// Indexed by block type. Adding a block type means adding an entry here.
+extern const MX_BLOCK_INFO_T mxBlockInfo[];
+extern const int mxBlockInfoCount;
+
+#endif /* MX_BLOCKS_H */
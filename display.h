@@ -4,7 +4,11 @@
 #include <stdbool.h> // bool
 
 bool mxDisplaySetup(unsigned int* screen_width, unsigned int* screen_height);
+bool mxDisplaySetupHeadless(unsigned int width, unsigned int height);
+bool mxDisplaySetSwapInterval(int interval);
+void mxDisplaySetFrameLimit(int fps);
 void mxDisplaySwapBuffers();
+unsigned int mxDisplayMissedFrames();
 void mxDisplayCleanup();
 
 #endif /* MX_DISPLAY_H */
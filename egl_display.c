@@ -1,15 +1,71 @@
+///////////////////////////////////////////////////////////////////////////////
+// This file sets up EGL on the screen, or offscreen when headless, and paces
+// frames. The swap interval sets how many display refreshes eglSwapBuffers
+// waits for, and a frame limit can also be set, in which case swapping waits
+// until a whole frame period has passed since the last frame. Most of the
+// wait is a sleep, so that the CPU is idle, but the end of it is spun, as
+// sleeps can end late by up to a scheduler tick.
+//
+// A frame is counted as missed for each frame period that passes without a
+// new frame being shown. The period is the frame limit's if there is one, or
+// otherwise the swap interval times the refresh period, which is assumed to
+// be DISPLAY_REFRESH_HZ, as EGL doesn't say what it is.
+///////////////////////////////////////////////////////////////////////////////
+
+#define _POSIX_C_SOURCE 200112L
+
+// Enable or disable debugging in this file.
+#define DEBUG_THIS
+
+#ifdef DEBUG_THIS
+#include "debug.h"
+#endif
+
+#include "display.h"
+#include "profiler.h" // mxProfileNow, mxProfileCount, MX_PROFILE_FRAMES_MISSED
+
 #include <stdlib.h> // NULL
 #include <stdbool.h> // bool, true, false
+#include <string.h> // strstr
+#include <time.h> // clock_nanosleep, CLOCK_MONOTONIC, TIMER_ABSTIME
+
+#ifdef HAVE_LIBBCM_HOST
+#include <bcm_host.h> // graphics_get_display_size, vc_dispmanx_*
+#endif
 
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
+#include <GLES2/gl2.h> // glFinish
 
 static EGLDisplay _egl_display;
 static EGLSurface _egl_surface;
 static EGLContext _egl_context;
+static EGLConfig _egl_config;
+static bool _headless;
+
+// Assumed refresh rate of the display.
+#define DISPLAY_REFRESH_HZ 60
+
+// Sleeps end this many nanoseconds before the frame is due, and the rest of
+// the wait is spun.
+#define SPIN_NANOSECONDS 500000
+
+// Frame period of the frame limit, or 0 for none, and when the next frame is
+// due if there is a limit.
+static uint64_t _frame_period;
+static uint64_t _next_frame;
+
+// Frame period that missed frames are counted against, or 0 to not count
+// them, when the last frame was shown, and the total missed.
+static int _swap_interval = 1;
+static uint64_t _last_frame;
+static unsigned int _missed_frames;
 
 ///////////////////////////////////////////////////////////////////////////////
-bool mxDisplaySetup(unsigned int* screen_width, unsigned int* screen_height)
+// Initialises the display connection and creates a GLES 2 context with a
+// configuration that supports the given kind of surface.
+///////////////////////////////////////////////////////////////////////////////
+static bool setup_context(EGLint surface_type)
 {
     // NOTE: The content of this function is largely based on the triangle.c
     //       source file that was provided as an example for Raspberry Pi.
@@ -35,8 +91,6 @@ bool mxDisplaySetup(unsigned int* screen_width, unsigned int* screen_height)
      * limitations under the License.
      */
     
-	// Get an EGL display connection.
-	_egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
     if (_egl_display == EGL_NO_DISPLAY) return false;
 
 	// Initialise the EGL display connection.
@@ -44,30 +98,42 @@ bool mxDisplaySetup(unsigned int* screen_width, unsigned int* screen_height)
     if (result == EGL_FALSE) return false;
 
 	// EGL frame buffer configuration.
-	static const EGLint attribute_list[] =
+	const EGLint attribute_list[] =
 	{
         EGL_RED_SIZE, 8,
         EGL_GREEN_SIZE, 8,
         EGL_BLUE_SIZE, 8,
         EGL_ALPHA_SIZE, 8,
         EGL_DEPTH_SIZE, 24,
-        EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+        EGL_SURFACE_TYPE, surface_type,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
         EGL_NONE
 	};
-	EGLConfig config;
     EGLint num_config;
-	result = eglChooseConfig(_egl_display, attribute_list, &config, 1, &num_config);
-    if (result == EGL_FALSE) return false;
+	result = eglChooseConfig(_egl_display, attribute_list, &_egl_config, 1, &num_config);
+    if (result == EGL_FALSE || num_config == 0) return false;
 
 	// Create an EGL rendering context.
     static const EGLint context_attributes[] = 
     {
-       // EGL_CONTEXT_CLIENT_VERSION, 2,
+       EGL_CONTEXT_CLIENT_VERSION, 2,
        EGL_NONE
     };
-	_egl_context = eglCreateContext(_egl_display, config, EGL_NO_CONTEXT, context_attributes);
+    eglBindAPI(EGL_OPENGL_ES_API);
+	_egl_context = eglCreateContext(_egl_display, _egl_config, EGL_NO_CONTEXT, context_attributes);
     if (_egl_context == EGL_NO_CONTEXT) return false;
 
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool mxDisplaySetup(unsigned int* screen_width, unsigned int* screen_height)
+{
+#ifdef HAVE_LIBBCM_HOST
+	// Get an EGL display connection.
+	_egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (!setup_context(EGL_WINDOW_BIT)) return false;
+
 	// Create an EGL window surface.
     int success = graphics_get_display_size(0/* LCD */, screen_width, screen_height);
     if (success < 0) return false;
@@ -96,20 +162,155 @@ bool mxDisplaySetup(unsigned int* screen_width, unsigned int* screen_height)
 	nativewindow.height = *screen_height;
 	vc_dispmanx_update_submit_sync(dispman_update);
 	  
-	_egl_surface = eglCreateWindowSurface(_egl_display, config, &nativewindow, NULL);
+	_egl_surface = eglCreateWindowSurface(_egl_display, _egl_config, &nativewindow, NULL);
     if (_egl_surface == EGL_NO_SURFACE) return false;
 
 	// Connect the context to the surface.
-	result = eglMakeCurrent(_egl_display, _egl_surface, _egl_surface, _egl_context);
+	EGLBoolean result = eglMakeCurrent(_egl_display, _egl_surface, _egl_surface, _egl_context);
     if (result == EGL_FALSE) return false;
     
     return true;
+#else
+#ifdef DEBUG_THIS
+    mxDebugStr("No display support in this build; use --headless");
+#endif
+    return false;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns a display that doesn't need a window system. With Mesa this is the
+// surfaceless platform; elsewhere the default display can create pbuffers.
+///////////////////////////////////////////////////////////////////////////////
+static EGLDisplay headless_display()
+{
+#if defined(EGL_EXT_platform_base) && defined(EGL_PLATFORM_SURFACELESS_MESA)
+    const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (extensions != NULL && strstr(extensions, "EGL_MESA_platform_surfaceless") != NULL)
+    {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (get_platform_display != NULL)
+            return get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+#endif
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets up rendering to an offscreen pbuffer of the given size, for running
+// without a screen.
+///////////////////////////////////////////////////////////////////////////////
+bool mxDisplaySetupHeadless(unsigned int width, unsigned int height)
+{
+    _egl_display = headless_display();
+    if (!setup_context(EGL_PBUFFER_BIT)) return false;
+
+    const EGLint pbuffer_attributes[] =
+    {
+        EGL_WIDTH, (EGLint) width,
+        EGL_HEIGHT, (EGLint) height,
+        EGL_NONE
+    };
+    _egl_surface = eglCreatePbufferSurface(_egl_display, _egl_config, pbuffer_attributes);
+    if (_egl_surface == EGL_NO_SURFACE) return false;
+
+	EGLBoolean result = eglMakeCurrent(_egl_display, _egl_surface, _egl_surface, _egl_context);
+    if (result == EGL_FALSE) return false;
+
+    _headless = true;
+#ifdef DEBUG_THIS
+    mxDebug("Headless %u x %u on %s", width, height, eglQueryString(_egl_display, EGL_VENDOR));
+#endif
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets the number of display refreshes each swap waits for, or 0 to swap
+// straight away. Returns false if the display doesn't allow it.
+///////////////////////////////////////////////////////////////////////////////
+bool mxDisplaySetSwapInterval(int interval)
+{
+    if (interval < 0) return false;
+    if (!_headless && eglSwapInterval(_egl_display, interval) == EGL_FALSE) return false;
+    _swap_interval = interval;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Limits the frame rate to the given frames per second, or 0 for no limit.
+///////////////////////////////////////////////////////////////////////////////
+void mxDisplaySetFrameLimit(int fps)
+{
+    _frame_period = fps > 0 ? 1000000000u / (unsigned int) fps : 0;
+    _next_frame = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Waits until the next frame is due under the frame limit. A frame that is
+// already more than a period late doesn't try to catch up, as that would only
+// rush the frames after it.
+///////////////////////////////////////////////////////////////////////////////
+static void wait_for_frame()
+{
+    uint64_t now = mxProfileNow();
+    if (_next_frame == 0 || now >= _next_frame + _frame_period)
+    {
+        _next_frame = now + _frame_period;
+        return;
+    }
+    if (now + SPIN_NANOSECONDS < _next_frame)
+    {
+        uint64_t wake = _next_frame - SPIN_NANOSECONDS;
+        struct timespec ts;
+        ts.tv_sec = (time_t) (wake / 1000000000u);
+        ts.tv_nsec = (long) (wake % 1000000000u);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) continue;
+    }
+    while (mxProfileNow() < _next_frame) continue;
+    _next_frame += _frame_period;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Counts the frame periods that have passed since the last frame was shown,
+// other than its own, as missed.
+///////////////////////////////////////////////////////////////////////////////
+static void count_missed_frames()
+{
+    uint64_t period = _frame_period;
+    if (period == 0 && !_headless && _swap_interval > 0)
+        period = 1000000000u / DISPLAY_REFRESH_HZ * _swap_interval;
+
+    uint64_t now = mxProfileNow();
+    unsigned int missed = 0;
+    if (period != 0 && _last_frame != 0)
+    {
+        // Frames are allowed to be up to half a period late.
+        uint64_t periods = (now - _last_frame + period / 2) / period;
+        if (periods > 1) missed = (unsigned int) (periods - 1);
+    }
+    _last_frame = now;
+    _missed_frames += missed;
+    mxProfileCount(MX_PROFILE_FRAMES_MISSED, missed);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 void mxDisplaySwapBuffers()
 {
-    eglSwapBuffers(_egl_display, _egl_surface);
+    // Swapping a pbuffer does nothing, so wait for the frame to be drawn
+    // instead, which keeps frame timings honest.
+    if (_headless) glFinish();
+    if (_frame_period != 0) wait_for_frame();
+    if (!_headless) eglSwapBuffers(_egl_display, _egl_surface);
+    count_missed_frames();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the number of frames missed since the display was set up.
+///////////////////////////////////////////////////////////////////////////////
+unsigned int mxDisplayMissedFrames()
+{
+    return _missed_frames;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
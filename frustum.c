@@ -0,0 +1,58 @@
+///////////////////////////////////////////////////////////////////////////////
+// This file tests boxes against the view frustum, so that chunks that can't be
+// seen are not drawn. The planes are taken straight from the combined model
+// view projection matrix, using the method described here:
+// http://www.cs.otago.ac.nz/postgrads/alexis/planeExtraction.pdf
+///////////////////////////////////////////////////////////////////////////////
+
+#include "frustum.h"
+
+#include <math.h> // fabsf
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets the frustum planes from a projection, or a projection multiplied by a
+// view and model matrix, in which case the planes are in model space.
+///////////////////////////////////////////////////////////////////////////////
+void mxFrustumExtract(MX_FRUSTUM_T* frustum, const MX_MATRIX_T m)
+{
+    // Each plane is the last row of the matrix plus or minus one of the
+    // others: left, right, bottom, top, near, far.
+    for (int i = 0; i < 6; i++)
+    {
+        int row = i >> 1;
+        float sign = (i & 1) ? -1.f : 1.f;
+        frustum->a[i] = m[3] + sign * m[row];
+        frustum->b[i] = m[7] + sign * m[4 + row];
+        frustum->c[i] = m[11] + sign * m[8 + row];
+        frustum->d[i] = m[15] + sign * m[12 + row];
+    }
+    for (int i = 6; i < MX_FRUSTUM_PLANES; i++)
+    {
+        frustum->a[i] = frustum->b[i] = frustum->c[i] = 0.f;
+        frustum->d[i] = 1.f;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns false if the axis aligned box is entirely outside the frustum. Boxes
+// near the corners of the frustum may be kept even though they are outside,
+// which only costs drawing something that is clipped anyway.
+///////////////////////////////////////////////////////////////////////////////
+bool mxFrustumTestBox(const MX_FRUSTUM_T* frustum, const float min[3], const float max[3])
+{
+    float cx = (min[0] + max[0]) * 0.5f, ex = (max[0] - min[0]) * 0.5f;
+    float cy = (min[1] + max[1]) * 0.5f, ey = (max[1] - min[1]) * 0.5f;
+    float cz = (min[2] + max[2]) * 0.5f, ez = (max[2] - min[2]) * 0.5f;
+
+    // The box is outside a plane if even its corner furthest along the
+    // plane's normal is behind it. Written without branches so that the
+    // compiler can test all the planes at once.
+    int outside = 0;
+    for (int i = 0; i < MX_FRUSTUM_PLANES; i++)
+    {
+        float distance = frustum->a[i] * cx + frustum->b[i] * cy + frustum->c[i] * cz + frustum->d[i];
+        float radius = fabsf(frustum->a[i]) * ex + fabsf(frustum->b[i]) * ey + fabsf(frustum->c[i]) * ez;
+        outside |= distance + radius < 0.f;
+    }
+    return !outside;
+}
@@ -0,0 +1,26 @@
+#ifndef MX_FRUSTUM_H
+#define MX_FRUSTUM_H
+
+#include "matrix.h" // MX_MATRIX_T
+
+#include <stdbool.h> // bool
+
+// The six frustum planes are padded to eight so that tests over all of them
+// fill whole vector registers. Padding planes never reject anything.
+#define MX_FRUSTUM_PLANES (8)
+
+// Planes are stored as separate arrays of each coefficient, so a box can be
+// tested against every plane at once. A point is inside a plane when
+// a * x + b * y + c * z + d >= 0.
+typedef struct
+{
+    float a[MX_FRUSTUM_PLANES];
+    float b[MX_FRUSTUM_PLANES];
+    float c[MX_FRUSTUM_PLANES];
+    float d[MX_FRUSTUM_PLANES];
+} MX_FRUSTUM_T;
+
+void mxFrustumExtract(MX_FRUSTUM_T* frustum, const MX_MATRIX_T m);
+bool mxFrustumTestBox(const MX_FRUSTUM_T* frustum, const float min[3], const float max[3]);
+
+#endif /* MX_FRUSTUM_H */
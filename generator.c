@@ -0,0 +1,326 @@
+///////////////////////////////////////////////////////////////////////////////
+// This file fills chunks with the blocks of a newly generated world. Each
+// chunk depends only on the seed and its own coordinates, so chunks can be
+// generated in any order and on any thread, and a chunk can always be made
+// again exactly as it was.
+//
+// The ground height of each column comes from several octaves of 2D noise.
+// The top block of each column is grass and those below are dirt, except
+// where 3D noise carves out caves.
+//
+// Other scenes can be generated instead, for benchmarks that need a world
+// with known properties: flat plains, solid ground riddled with caves, a
+// checkerboard where no face of any block is hidden, and an island of about
+// a million blocks with nothing around it.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "generator.h"
+#include "noise.h" // mxNoise2, mxNoise3
+
+#include <string.h> // strcmp
+
+// Number of columns in a chunk, and samples in a horizontal slab of a chunk.
+#define COLUMNS (MX_CHUNK_SIZE * MX_CHUNK_SIZE)
+
+// Ground height is HEIGHT_BASE plus or minus up to about HEIGHT_RANGE blocks.
+// The largest hills are HEIGHT_SCALE blocks across.
+#define HEIGHT_BASE     (0.f)
+#define HEIGHT_RANGE    (24.f)
+#define HEIGHT_SCALE    (96.f)
+#define HEIGHT_OCTAVES  (4)
+
+// Caves are where the cave noise is above CAVE_THRESHOLD. They are about
+// CAVE_SCALE blocks across, and are kept CAVE_DEPTH blocks below the ground,
+// apart from where they happen to break through.
+#define CAVE_SCALE      (24.f)
+#define CAVE_OCTAVES    (2)
+#define CAVE_THRESHOLD  (0.35f)
+#define CAVE_DEPTH      (4)
+
+// Noise for each octave and feature is taken from a different seed.
+#define CAVE_SEED_OFFSET (0x9e3779b9u)
+
+// The plains are flat at this height.
+#define PLAINS_HEIGHT   (0)
+
+// The caves scene is solid from CAVES_BOTTOM to CAVES_TOP, with caves carved
+// out wherever the cave noise is above DENSE_CAVE_THRESHOLD, which leaves
+// about half of it open.
+#define CAVES_BOTTOM    (-32)
+#define CAVES_TOP       (16)
+#define DENSE_CAVE_THRESHOLD (0.f)
+
+// The checkerboard is this many blocks deep, below y = 0.
+#define CHECKER_DEPTH   (8)
+
+// The island is the usual terrain within ISLAND_HALF_WIDTH blocks of the
+// origin on each axis, down to ISLAND_BOTTOM, with nothing else around it.
+// It is a whole number of chunks across, which with 16 block chunks makes it
+// 192 x 192 x 28 blocks below y = 0.
+#define ISLAND_HALF_WIDTH (6 * MX_CHUNK_SIZE)
+#define ISLAND_BOTTOM   (-28)
+
+// Scenes that can be generated.
+#define SCENE_HILLS         (0)
+#define SCENE_PLAINS        (1)
+#define SCENE_CAVES         (2)
+#define SCENE_CHECKERBOARD  (3)
+#define SCENE_ISLAND        (4)
+
+static const char* const _scene_names[] = {
+    "hills", "plains", "caves", "checkerboard", "million", NULL
+};
+
+static uint32_t _seed;
+static int _scene;
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets the seed that the whole world is generated from.
+///////////////////////////////////////////////////////////////////////////////
+void mxGeneratorSetup(uint32_t seed)
+{
+    _seed = seed;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Chooses the scene to generate by name: "hills" for the normal world, or
+// "plains", "caves", "checkerboard" or "million". Returns false if there is
+// no scene with that name. Must not be called while chunks are generating.
+///////////////////////////////////////////////////////////////////////////////
+bool mxGeneratorSetScene(const char* name)
+{
+    for (int i = 0; _scene_names[i] != NULL; i++)
+    {
+        if (strcmp(name, _scene_names[i]) == 0)
+        {
+            _scene = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the name of the scene with the given index, or NULL past the last,
+// so that callers can list them.
+///////////////////////////////////////////////////////////////////////////////
+const char* mxGeneratorSceneName(int index)
+{
+    if (index < 0 || index >= (int) (sizeof(_scene_names) / sizeof(_scene_names[0]))) return NULL;
+    return _scene_names[index];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Fills heights with the ground height of count columns at the given world
+// block coordinates, as the sum of octaves of noise.
+///////////////////////////////////////////////////////////////////////////////
+static void column_heights(const float* x, const float* z, int count, int* heights)
+{
+    float sx[COLUMNS], sz[COLUMNS], n[COLUMNS], total[COLUMNS];
+    float frequency = 1.f / HEIGHT_SCALE;
+    float amplitude = HEIGHT_RANGE;
+
+    for (int i = 0; i < count; i++) total[i] = HEIGHT_BASE;
+    for (int octave = 0; octave < HEIGHT_OCTAVES; octave++)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            sx[i] = x[i] * frequency;
+            sz[i] = z[i] * frequency;
+        }
+        mxNoise2(sx, sz, count, _seed + octave, n);
+        for (int i = 0; i < count; i++) total[i] += n[i] * amplitude;
+        frequency *= 2.f;
+        amplitude *= 0.5f;
+    }
+
+    // Round down.
+    for (int i = 0; i < count; i++)
+    {
+        int h = (int) total[i];
+        heights[i] = h - (total[i] < (float) h);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Fills cave with the cave noise for a horizontal slab of a chunk.
+///////////////////////////////////////////////////////////////////////////////
+static void slab_caves(const float* x, float y, const float* z, float* cave)
+{
+    float sx[COLUMNS], sy[COLUMNS], sz[COLUMNS], n[COLUMNS];
+    float frequency = 1.f / CAVE_SCALE;
+    float amplitude = 1.f;
+
+    for (int i = 0; i < COLUMNS; i++) cave[i] = 0.f;
+    for (int octave = 0; octave < CAVE_OCTAVES; octave++)
+    {
+        for (int i = 0; i < COLUMNS; i++)
+        {
+            sx[i] = x[i] * frequency;
+            sy[i] = y * frequency;
+            sz[i] = z[i] * frequency;
+        }
+        mxNoise3(sx, sy, sz, COLUMNS, _seed + CAVE_SEED_OFFSET + octave, n);
+        for (int i = 0; i < COLUMNS; i++) cave[i] += n[i] * amplitude;
+        frequency *= 2.f;
+        amplitude *= 0.5f;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the height of the ground at the given world column, ignoring caves.
+// This is the y coordinate of the top block.
+///////////////////////////////////////////////////////////////////////////////
+int mxGeneratorHeight(int x, int z)
+{
+    switch (_scene)
+    {
+        case SCENE_PLAINS: return PLAINS_HEIGHT;
+        case SCENE_CAVES: return CAVES_TOP;
+        case SCENE_CHECKERBOARD: return -1;
+        case SCENE_ISLAND:
+            if (x < -ISLAND_HALF_WIDTH || x >= ISLAND_HALF_WIDTH ||
+                z < -ISLAND_HALF_WIDTH || z >= ISLAND_HALF_WIDTH) return ISLAND_BOTTOM - 1;
+            break;
+    }
+
+    float fx = (float) x, fz = (float) z;
+    int height;
+    column_heights(&fx, &fz, 1, &height);
+    return height;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Fills the plains: grass at PLAINS_HEIGHT and dirt below.
+///////////////////////////////////////////////////////////////////////////////
+static void fill_plains(MX_CHUNK_T* chunk)
+{
+    int base_y = chunk->cy << MX_CHUNK_BITS;
+    for (int y = 0; y < MX_CHUNK_SIZE && base_y + y <= PLAINS_HEIGHT; y++)
+    {
+        MX_BLOCK_T type = base_y + y == PLAINS_HEIGHT ? MX_BLOCK_GRASS : MX_BLOCK_DIRT;
+        memset(&chunk->blocks[MX_BLOCK_INDEX(0, y, 0)], type, COLUMNS);
+        chunk->solid_count += COLUMNS;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Fills the caves scene: dirt between CAVES_BOTTOM and CAVES_TOP, with grass
+// on top, and large caves through all of it.
+///////////////////////////////////////////////////////////////////////////////
+static void fill_caves(MX_CHUNK_T* chunk, const float* x, const float* z)
+{
+    int base_y = chunk->cy << MX_CHUNK_BITS;
+    float cave[COLUMNS];
+    for (int y = 0; y < MX_CHUNK_SIZE; y++)
+    {
+        int wy = base_y + y;
+        if (wy < CAVES_BOTTOM || wy > CAVES_TOP) continue;
+        slab_caves(x, (float) wy, z, cave);
+
+        MX_BLOCK_T* slab = &chunk->blocks[MX_BLOCK_INDEX(0, y, 0)];
+        int solid = 0;
+        for (int i = 0; i < COLUMNS; i++)
+        {
+            MX_BLOCK_T type = wy == CAVES_TOP ? MX_BLOCK_GRASS : MX_BLOCK_DIRT;
+            if (cave[i] > DENSE_CAVE_THRESHOLD) type = MX_BLOCK_AIR;
+            slab[i] = type;
+            solid += type != MX_BLOCK_AIR;
+        }
+        chunk->solid_count += solid;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Fills the checkerboard, where every other block is solid along each axis,
+// so that every face of every block is drawn.
+///////////////////////////////////////////////////////////////////////////////
+static void fill_checkerboard(MX_CHUNK_T* chunk)
+{
+    int base_x = chunk->cx << MX_CHUNK_BITS;
+    int base_y = chunk->cy << MX_CHUNK_BITS;
+    int base_z = chunk->cz << MX_CHUNK_BITS;
+    for (int y = 0; y < MX_CHUNK_SIZE; y++)
+    {
+        int wy = base_y + y;
+        if (wy < -CHECKER_DEPTH || wy >= 0) continue;
+        for (int z = 0; z < MX_CHUNK_SIZE; z++)
+        {
+            for (int x = 0; x < MX_CHUNK_SIZE; x++)
+            {
+                if (((base_x + x + wy + base_z + z) & 1) == 0) continue;
+                chunk->blocks[MX_BLOCK_INDEX(x, y, z)] = wy == -1 ? MX_BLOCK_GRASS : MX_BLOCK_DIRT;
+                chunk->solid_count++;
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Fills a chunk from mxWorldAllocChunk, which must be empty.
+///////////////////////////////////////////////////////////////////////////////
+void mxGeneratorFill(MX_CHUNK_T* chunk)
+{
+    int base_x = chunk->cx << MX_CHUNK_BITS;
+    int base_y = chunk->cy << MX_CHUNK_BITS;
+    int base_z = chunk->cz << MX_CHUNK_BITS;
+
+    // Column positions, in the same order as blocks in a slab.
+    float x[COLUMNS], z[COLUMNS];
+    for (int i = 0; i < COLUMNS; i++)
+    {
+        x[i] = (float) (base_x + (i & MX_CHUNK_MASK));
+        z[i] = (float) (base_z + (i >> MX_CHUNK_BITS));
+    }
+
+    if (_scene == SCENE_PLAINS)
+    {
+        fill_plains(chunk);
+        return;
+    }
+    if (_scene == SCENE_CAVES)
+    {
+        fill_caves(chunk, x, z);
+        return;
+    }
+    if (_scene == SCENE_CHECKERBOARD)
+    {
+        fill_checkerboard(chunk);
+        return;
+    }
+
+    // The island's chunks are either wholly inside it or wholly outside.
+    if (_scene == SCENE_ISLAND &&
+        (base_x < -ISLAND_HALF_WIDTH || base_x >= ISLAND_HALF_WIDTH ||
+         base_z < -ISLAND_HALF_WIDTH || base_z >= ISLAND_HALF_WIDTH ||
+         base_y + MX_CHUNK_SIZE <= ISLAND_BOTTOM))
+    {
+        return;
+    }
+
+    int heights[COLUMNS];
+    column_heights(x, z, COLUMNS, heights);
+    int highest = heights[0];
+    for (int i = 1; i < COLUMNS; i++) if (heights[i] > highest) highest = heights[i];
+
+    float cave[COLUMNS];
+    for (int y = 0; y < MX_CHUNK_SIZE && base_y + y <= highest; y++)
+    {
+        int wy = base_y + y;
+        if (_scene == SCENE_ISLAND && wy < ISLAND_BOTTOM) continue;
+        slab_caves(x, (float) wy, z, cave);
+
+        MX_BLOCK_T* slab = &chunk->blocks[MX_BLOCK_INDEX(0, y, 0)];
+        int solid = 0;
+        for (int i = 0; i < COLUMNS; i++)
+        {
+            int depth = heights[i] - wy;
+            MX_BLOCK_T type = depth > 0 ? MX_BLOCK_DIRT : MX_BLOCK_GRASS;
+            if (depth < 0) type = MX_BLOCK_AIR;
+            if (cave[i] > CAVE_THRESHOLD && depth >= CAVE_DEPTH) type = MX_BLOCK_AIR;
+            slab[i] = type;
+            solid += type != MX_BLOCK_AIR;
+        }
+        chunk->solid_count += solid;
+    }
+}
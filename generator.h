@@ -0,0 +1,15 @@
+#ifndef MX_GENERATOR_H
+#define MX_GENERATOR_H
+
+#include "world.h" // MX_CHUNK_T
+
+#include <stdbool.h> // bool
+#include <stdint.h> // uint32_t
+
+void mxGeneratorSetup(uint32_t seed);
+bool mxGeneratorSetScene(const char* name);
+const char* mxGeneratorSceneName(int index);
+int mxGeneratorHeight(int x, int z);
+void mxGeneratorFill(MX_CHUNK_T* chunk);
+
+#endif /* MX_GENERATOR_H */
@@ -5,245 +5,759 @@
 #include "debug.h"
 #endif
 
-#include "display.h" // mxDisplaySwapBuffers
-#include "targa.h" // tga_load, TGA_TRUECOLOR_32, tga_error_string, tga_get_last_error
+#include "atlas.h" // mxAtlasBuild, mxAtlasFree, MX_ATLAS_T
+#include "world.h" // mxWorldChunkCount, mxWorldChunk, MX_CHUNK_T
+#include "mesher.h" // mxMesherGather, mxMesherBuild, mxMesherDownsample, MX_MESH_T, MX_MESH_VERTEX_T
+#include "matrix.h" // mxMatrixFrustum, mxMatrixMultiply, mxMatrixTranslate, MX_MATRIX_T
+#include "frustum.h" // mxFrustumExtract, mxFrustumTestBox, MX_FRUSTUM_T
+#include "gl_state.h" // mxGlEnable, mxGlBindBuffer, mxGlDrawElements, etc.
+#include "profiler.h" // mxProfileCount, mxProfileAdd, mxProfileNow
+#include "shader.h" // mxShaderProgram, mxShaderUse, mxShaderCleanup
+#include "jobs.h" // mxJobsSubmit, mxJobsSubmitUrgent, mxJobsFinish, mxJobsPending, MX_JOB_T
+#include "loader.h" // mxLoaderUpdate, mxLoaderPending
+#include "stream.h" // mxStreamUpdate, mxStreamPending, mxStreamRadius
 
-#include <stdlib.h> // free
-#include <math.h> // tan, sqrt
+#include <stdio.h> // fopen, fprintf, fwrite
+#include <stdlib.h> // malloc, realloc, free
+#include <stddef.h> // offsetof
+#include <string.h> // memcpy, memset
+#include <math.h> // tan, sqrt, sqrtf, floorf
+#include <limits.h> // INT_MAX
+#include <sched.h> // sched_yield
 
-#include <GLES/gl.h>
-//#include <GLES2/gl2.h>
-//#include <GLES2/gl2ext.h>
+#include <GLES2/gl2.h>
 
-// Textures are 16x16 pixels square.
-#define TEXTURE_IMAGE_SIZE 16
+// Most chunks that can be being meshed at once. The last few jobs are kept
+// for chunks that have been edited, so that they never wait behind chunks
+// that are streaming in.
+#define MAX_MESH_JOBS 40
+#define URGENT_MESH_JOBS 8
 
-// This is the number of textures to be loaded.
-#define TEXTURE_COUNT 3
+// Most bytes of vertex data uploaded in one frame, so that a burst of meshes
+// finishing together is spread over several frames. At least one mesh is
+// uploaded each frame however large it is.
+#define UPLOAD_BUDGET (256 * 1024)
 
-// The following indexes the available textures.
-#define TEX_DIRT_SIDE 		(0)
-#define TEX_DIRT_TOP 		(1)
-#define TEX_DIRT_BOTTOM 	(2)
+// Chunks are drawn at the coarsest level of detail whose cells cover no more
+// than this many pixels across on screen, at the chunk's nearest point.
+#define LOD_PIXELS (8.f)
+
+// The far plane is at least this far away, in world units, and further if
+// chunks are loaded beyond it.
+#define MIN_FAR_PLANE (4000.f)
 
 #ifndef M_PI
 #define M_PI 3.141592654
 #endif
 
-static GLuint _tex[TEXTURE_COUNT];
-
-static const GLbyte _voxel_vertices[6 * 4 * 3] = {
-
-    // Front
-    -10, -10,  10,
-     10, -10,  10,
-    -10,  10,  10,
-     10,  10,  10,
-
-    // Back
-    -10, -10, -10,
-    -10,  10, -10,
-     10, -10, -10,
-     10,  10, -10,
-
-    // Left
-    -10, -10,  10,
-    -10,  10,  10,
-    -10, -10, -10,
-    -10,  10, -10,
-
-    // Right
-     10, -10, -10,
-     10,  10, -10,
-     10, -10,  10,
-     10,  10,  10,
-
-    // Top
-    -10,  10,  10,
-     10,  10,  10,
-    -10,  10, -10,
-     10,  10, -10,
-
-    // Bottom
-    -10, -10,  10,
-    -10, -10, -10,
-     10, -10,  10,
-     10, -10, -10,
-};
+// Expands a macro into a string, for use in shader sources.
+#define STRINGIFY(x) #x
+#define MX_STRINGIFY(x) STRINGIFY(x)
 
-// Texture coordinates.
-static const GLbyte _voxel_tex_coords[6 * 4 * 2] = {
-
-    1,  0,    
-    0,  0,
-    1,  1,
-    0,  1,
-         
-    0,  0,
-    0,  1,
-    1,  0,
-    1,  1,
-         
-    0,  0,
-    0,  1,
-    1,  0,
-    1,  1,
-         
-    0,  0,
-    0,  1,
-    1,  0,
-    1,  1,
-         
-    1,  0,
-    1,  1,
-    0,  0,
-    0,  1,
-
-    0,  0,
-    0,  1,
-    1,  0,
-    1,  1
-};
+// Vertex attribute locations.
+#define ATTRIB_POSITION     (0)
+#define ATTRIB_TILE         (1)
+#define ATTRIB_FACE         (2)
+#define ATTRIB_AO           (3)
+
+// Most quads drawn by one call, as indices are 16 bits. Larger meshes are
+// drawn in several calls.
+#define MAX_DRAW_QUADS      (65536 / MX_MESH_QUAD_VERTICES)
+
+// All block textures are packed into one atlas texture.
+static MX_ATLAS_T _atlas;
+static GLuint _atlas_tex;
+
+// The chunk shader places each chunk mesh with a single offset uniform, so
+// no matrix work is needed per chunk. Texture coordinates are in blocks, taken
+// from the position along the face's texture axes, and wrap within the
+// vertex's atlas tile. They are kept half a texel inside the tile so that
+// nearest sampling never reaches a neighbouring tile. The ambient occlusion
+// level baked into each vertex scales the colour from 40% to 100%.
+static const char* _chunk_vertex_shader =
+    "uniform mat4 u_mvp;\n"
+    "uniform vec3 u_offset;\n"
+    "uniform vec4 u_tiles[" MX_STRINGIFY(MX_ATLAS_MAX_TILES) "];\n"
+    "uniform vec3 u_face_s[" MX_STRINGIFY(MX_FACE_COUNT) "];\n"
+    "uniform vec3 u_face_t[" MX_STRINGIFY(MX_FACE_COUNT) "];\n"
+    "attribute vec3 a_position;\n"
+    "attribute float a_tile;\n"
+    "attribute float a_face;\n"
+    "attribute float a_ao;\n"
+    "varying vec2 v_tex_coord;\n"
+    "varying vec4 v_tile;\n"
+    "varying float v_light;\n"
+    "void main()\n"
+    "{\n"
+    "    int face = int(a_face);\n"
+    "    v_light = 0.4 + 0.2 * a_ao;\n"
+    "    v_tex_coord = vec2(dot(a_position, u_face_s[face]), dot(a_position, u_face_t[face]));\n"
+    "    v_tile = u_tiles[int(a_tile)];\n"
+    "    gl_Position = u_mvp * vec4(a_position + u_offset, 1.0);\n"
+    "}\n";
+
+static const char* _chunk_fragment_shader =
+    "precision mediump float;\n"
+    "uniform sampler2D u_texture;\n"
+    "uniform vec2 u_half_texel;\n"
+    "varying vec2 v_tex_coord;\n"
+    "varying vec4 v_tile;\n"
+    "varying float v_light;\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 uv = clamp(fract(v_tex_coord) * v_tile.zw, u_half_texel, v_tile.zw - u_half_texel);\n"
+    "    vec4 colour = texture2D(u_texture, v_tile.xy + uv);\n"
+    "    gl_FragColor = vec4(colour.rgb * v_light, colour.a);\n"
+    "}\n";
+
+// Attribute names, in order of their locations.
+static const char* const _chunk_attributes[] = { "a_position", "a_tile", "a_face", "a_ao", NULL };
+
+static GLuint _chunk_program;
+static GLint _u_mvp;
+static GLint _u_offset;
+static GLint _u_texture;
+static GLint _u_tiles;
+static GLint _u_half_texel;
+static GLint _u_face_s;
+static GLint _u_face_t;
+
+// Indices for drawing MAX_DRAW_QUADS quads, shared by every chunk.
+static GLuint _quad_indices;
+
+// The projection is set once, and the view whenever the camera moves.
+static MX_MATRIX_T _projection;
+static MX_MATRIX_T _view;
+
+// Where the camera is, in world units.
+static float _eye[3];
+
+// Pixels across the screen covered by one unit at unit distance, for
+// choosing each chunk's level of detail.
+static float _focal_length;
+static float _lod_pixels = LOD_PIXELS;
+
+static unsigned int _screen_width;
+static unsigned int _screen_height;
+
+// Every chunk that has been meshed has one of these. The vertex buffer is
+// only created once the chunk has something to draw. It holds the chunk's
+// meshes at each level of detail up to lod_levels - 1, one after another.
+typedef struct
+{
+    GLuint vbo;
+    int vertex_count;
+    int lod_levels;
+    int lod_first[MX_LOD_COUNT];
+    int lod_count[MX_LOD_COUNT];
+
+    // Set from when a mesh job is started until its mesh is uploaded.
+    bool meshing;
+
+    // Which faces of the chunk can be seen through it, and the last frame
+    // it was found to be visible from the camera.
+    MX_CONNECTIVITY_T connectivity;
+    unsigned int visible_frame;
+} MX_CHUNK_RENDER_T;
+
+// Chunks are meshed by jobs on the worker threads. Each job holds a copy of
+// the chunk's blocks, taken on the main thread, and the mesh built from them.
+typedef struct
+{
+    MX_JOB_T job;
+
+    // The chunk being meshed, or NULL when the job is free.
+    MX_CHUNK_T* chunk;
+    bool ok;
+    MX_CONNECTIVITY_T connectivity;
+
+    // Levels of detail to build, and where each one's mesh ends in mesh, in
+    // vertices.
+    int lod_levels;
+    int lod_end[MX_LOD_COUNT];
+
+    // When the chunk was edited, for meshes that are urgent, or 0.
+    uint64_t edit_time;
+    MX_BLOCK_T padded[MX_PADDED_VOLUME];
+    MX_BLOCK_T coarse[MX_LOD_PADDED_VOLUME(1)];
+    MX_MESH_T mesh;
+} MX_MESH_JOB_T;
+
+static MX_MESH_JOB_T _mesh_jobs[MAX_MESH_JOBS];
+
+// Finished meshes waiting for upload budget, oldest first.
+static MX_MESH_JOB_T* _uploads[MAX_MESH_JOBS];
+static int _uploads_head;
+static int _uploads_count;
+
+// Bytes that may still be uploaded this frame.
+static int _upload_budget;
+
+// Bytes of vertex data in all chunk vertex buffers.
+static int _mesh_bytes;
+
+// Edited chunks waiting to be meshed, gathered each frame so that the oldest
+// edits can go first.
+static MX_CHUNK_T** _edited;
+static int _edited_capacity;
 
+// Chunks hidden behind rock are culled by searching outwards from the camera
+// through chunks that can be seen through. The search covers the box around
+// all chunks in the world, each frame: the chunk in each cell, whether the
+// search has reached it yet, and the cells waiting to be searched.
 typedef struct
 {
-	GLbyte pos_x;
-	GLbyte pos_y;
-	GLbyte pos_z;
-    unsigned char type;
-} MX_VOXEL_T;
+    int cell;
+
+    // The face the search came in through, and the directions it has taken.
+    unsigned char face;
+    unsigned char directions;
+} MX_VISIT_T;
+
+static bool _cave_culling = true;
+static unsigned int _frame;
+static MX_CHUNK_T** _cells;
+static unsigned char* _reached;
+static MX_VISIT_T* _visits;
+static int _cells_capacity;
+
+// Chunk offsets for each face, in the order of MX_FACE_FRONT, etc.
+static const int _face_offsets[MX_FACE_COUNT][3] = {
+    {  0,  0,  1 },
+    {  0,  0, -1 },
+    { -1,  0,  0 },
+    {  1,  0,  0 },
+    {  0,  1,  0 },
+    {  0, -1,  0 },
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Builds the texture atlas and uploads it, along with the tile rectangles the
+// shader needs to find each tile.
+///////////////////////////////////////////////////////////////////////////////
+static bool load_textures()
+{
+    if (!mxAtlasBuild(&_atlas)) return false;
+
+    glGenTextures(1, &_atlas_tex);
+    mxGlBindTexture(GL_TEXTURE_2D, _atlas_tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _atlas.width, _atlas.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, _atlas.pixels);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    mxShaderUse(_chunk_program);
+    glUniform1i(_u_texture, 0);
+    glUniform4fv(_u_tiles, _atlas.tile_count, &_atlas.tile_rects[0][0]);
+    glUniform2f(_u_half_texel, 0.5f / _atlas.width, 0.5f / _atlas.height);
+
+    GLfloat face_s[MX_FACE_COUNT][3];
+    GLfloat face_t[MX_FACE_COUNT][3];
+    for (int face = 0; face < MX_FACE_COUNT; face++) mxMesherTextureAxes(face, face_s[face], face_t[face]);
+    glUniform3fv(_u_face_s, MX_FACE_COUNT, &face_s[0][0]);
+    glUniform3fv(_u_face_t, MX_FACE_COUNT, &face_t[0][0]);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Creates the index buffer that every chunk mesh is drawn with, which splits
+// each group of four vertices into two triangles.
+///////////////////////////////////////////////////////////////////////////////
+static bool create_quad_indices()
+{
+    static const GLushort quad[MX_MESH_QUAD_INDICES] = { 0, 1, 2, 0, 2, 3 };
+    GLushort* indices = (GLushort*) malloc(MAX_DRAW_QUADS * sizeof(quad));
+    if (indices == NULL) return false;
+    for (int q = 0; q < MAX_DRAW_QUADS; q++)
+        for (int i = 0; i < MX_MESH_QUAD_INDICES; i++)
+            indices[q * MX_MESH_QUAD_INDICES + i] = (GLushort) (q * MX_MESH_QUAD_VERTICES + quad[i]);
+
+    glGenBuffers(1, &_quad_indices);
+    mxGlBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _quad_indices);
+    mxGlBufferData(GL_ELEMENT_ARRAY_BUFFER, MAX_DRAW_QUADS * sizeof(quad), indices, GL_STATIC_DRAW);
+    mxGlBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    free(indices);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the level of detail to draw the chunk at: the coarsest whose cells,
+// 1 << lod blocks wide, cover no more than _lod_pixels on screen at the
+// chunk's nearest point to the camera.
+///////////////////////////////////////////////////////////////////////////////
+static int chunk_lod(const MX_CHUNK_T* chunk)
+{
+    if (_lod_pixels <= 0.f) return 0;
+
+    // Work in blocks, with block corners on whole numbers, like the meshes.
+    int c[3] = { chunk->cx, chunk->cy, chunk->cz };
+    float distance2 = 0.f;
+    for (int a = 0; a < 3; a++)
+    {
+        float eye = _eye[a] / MX_BLOCK_SIZE + 0.5f;
+        float min = (float) (c[a] << MX_CHUNK_BITS);
+        float max = min + MX_CHUNK_SIZE;
+        float outside = eye < min ? min - eye : (eye > max ? eye - max : 0.f);
+        distance2 += outside * outside;
+    }
+
+    // A cell w blocks wide covers w * _focal_length / distance pixels.
+    float widest = _lod_pixels * sqrtf(distance2) / _focal_length;
+    int lod = 0;
+    while (lod + 1 < MX_LOD_COUNT && (float) (2 << lod) <= widest) lod++;
+    return lod;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static void mesh_run(MX_JOB_T* job)
+{
+    MX_MESH_JOB_T* mesh_job = (MX_MESH_JOB_T*) job;
+    MX_MESH_T* mesh = &mesh_job->mesh;
+    mesh->vertex_count = 0;
+    mesh_job->ok = mxMesherBuild(mesh_job->padded, 0, _atlas.face_tiles, mesh);
+    mesh_job->lod_end[0] = mesh->vertex_count;
+
+    // Chunks with nothing to see up close have nothing to see from afar.
+    for (int lod = 1; lod < mesh_job->lod_levels; lod++)
+    {
+        if (mesh_job->ok && mesh_job->lod_end[0] > 0)
+        {
+            mxMesherDownsample(mesh_job->padded, lod, mesh_job->coarse);
+            mesh_job->ok = mxMesherBuild(mesh_job->coarse, lod, _atlas.face_tiles, mesh);
+        }
+        mesh_job->lod_end[lod] = mesh->vertex_count;
+    }
+    mesh_job->connectivity = mxMesherConnectivity(mesh_job->padded);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Copies the mesh into the chunk's vertex buffer and frees the job.
+///////////////////////////////////////////////////////////////////////////////
+static void upload_mesh(MX_MESH_JOB_T* mesh_job)
+{
+    MX_CHUNK_T* chunk = mesh_job->chunk;
+    MX_CHUNK_RENDER_T* render = (MX_CHUNK_RENDER_T*) chunk->render;
+    int vertex_count = mesh_job->ok ? mesh_job->mesh.vertex_count : 0;
+
+#ifdef DEBUG_THIS
+    if (!mesh_job->ok) mxDebug("Out of memory meshing chunk %d, %d, %d", chunk->cx, chunk->cy, chunk->cz);
+#endif
+
+    _mesh_bytes -= render->vertex_count * sizeof(MX_MESH_VERTEX_T);
+    if (vertex_count == 0 && render->vbo != 0)
+    {
+        mxGlDeleteBuffers(1, &render->vbo);
+        render->vbo = 0;
+    }
+    else if (vertex_count > 0)
+    {
+        int size = vertex_count * sizeof(MX_MESH_VERTEX_T);
+        if (render->vbo == 0) glGenBuffers(1, &render->vbo);
+        mxGlBindBuffer(GL_ARRAY_BUFFER, render->vbo);
+        mxGlBufferData(GL_ARRAY_BUFFER, size, mesh_job->mesh.vertices, GL_STATIC_DRAW);
+        _upload_budget -= size;
+        _mesh_bytes += size;
+    }
+    render->vertex_count = vertex_count;
+    render->lod_levels = mesh_job->lod_levels;
+    for (int lod = 0; lod < mesh_job->lod_levels; lod++)
+    {
+        render->lod_first[lod] = lod > 0 && vertex_count > 0 ? mesh_job->lod_end[lod - 1] : 0;
+        render->lod_count[lod] = vertex_count > 0 ? mesh_job->lod_end[lod] - render->lod_first[lod] : 0;
+    }
+    render->connectivity = mesh_job->connectivity;
+    render->meshing = false;
+    mesh_job->chunk = NULL;
+    if (mesh_job->edit_time != 0) mxProfileAdd(MX_PROFILE_CHUNK_EDIT, mxProfileNow() - mesh_job->edit_time);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Uploads the finished mesh now if it's urgent or this frame's budget allows,
+// and otherwise queues it behind any others waiting.
+///////////////////////////////////////////////////////////////////////////////
+static void mesh_finish(MX_JOB_T* job)
+{
+    MX_MESH_JOB_T* mesh_job = (MX_MESH_JOB_T*) job;
+    if (mesh_job->edit_time != 0 || (_uploads_count == 0 && _upload_budget > 0))
+    {
+        upload_mesh(mesh_job);
+        return;
+    }
+    _uploads[(_uploads_head + _uploads_count++) % MAX_MESH_JOBS] = mesh_job;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Starts a job to mesh the chunk, ahead of other jobs if it has been edited.
+// Returns false if that can't be done yet.
+///////////////////////////////////////////////////////////////////////////////
+static bool start_mesh(MX_CHUNK_T* chunk)
+{
+    bool urgent = chunk->edit_time != 0;
+    int job_count = urgent ? MAX_MESH_JOBS : MAX_MESH_JOBS - URGENT_MESH_JOBS;
+    MX_MESH_JOB_T* mesh_job = NULL;
+    for (int i = 0; i < job_count && mesh_job == NULL; i++)
+        if (_mesh_jobs[i].chunk == NULL) mesh_job = &_mesh_jobs[i];
+    if (mesh_job == NULL) return false;
+
+    MX_CHUNK_RENDER_T* render = (MX_CHUNK_RENDER_T*) chunk->render;
+    if (render == NULL)
+    {
+        render = (MX_CHUNK_RENDER_T*) calloc(1, sizeof(MX_CHUNK_RENDER_T));
+        if (render == NULL) return false;
+        render->connectivity = MX_CONNECTIVITY_ALL;
+        chunk->render = render;
+    }
+
+    mxMesherGather(chunk, mesh_job->padded);
+    mesh_job->job.run = mesh_run;
+    mesh_job->job.finish = mesh_finish;
+    mesh_job->chunk = chunk;
+    mesh_job->edit_time = chunk->edit_time;
+
+    // Coarse meshes are only built for chunks far enough away to be drawn
+    // with them, and never for edits, which must be quick. Chunks that end
+    // up further away are meshed again when they need them.
+    mesh_job->lod_levels = urgent ? 1 : chunk_lod(chunk) + 1;
+    if (!(urgent ? mxJobsSubmitUrgent(&mesh_job->job) : mxJobsSubmit(&mesh_job->job)))
+    {
+        mesh_job->chunk = NULL;
+        return false;
+    }
+    render->meshing = true;
+    chunk->dirty = false;
+    chunk->edit_time = 0;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Brings the chunk's mesh up to date, or starts a job to. Chunks with nothing
+// in them don't need a job to find that they have no mesh. Returns false if
+// the job can't be started yet.
+///////////////////////////////////////////////////////////////////////////////
+static bool update_chunk(MX_CHUNK_T* chunk)
+{
+    MX_CHUNK_RENDER_T* render = (MX_CHUNK_RENDER_T*) chunk->render;
+    if (chunk->solid_count > 0) return start_mesh(chunk);
+
+    if (render != NULL && render->vbo != 0)
+    {
+        mxGlDeleteBuffers(1, &render->vbo);
+        _mesh_bytes -= render->vertex_count * sizeof(MX_MESH_VERTEX_T);
+        render->vbo = 0;
+        render->vertex_count = 0;
+        memset(render->lod_count, 0, sizeof(render->lod_count));
+    }
+    if (render != NULL) render->connectivity = MX_CONNECTIVITY_ALL;
+    if (chunk->edit_time != 0) mxProfileAdd(MX_PROFILE_CHUNK_EDIT, mxProfileNow() - chunk->edit_time);
+    chunk->dirty = false;
+    chunk->edit_time = 0;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Deletes the chunk's vertex buffer, so that it can be removed from the world.
+// Returns false if the chunk is being meshed, in which case it must be left
+// in the world until it isn't.
+///////////////////////////////////////////////////////////////////////////////
+bool mxGraphicsReleaseChunk(MX_CHUNK_T* chunk)
+{
+    MX_CHUNK_RENDER_T* render = (MX_CHUNK_RENDER_T*) chunk->render;
+    if (render == NULL) return true;
+    if (render->meshing) return false;
+
+    if (render->vbo != 0) mxGlDeleteBuffers(1, &render->vbo);
+    _mesh_bytes -= render->vertex_count * sizeof(MX_MESH_VERTEX_T);
+    free(render);
+    chunk->render = NULL;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the bytes of vertex data held by the GPU for all chunks.
+///////////////////////////////////////////////////////////////////////////////
+int mxGraphicsMeshBytes()
+{
+    return _mesh_bytes;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static int compare_edit_times(const void* a, const void* b)
+{
+    uint64_t ta = (*(MX_CHUNK_T* const*) a)->edit_time;
+    uint64_t tb = (*(MX_CHUNK_T* const*) b)->edit_time;
+    return ta < tb ? -1 : ta > tb;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Starts meshing edited chunks, those edited longest ago first, so that when
+// edits come faster than they can be meshed none of them waits forever.
+// Returns false if it ran out of jobs.
+///////////////////////////////////////////////////////////////////////////////
+static bool update_edited_chunks(int chunk_count)
+{
+    if (chunk_count > _edited_capacity)
+    {
+        MX_CHUNK_T** edited = (MX_CHUNK_T**) realloc(_edited, chunk_count * sizeof(MX_CHUNK_T*));
+        if (edited == NULL) return true;
+        _edited = edited;
+        _edited_capacity = chunk_count;
+    }
+
+    int edited_count = 0;
+    for (int i = 0; i < chunk_count; i++)
+    {
+        MX_CHUNK_T* chunk = mxWorldChunk(i);
+        if (!chunk->dirty || chunk->edit_time == 0) continue;
+        MX_CHUNK_RENDER_T* render = (MX_CHUNK_RENDER_T*) chunk->render;
+        if (render != NULL && render->meshing) continue;
+        _edited[edited_count++] = chunk;
+    }
+    qsort(_edited, edited_count, sizeof(MX_CHUNK_T*), compare_edit_times);
+
+    for (int i = 0; i < edited_count; i++)
+        if (!update_chunk(_edited[i])) return false;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Uploads finished meshes, up to the given number of bytes, brings chunks in
+// and out of the world around the player, and starts meshing chunks that have
+// changed.
+///////////////////////////////////////////////////////////////////////////////
+static void update_chunks(int budget)
+{
+    _upload_budget = budget;
+    while (_uploads_count > 0 && _upload_budget > 0)
+    {
+        upload_mesh(_uploads[_uploads_head]);
+        _uploads_head = (_uploads_head + 1) % MAX_MESH_JOBS;
+        _uploads_count--;
+    }
+    mxJobsFinish();
+    mxStreamUpdate();
+    mxLoaderUpdate();
+    mxGlBindBuffer(GL_ARRAY_BUFFER, 0);
 
-static MX_VOXEL_T _voxels[1000];
-static int _voxels_count;
+    // Edited chunks first, then the rest.
+    int chunk_count = mxWorldChunkCount();
+    update_edited_chunks(chunk_count);
+    for (int i = 0; i < chunk_count; i++)
+    {
+        MX_CHUNK_T* chunk = mxWorldChunk(i);
+        if (!chunk->dirty || chunk->edit_time != 0) continue;
+
+        MX_CHUNK_RENDER_T* render = (MX_CHUNK_RENDER_T*) chunk->render;
+        if (render != NULL && render->meshing) continue;
+        if (!update_chunk(chunk)) break;
+    }
+}
 
 ///////////////////////////////////////////////////////////////////////////////
-static unsigned char* load_texture(char* filename)
+static void paint_chunk(MX_CHUNK_T* chunk, int lod)
 {
-    int w, h;
-    unsigned char* tex = (unsigned char*) tga_load(filename, &w, &h, TGA_TRUECOLOR_32);
-    if (tex == NULL) mxDebugStr(tga_error_string(tga_get_last_error()));
-    mxDebug("width = %d; height = %d", w, h);
-    return tex;
+    MX_CHUNK_RENDER_T* render = (MX_CHUNK_RENDER_T*) chunk->render;
+
+    glUniform3f(_u_offset,
+                (GLfloat) (chunk->cx << MX_CHUNK_BITS),
+                (GLfloat) (chunk->cy << MX_CHUNK_BITS),
+                (GLfloat) (chunk->cz << MX_CHUNK_BITS));
+
+    mxGlBindBuffer(GL_ARRAY_BUFFER, render->vbo);
+    int quad_count = render->lod_count[lod] / MX_MESH_QUAD_VERTICES;
+    for (int first = 0; first < quad_count; first += MAX_DRAW_QUADS)
+    {
+        // Later draws start the attributes further into the buffer, as the
+        // indices always start from zero.
+        int first_vertex = render->lod_first[lod] + first * MX_MESH_QUAD_VERTICES;
+        const char* base = (const char*) NULL + first_vertex * sizeof(MX_MESH_VERTEX_T);
+        glVertexAttribPointer(ATTRIB_POSITION, 3, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(MX_MESH_VERTEX_T),
+                              base + offsetof(MX_MESH_VERTEX_T, x));
+        glVertexAttribPointer(ATTRIB_TILE, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(MX_MESH_VERTEX_T),
+                              base + offsetof(MX_MESH_VERTEX_T, tile));
+        glVertexAttribPointer(ATTRIB_FACE, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(MX_MESH_VERTEX_T),
+                              base + offsetof(MX_MESH_VERTEX_T, face));
+        glVertexAttribPointer(ATTRIB_AO, 1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(MX_MESH_VERTEX_T),
+                              base + offsetof(MX_MESH_VERTEX_T, ao));
+
+        int count = quad_count - first < MAX_DRAW_QUADS ? quad_count - first : MAX_DRAW_QUADS;
+        mxGlDrawElements(GL_TRIANGLES, count * MX_MESH_QUAD_INDICES, GL_UNSIGNED_SHORT, 0);
+    }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-static void load_textures()
+// Returns false if the chunk's box is outside the frustum.
+///////////////////////////////////////////////////////////////////////////////
+static bool chunk_in_frustum(const MX_FRUSTUM_T* frustum, int cx, int cy, int cz)
 {
-    // TEX_DIRT_SIDE
-    unsigned char* _tex_side = load_texture("terrain/block_dirt_side.tga");
-    glBindTexture(GL_TEXTURE_2D, _tex[TEX_DIRT_SIDE]);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, TEXTURE_IMAGE_SIZE, TEXTURE_IMAGE_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, _tex_side);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (GLfloat) GL_NEAREST);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, (GLfloat) GL_NEAREST);
-    free(_tex_side);
-
-    // TEX_DIRT_TOP
-    unsigned char* _tex_top = load_texture("terrain/block_dirt_top.tga");
-    glBindTexture(GL_TEXTURE_2D, _tex[TEX_DIRT_TOP]);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, TEXTURE_IMAGE_SIZE, TEXTURE_IMAGE_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, _tex_top);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (GLfloat) GL_NEAREST);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, (GLfloat) GL_NEAREST);
-    free(_tex_top);
-
-    // TEX_DIRT_BOTTOM
-    unsigned char* _tex_bottom = load_texture("terrain/block_dirt_bottom.tga");
-    glBindTexture(GL_TEXTURE_2D, _tex[TEX_DIRT_BOTTOM]);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, TEXTURE_IMAGE_SIZE, TEXTURE_IMAGE_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, _tex_bottom);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (GLfloat) GL_NEAREST);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, (GLfloat) GL_NEAREST);
-    free(_tex_bottom);
+    float min[3] = {
+        (float) (cx << MX_CHUNK_BITS),
+        (float) (cy << MX_CHUNK_BITS),
+        (float) (cz << MX_CHUNK_BITS)
+    };
+    float max[3] = { min[0] + MX_CHUNK_SIZE, min[1] + MX_CHUNK_SIZE, min[2] + MX_CHUNK_SIZE };
+    return mxFrustumTestBox(frustum, min, max);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-static void paint_voxel(GLbyte pos_x, GLbyte pos_y, GLbyte pos_z, unsigned char type)
+// Marks the chunks that may be visible from the camera this frame, by a
+// breadth first search from the camera's chunk. The search goes from a chunk
+// into its neighbour through a face only if that face is joined by air to the
+// face it came in through, the neighbour is in the frustum, and it never
+// turns back towards the camera along any axis. Chunks that aren't in the
+// world, or haven't been meshed, are taken to be open. Returns false if the
+// camera is outside the world, where nothing is culled.
+///////////////////////////////////////////////////////////////////////////////
+static bool find_visible_chunks(const MX_FRUSTUM_T* frustum)
 {
-    glPushMatrix();
-    
-    unsigned char front, back, left, right, top, bottom;
-    switch (type)
+    int chunk_count = mxWorldChunkCount();
+    if (chunk_count == 0) return false;
+
+    int min[3], max[3];
+    for (int i = 0; i < chunk_count; i++)
+    {
+        const MX_CHUNK_T* chunk = mxWorldChunk(i);
+        int c[3] = { chunk->cx, chunk->cy, chunk->cz };
+        for (int a = 0; a < 3; a++)
+        {
+            if (i == 0 || c[a] < min[a]) min[a] = c[a];
+            if (i == 0 || c[a] > max[a]) max[a] = c[a];
+        }
+    }
+
+    int camera[3], size[3];
+    for (int a = 0; a < 3; a++)
+    {
+        camera[a] = (int) floorf(_eye[a] / MX_BLOCK_SIZE + 0.5f) >> MX_CHUNK_BITS;
+        if (camera[a] < min[a] || camera[a] > max[a]) return false;
+        size[a] = max[a] - min[a] + 1;
+    }
+
+    int cell_count = size[0] * size[1] * size[2];
+    if (cell_count > _cells_capacity)
+    {
+        MX_CHUNK_T** cells = (MX_CHUNK_T**) realloc(_cells, cell_count * sizeof(MX_CHUNK_T*));
+        if (cells != NULL) _cells = cells;
+        unsigned char* reached = (unsigned char*) realloc(_reached, cell_count);
+        if (reached != NULL) _reached = reached;
+        MX_VISIT_T* visits = (MX_VISIT_T*) realloc(_visits, cell_count * sizeof(MX_VISIT_T));
+        if (visits != NULL) _visits = visits;
+        if (cells == NULL || reached == NULL || visits == NULL) return false;
+        _cells_capacity = cell_count;
+    }
+    memset(_cells, 0, cell_count * sizeof(MX_CHUNK_T*));
+    memset(_reached, 0, cell_count);
+    for (int i = 0; i < chunk_count; i++)
+    {
+        MX_CHUNK_T* chunk = mxWorldChunk(i);
+        _cells[((chunk->cy - min[1]) * size[2] + (chunk->cz - min[2])) * size[0] + (chunk->cx - min[0])] = chunk;
+    }
+
+    // The camera's chunk can be seen out of through every face.
+    int head = 0, tail = 0;
+    int start = ((camera[1] - min[1]) * size[2] + (camera[2] - min[2])) * size[0] + (camera[0] - min[0]);
+    _reached[start] = 1;
+    _visits[tail].cell = start;
+    _visits[tail].face = MX_FACE_COUNT;
+    _visits[tail].directions = 0;
+    tail++;
+
+    while (head < tail)
     {
-        case 0:
-            front = back = left = right = _tex[TEX_DIRT_SIDE];
-            top = _tex[TEX_DIRT_TOP];
-            bottom = _tex[TEX_DIRT_BOTTOM];
-            break;
+        const MX_VISIT_T* visit = &_visits[head++];
+        MX_CHUNK_T* chunk = _cells[visit->cell];
+        MX_CHUNK_RENDER_T* render = chunk != NULL ? (MX_CHUNK_RENDER_T*) chunk->render : NULL;
+        MX_CONNECTIVITY_T connectivity = render != NULL ? render->connectivity : MX_CONNECTIVITY_ALL;
+        if (render != NULL) render->visible_frame = _frame;
+
+        int c[3] = {
+            visit->cell % size[0],
+            visit->cell / (size[0] * size[2]),
+            (visit->cell / size[0]) % size[2]
+        };
+        for (int face = 0; face < MX_FACE_COUNT; face++)
+        {
+            // Faces come in opposite pairs, so face ^ 1 is the way back.
+            if (visit->directions & (1u << (face ^ 1))) continue;
+            if (visit->face < MX_FACE_COUNT && !MX_FACES_CONNECTED(connectivity, visit->face, face)) continue;
+
+            int n[3];
+            bool inside = true;
+            for (int a = 0; a < 3; a++)
+            {
+                n[a] = c[a] + _face_offsets[face][a];
+                inside = inside && n[a] >= 0 && n[a] < size[a];
+            }
+            if (!inside) continue;
+
+            int cell = (n[1] * size[2] + n[2]) * size[0] + n[0];
+            if (_reached[cell]) continue;
+            _reached[cell] = 1;
+            if (!chunk_in_frustum(frustum, n[0] + min[0], n[1] + min[1], n[2] + min[2])) continue;
+
+            _visits[tail].cell = cell;
+            _visits[tail].face = (unsigned char) (face ^ 1);
+            _visits[tail].directions = (unsigned char) (visit->directions | (1u << face));
+            tail++;
+        }
     }
-    
-    // Translate to position
-    glTranslatef(pos_x, pos_y, pos_z);
-        
-    // Front
-    glBindTexture(GL_TEXTURE_2D, front);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-
-    // Back
-    glBindTexture(GL_TEXTURE_2D, back);
-    glDrawArrays(GL_TRIANGLE_STRIP, 4, 4);
-
-    // Left
-    glBindTexture(GL_TEXTURE_2D, left);
-    glDrawArrays(GL_TRIANGLE_STRIP, 8, 4);
-
-    // Right
-    glBindTexture(GL_TEXTURE_2D, right);
-    glDrawArrays(GL_TRIANGLE_STRIP, 12, 4);
-
-    // Top
-    glBindTexture(GL_TEXTURE_2D, top);
-    glDrawArrays(GL_TRIANGLE_STRIP, 16, 4);
-
-    // Bottom
-    glBindTexture(GL_TEXTURE_2D, bottom);
-    glDrawArrays(GL_TRIANGLE_STRIP, 20, 4);
-    
-    glPopMatrix();
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Turns culling of chunks hidden behind rock on or off, for comparison.
+///////////////////////////////////////////////////////////////////////////////
+void mxGraphicsSetCaveCulling(bool enabled)
+{
+    _cave_culling = enabled;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets how many pixels across the cells of distant chunks may cover before a
+// finer level of detail is used. Zero draws every chunk in full detail.
+///////////////////////////////////////////////////////////////////////////////
+void mxGraphicsSetLodPixels(float pixels)
+{
+    _lod_pixels = pixels;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 bool mxGraphicsSetup(unsigned int screen_width, unsigned int screen_height)
 {    
     // OpenGL set-up.
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-    glVertexPointer(3, GL_BYTE, 0, &_voxel_vertices);
-    glTexCoordPointer(2, GL_BYTE, 0, &_voxel_tex_coords);
-    glGenTextures(TEXTURE_COUNT, &_tex[0]);
-    load_textures();
+    mxGlReset();
+    _chunk_program = mxShaderProgram(_chunk_vertex_shader, _chunk_fragment_shader, _chunk_attributes);
+    if (_chunk_program == 0) return false;
+    _u_mvp = glGetUniformLocation(_chunk_program, "u_mvp");
+    _u_offset = glGetUniformLocation(_chunk_program, "u_offset");
+    _u_texture = glGetUniformLocation(_chunk_program, "u_texture");
+    _u_tiles = glGetUniformLocation(_chunk_program, "u_tiles");
+    _u_half_texel = glGetUniformLocation(_chunk_program, "u_half_texel");
+    _u_face_s = glGetUniformLocation(_chunk_program, "u_face_s");
+    _u_face_t = glGetUniformLocation(_chunk_program, "u_face_t");
+    if (!load_textures()) return false;
+    if (!create_quad_indices()) return false;
 
     // Configure the viewport. TODO: Screen size changes after init?
+    _screen_width = screen_width;
+    _screen_height = screen_height;
     glViewport(0, 0, (GLsizei) screen_width, (GLsizei) screen_height);
+    glDepthFunc(GL_LEQUAL);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     // Set-up the view frustum.
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
     float fovy = 45.f;
     float aspect = (float) screen_width / (float) screen_height;
     float zNear = 1.0f;
-    float zFar = 1000.0f;
+    float zFar = (mxStreamRadius() + 1) * (float) (MX_CHUNK_SIZE * MX_BLOCK_SIZE);
+    if (zFar < MIN_FAR_PLANE) zFar = MIN_FAR_PLANE;
     float yMax = zNear * (float) tan(fovy * M_PI / 360.0);
     float yMin = -yMax;
     float xMin = yMin * aspect;
     float xMax = yMax * aspect;
-    glFrustumf(xMin, xMax, yMin, yMax, zNear, zFar);
-
-    // TODO: Plot chunks instead of single cubes.
-	// TODO: To replace this with Lua script.
-    int n = 1;
-    for (int z = -n; z <= n; z++)
-    {
-        for (int x = -n; x <= n; x++)
-        {
-            for (int y = -n; y <= n; y++)
-            {
-                MX_VOXEL_T *voxel = &_voxels[_voxels_count++];
-                voxel->pos_x = x * 20;
-                voxel->pos_z = z * 20;
-                voxel->pos_y = y * 20;
-                voxel->type = 0;
-            }
-        }
-    }
-    
+    mxMatrixFrustum(_projection, xMin, xMax, yMin, yMax, zNear, zFar);
+    _focal_length = (float) screen_height / (2.f * yMax / zNear);
+    mxMatrixIdentity(_view);
     return true;
 }
 
@@ -257,9 +771,6 @@ void mxGraphicsLookAt(float eyeX, float eyeY, float eyeZ, float centerX, float c
     static const float upY = 1.f;
     static const float upZ = 0.f;
 
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-
     ///////////////////////////////////////////////////////////////////////////////
     // Copyright (C) 1999-2007  Brian Paul   All Rights Reserved.
     // 
@@ -331,7 +842,7 @@ void mxGraphicsLookAt(float eyeX, float eyeY, float eyeZ, float centerX, float c
         y[2] /= mag;
     }
 
-    GLfloat m[16];
+    MX_MATRIX_T m;
 #define M(row, col) m[col * 4 + row]
     M(0, 0) = x[0];
     M(0, 1) = x[1];
@@ -350,10 +861,13 @@ void mxGraphicsLookAt(float eyeX, float eyeY, float eyeZ, float centerX, float c
     M(3, 2) = 0.0;
     M(3, 3) = 1.0;
 #undef M
-    glMultMatrixf(m);
 
     // Translate Eye to Origin.
-    glTranslatef(-eyeX, -eyeY, -eyeZ);
+    mxMatrixTranslate(m, -eyeX, -eyeY, -eyeZ);
+    memcpy(_view, m, sizeof(MX_MATRIX_T));
+    _eye[0] = eyeX;
+    _eye[1] = eyeY;
+    _eye[2] = eyeZ;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -364,6 +878,8 @@ void mxGraphicsUpdate(float timeSinceLastUpdate)
 ///////////////////////////////////////////////////////////////////////////////
 void mxGraphicsPaint()
 {
+    update_chunks(UPLOAD_BUDGET);
+
     // Set background color and clear buffers.
     // NOTE: Console text remains visible if you either use alpha transparency
     //       or don't set the colour at all.
@@ -371,37 +887,171 @@ void mxGraphicsPaint()
     glClearColor((float) 135 / 255, (float) 127 / 255, (float) 235 / 255, 0.80f);
     glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 
-    glEnable(GL_TEXTURE_2D);
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
-    glEnable(GL_BLEND);
+    mxGlEnable(GL_DEPTH_TEST);
+    mxGlEnable(GL_CULL_FACE);
+    mxGlEnable(GL_BLEND);
 
-    glDepthFunc(GL_LEQUAL);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    
-    // Render world.
-    // TODO: Use default shader program.
-    // TODO: Render chunks.
+    // Render world. Mesh vertices are block corners relative to the chunk
+    // origin, whereas blocks are centred on their coordinates.
+    MX_MATRIX_T mvp;
+    mxMatrixMultiply(mvp, _projection, _view);
+    mxMatrixScale(mvp, (float) MX_BLOCK_SIZE, (float) MX_BLOCK_SIZE, (float) MX_BLOCK_SIZE);
+    mxMatrixTranslate(mvp, -0.5f, -0.5f, -0.5f);
+
+    mxShaderUse(_chunk_program);
+    glUniformMatrix4fv(_u_mvp, 1, GL_FALSE, mvp);
+    mxGlActiveTexture(GL_TEXTURE0);
+    mxGlBindTexture(GL_TEXTURE_2D, _atlas_tex);
+    mxGlBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _quad_indices);
+    mxGlEnableVertexAttribArray(ATTRIB_POSITION);
+    mxGlEnableVertexAttribArray(ATTRIB_TILE);
+    mxGlEnableVertexAttribArray(ATTRIB_FACE);
+    mxGlEnableVertexAttribArray(ATTRIB_AO);
+
+    // Chunks are tested in the same space as their mesh vertices, in blocks.
+    MX_FRUSTUM_T frustum;
+    mxFrustumExtract(&frustum, mvp);
+    _frame++;
+    bool hide = _cave_culling && find_visible_chunks(&frustum);
+
+	// Paint visible chunks.
+    int drawn = 0;
+    int culled = 0;
+    int hidden = 0;
+    int coarse = 0;
+    int chunk_count = mxWorldChunkCount();
+    for (int i = 0; i < chunk_count; i++)
+    {
+        MX_CHUNK_T* chunk = mxWorldChunk(i);
+        MX_CHUNK_RENDER_T* render = (MX_CHUNK_RENDER_T*) chunk->render;
+        if (render == NULL || render->vertex_count == 0) continue;
+
+        if (!chunk_in_frustum(&frustum, chunk->cx, chunk->cy, chunk->cz))
+        {
+            culled++;
+            continue;
+        }
+        if (hide && render->visible_frame != _frame)
+        {
+            hidden++;
+            continue;
+        }
+        int lod = chunk_lod(chunk);
+        if (lod >= render->lod_levels)
+        {
+            if (!render->meshing) chunk->dirty = true;
+            lod = render->lod_levels - 1;
+        }
+        paint_chunk(chunk, lod);
+        drawn++;
+        if (lod > 0) coarse++;
+    }
+    mxProfileCount(MX_PROFILE_CHUNKS_DRAWN, drawn);
+    mxProfileCount(MX_PROFILE_CHUNKS_CULLED, culled);
+    mxProfileCount(MX_PROFILE_CHUNKS_HIDDEN, hidden);
+    mxProfileCount(MX_PROFILE_CHUNKS_COARSE, coarse);
 
-	// Paint voxels.
-    for (int i = 0; i < _voxels_count; i++)
-        paint_voxel(_voxels[i].pos_x, _voxels[i].pos_y, _voxels[i].pos_z, _voxels[i].type);
-    
-    glDisable(GL_CULL_FACE);
-    
     // TODO: Use chunk alpha shader program.
     // TODO: Render chunks.
 
-    glDisable(GL_TEXTURE_2D);
-    glDisable(GL_DEPTH_TEST);
-    glDisable(GL_CULL_FACE);
-    glDisable(GL_BLEND);
+    // The state is left set for the next frame, where setting it again is
+    // skipped by the state cache, as nothing else draws in between.
+    mxGlStatsFrame();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Waits until every chunk around the player has been loaded, meshed and
+// uploaded, and those too far away have been unloaded. This blocks, so is
+// only for use before the game starts, or where a frame must not depend on
+// how fast the workers are.
+///////////////////////////////////////////////////////////////////////////////
+void mxGraphicsFinishLoading()
+{
+    for (;;)
+    {
+        update_chunks(INT_MAX);
+        bool busy = mxStreamPending() > 0 || mxLoaderPending() > 0 || mxJobsPending() > 0 || _uploads_count > 0;
+        int chunk_count = mxWorldChunkCount();
+        for (int i = 0; i < chunk_count && !busy; i++) busy = mxWorldChunk(i)->dirty;
+        if (!busy) break;
+        sched_yield();
+    }
+    mxGlStatsClear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes the current contents of the frame buffer to a binary PPM file, so
+// that a rendered frame can be compared with a reference image. Returns false
+// on failure.
+///////////////////////////////////////////////////////////////////////////////
+bool mxGraphicsSaveFrame(const char* filename)
+{
+    unsigned int w = _screen_width;
+    unsigned int h = _screen_height;
+    unsigned char* rgba = (unsigned char*) malloc(w * h * 4 + w * 3);
+    if (rgba == NULL) return false;
+    unsigned char* row = &rgba[w * h * 4];
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, (GLsizei) w, (GLsizei) h, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+
+    FILE* f = fopen(filename, "wb");
+    if (f == NULL)
+    {
+        free(rgba);
+        return false;
+    }
 
-    // Show the re-painted display.
-    mxDisplaySwapBuffers();
+    // GL rows start at the bottom, PPM rows at the top.
+    bool ok = fprintf(f, "P6\n%u %u\n255\n", w, h) > 0;
+    for (unsigned int y = h; ok && y-- > 0;)
+    {
+        const unsigned char* src = &rgba[y * w * 4];
+        for (unsigned int x = 0; x < w; x++)
+        {
+            row[x * 3 + 0] = src[x * 4 + 0];
+            row[x * 3 + 1] = src[x * 4 + 1];
+            row[x * 3 + 2] = src[x * 4 + 2];
+        }
+        ok = fwrite(row, 3, w, f) == w;
+    }
+    if (fclose(f) != 0) ok = false;
+    free(rgba);
+    return ok;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 void mxGraphicsCleanup()
 {
+    int chunk_count = mxWorldChunkCount();
+    for (int i = 0; i < chunk_count; i++)
+    {
+        MX_CHUNK_T* chunk = mxWorldChunk(i);
+        MX_CHUNK_RENDER_T* render = (MX_CHUNK_RENDER_T*) chunk->render;
+        if (render == NULL) continue;
+        if (render->vbo != 0) mxGlDeleteBuffers(1, &render->vbo);
+        free(render);
+        chunk->render = NULL;
+    }
+    for (int i = 0; i < MAX_MESH_JOBS; i++)
+    {
+        mxMesherFree(&_mesh_jobs[i].mesh);
+        _mesh_jobs[i].chunk = NULL;
+    }
+    _uploads_head = _uploads_count = 0;
+    _mesh_bytes = 0;
+    free(_edited);
+    _edited = NULL;
+    _edited_capacity = 0;
+    free(_cells);
+    free(_reached);
+    free(_visits);
+    _cells = NULL;
+    _reached = NULL;
+    _visits = NULL;
+    _cells_capacity = 0;
+    mxGlDeleteBuffers(1, &_quad_indices);
+    _quad_indices = 0;
+    mxGlDeleteTextures(1, &_atlas_tex);
+    mxAtlasFree(&_atlas);
+    mxShaderCleanup();
 }
@@ -1,16 +1,20 @@
 #ifndef MX_GFX_H
 #define MX_GFX_H
 
+#include "world.h" // MX_CHUNK_T
+
 #include <stdbool.h> // bool
 
 bool mxGraphicsSetup(unsigned int screen_width, unsigned int screen_height);
 void mxGraphicsLookAt(float eyeX, float eyeY, float eyeZ, float centerX, float centerY, float centerZ);
+void mxGraphicsSetCaveCulling(bool enabled);
+void mxGraphicsSetLodPixels(float pixels);
 void mxGraphicsUpdate(float timeSinceLastUpdate);
 void mxGraphicsPaint();
-void mxGraphicsCleanup();
-
-#endif /* MX_GFX_H */
-int();
+bool mxGraphicsReleaseChunk(MX_CHUNK_T* chunk);
+int mxGraphicsMeshBytes();
+void mxGraphicsFinishLoading();
+bool mxGraphicsSaveFrame(const char* filename);
 void mxGraphicsCleanup();
 
 #endif /* MX_GFX_H */
@@ -0,0 +1,270 @@
+///////////////////////////////////////////////////////////////////////////////
+// This file wraps the GL calls that change state or draw, so that calls that
+// would set state to what it already is are skipped, and so that the work
+// done in each frame can be counted: draw calls, vertices and triangles,
+// texture binds, bytes of buffer data uploaded, state changes made, and
+// state changes skipped because they changed nothing.
+//
+// The cache only knows about calls made through these functions, so all GL
+// state these cover must be changed through them. Until a piece of state has
+// been set once its value is unknown, and the first call always goes to GL.
+// Only the main thread may use GL, so there are no locks.
+//
+// The counts are added to the profile once a frame. Define MX_NO_GL_STATS to
+// compile the counting out; the cache is kept either way.
+///////////////////////////////////////////////////////////////////////////////
+
+// Enable or disable debugging in this file.
+//#define DEBUG_THIS
+
+#ifdef DEBUG_THIS
+#include "debug.h"
+#endif
+
+#include "gl_state.h"
+#include "profiler.h" // mxProfileCount
+
+#include <stdbool.h> // bool
+#include <string.h> // memset
+
+// Capabilities that are cached. Others go straight to GL.
+static const GLenum _caps[] = {
+    GL_BLEND, GL_CULL_FACE, GL_DEPTH_TEST, GL_DITHER, GL_POLYGON_OFFSET_FILL,
+    GL_SAMPLE_ALPHA_TO_COVERAGE, GL_SAMPLE_COVERAGE, GL_SCISSOR_TEST, GL_STENCIL_TEST
+};
+
+#define CAP_COUNT ((int) (sizeof(_caps) / sizeof(_caps[0])))
+
+// Texture units and vertex attributes that are cached.
+#define MAX_TEXTURE_UNITS (8)
+#define MAX_ATTRIBS (16)
+
+// Cached values that aren't known yet.
+#define UNKNOWN_FLAG (-1)
+#define UNKNOWN_NAME (~0u)
+
+typedef struct
+{
+    signed char caps[CAP_COUNT];
+    signed char attribs[MAX_ATTRIBS];
+    GLuint program;
+    GLenum active_unit;
+    GLuint textures[MAX_TEXTURE_UNITS];
+    GLuint array_buffer;
+    GLuint element_buffer;
+} MX_GL_STATE_T;
+
+typedef struct
+{
+    uint32_t draws;
+    uint32_t vertices;
+    uint32_t triangles;
+    uint32_t binds;
+    uint32_t upload_bytes;
+    uint32_t changes;
+    uint32_t redundant;
+} MX_GL_COUNTS_T;
+
+static MX_GL_STATE_T _state;
+
+#ifndef MX_NO_GL_STATS
+static MX_GL_COUNTS_T _counts;
+#define COUNT(counter, n) (_counts.counter += (n))
+#else
+#define COUNT(counter, n) ((void) 0)
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Forgets all cached state, so that the next call for each piece of state
+// goes to GL. Used when a context is created, or when something outside these
+// functions may have changed the state.
+///////////////////////////////////////////////////////////////////////////////
+void mxGlReset()
+{
+    memset(_state.caps, UNKNOWN_FLAG, sizeof(_state.caps));
+    memset(_state.attribs, UNKNOWN_FLAG, sizeof(_state.attribs));
+    _state.program = UNKNOWN_NAME;
+    _state.active_unit = GL_TEXTURE0;
+    for (int i = 0; i < MAX_TEXTURE_UNITS; i++) _state.textures[i] = UNKNOWN_NAME;
+    _state.array_buffer = UNKNOWN_NAME;
+    _state.element_buffer = UNKNOWN_NAME;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns true if the cached flag already has the given value, and otherwise
+// sets it and returns false. A NULL flag is never cached.
+///////////////////////////////////////////////////////////////////////////////
+static bool same_flag(signed char* flag, bool value)
+{
+    if (flag != NULL && *flag == (signed char) value)
+    {
+        COUNT(redundant, 1);
+        return true;
+    }
+    if (flag != NULL) *flag = (signed char) value;
+    COUNT(changes, 1);
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// The same for cached names, such as bound textures and buffers. A NULL name
+// is never cached.
+///////////////////////////////////////////////////////////////////////////////
+static bool same_name(GLuint* name, GLuint value)
+{
+    if (name != NULL && *name == value)
+    {
+        COUNT(redundant, 1);
+        return true;
+    }
+    if (name != NULL) *name = value;
+    COUNT(changes, 1);
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static signed char* cap_flag(GLenum cap)
+{
+    for (int i = 0; i < CAP_COUNT; i++) if (_caps[i] == cap) return &_state.caps[i];
+    return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static GLuint* buffer_binding(GLenum target)
+{
+    if (target == GL_ARRAY_BUFFER) return &_state.array_buffer;
+    if (target == GL_ELEMENT_ARRAY_BUFFER) return &_state.element_buffer;
+    return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxGlEnable(GLenum cap)
+{
+    if (!same_flag(cap_flag(cap), true)) glEnable(cap);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxGlDisable(GLenum cap)
+{
+    if (!same_flag(cap_flag(cap), false)) glDisable(cap);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxGlUseProgram(GLuint program)
+{
+    if (!same_name(&_state.program, program)) glUseProgram(program);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxGlActiveTexture(GLenum unit)
+{
+    if (_state.active_unit == unit)
+    {
+        COUNT(redundant, 1);
+        return;
+    }
+    glActiveTexture(unit);
+    _state.active_unit = unit;
+    COUNT(changes, 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Binds the texture to the active unit. Only 2D textures are cached.
+///////////////////////////////////////////////////////////////////////////////
+void mxGlBindTexture(GLenum target, GLuint texture)
+{
+    unsigned int unit = _state.active_unit - GL_TEXTURE0;
+    GLuint* bound = target == GL_TEXTURE_2D && unit < MAX_TEXTURE_UNITS ? &_state.textures[unit] : NULL;
+    if (same_name(bound, texture)) return;
+    glBindTexture(target, texture);
+    COUNT(binds, 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Deleting a bound texture unbinds it, so the cache must follow.
+///////////////////////////////////////////////////////////////////////////////
+void mxGlDeleteTextures(GLsizei n, const GLuint* textures)
+{
+    for (GLsizei i = 0; i < n; i++)
+        for (int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+            if (textures[i] != 0 && _state.textures[unit] == textures[i]) _state.textures[unit] = 0;
+    glDeleteTextures(n, textures);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxGlBindBuffer(GLenum target, GLuint buffer)
+{
+    if (!same_name(buffer_binding(target), buffer)) glBindBuffer(target, buffer);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxGlBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+{
+    glBufferData(target, size, data, usage);
+    COUNT(upload_bytes, (uint32_t) size);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Deleting a bound buffer unbinds it, so the cache must follow.
+///////////////////////////////////////////////////////////////////////////////
+void mxGlDeleteBuffers(GLsizei n, const GLuint* buffers)
+{
+    for (GLsizei i = 0; i < n; i++)
+    {
+        if (buffers[i] == 0) continue;
+        if (_state.array_buffer == buffers[i]) _state.array_buffer = 0;
+        if (_state.element_buffer == buffers[i]) _state.element_buffer = 0;
+    }
+    glDeleteBuffers(n, buffers);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxGlEnableVertexAttribArray(GLuint index)
+{
+    if (!same_flag(index < MAX_ATTRIBS ? &_state.attribs[index] : NULL, true)) glEnableVertexAttribArray(index);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxGlDisableVertexAttribArray(GLuint index)
+{
+    if (!same_flag(index < MAX_ATTRIBS ? &_state.attribs[index] : NULL, false)) glDisableVertexAttribArray(index);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxGlDrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+{
+    glDrawElements(mode, count, type, indices);
+    COUNT(draws, 1);
+    COUNT(vertices, (uint32_t) count);
+    if (mode == GL_TRIANGLES) COUNT(triangles, (uint32_t) count / 3);
+    else if ((mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN) && count > 2) COUNT(triangles, (uint32_t) count - 2);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Adds the counts since the last frame to the profile, and starts counting
+// the next frame.
+///////////////////////////////////////////////////////////////////////////////
+void mxGlStatsFrame()
+{
+#ifndef MX_NO_GL_STATS
+    mxProfileCount(MX_PROFILE_DRAW_CALLS, _counts.draws);
+    mxProfileCount(MX_PROFILE_VERTICES, _counts.vertices);
+    mxProfileCount(MX_PROFILE_TRIANGLES, _counts.triangles);
+    mxProfileCount(MX_PROFILE_TEXTURE_BINDS, _counts.binds);
+    mxProfileCount(MX_PROFILE_UPLOAD_BYTES, _counts.upload_bytes);
+    mxProfileCount(MX_PROFILE_STATE_CHANGES, _counts.changes);
+    mxProfileCount(MX_PROFILE_REDUNDANT_STATE, _counts.redundant);
+#endif
+    mxGlStatsClear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Throws away the counts since the last frame, for work that isn't part of a
+// frame, such as loading.
+///////////////////////////////////////////////////////////////////////////////
+void mxGlStatsClear()
+{
+#ifndef MX_NO_GL_STATS
+    memset(&_counts, 0, sizeof(_counts));
+#endif
+}
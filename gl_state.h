@@ -0,0 +1,22 @@
+#ifndef MX_GL_STATE_H
+#define MX_GL_STATE_H
+
+#include <GLES2/gl2.h>
+
+void mxGlReset();
+void mxGlEnable(GLenum cap);
+void mxGlDisable(GLenum cap);
+void mxGlUseProgram(GLuint program);
+void mxGlActiveTexture(GLenum unit);
+void mxGlBindTexture(GLenum target, GLuint texture);
+void mxGlDeleteTextures(GLsizei n, const GLuint* textures);
+void mxGlBindBuffer(GLenum target, GLuint buffer);
+void mxGlBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage);
+void mxGlDeleteBuffers(GLsizei n, const GLuint* buffers);
+void mxGlEnableVertexAttribArray(GLuint index);
+void mxGlDisableVertexAttribArray(GLuint index);
+void mxGlDrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices);
+void mxGlStatsFrame();
+void mxGlStatsClear();
+
+#endif /* MX_GL_STATE_H */
@@ -0,0 +1,351 @@
+///////////////////////////////////////////////////////////////////////////////
+// This file reads the keyboard and mouse through the kernel's evdev devices,
+// /dev/input/event*, on a thread of its own. The thread sleeps in epoll_wait
+// until any device has events, so each event is handled as soon as it
+// arrives rather than at the start of the next frame, and the main thread
+// makes no system calls for input at all.
+//
+// The thread publishes the input state with a sequence lock: it makes the
+// sequence number odd while it changes the state and even again afterwards,
+// and a reader copies the state and tries again if the number was odd or
+// changed meanwhile. Neither side ever waits for the other. Mouse movement,
+// key presses and button presses are kept as running totals rather than
+// being cleared when read, so a copy is the same whenever it's taken and the
+// main thread finds what happened since its last copy by subtracting.
+//
+// Events are timestamped by the kernel from the monotonic clock, the same
+// clock as mxProfileNow, so the time from an event to the frame that shows it
+// can be measured.
+//
+// The devices are grabbed so that key presses don't also reach the console.
+// Opening them usually needs root or membership of the input group. The
+// console keyboard or GPM mouse is used instead of whichever of the two
+// can't be opened here.
+///////////////////////////////////////////////////////////////////////////////
+
+#define _POSIX_C_SOURCE 200809L
+
+// Enable or disable debugging in this file.
+#define DEBUG_THIS
+
+#ifdef DEBUG_THIS
+#include "debug.h"
+#endif
+
+#include "input.h"
+#include "keyboard.h" // mxKeyboardApplyKey
+#include "mouse.h" // MOUSE_LEFT, MOUSE_RIGHT, MOUSE_MIDDLE
+
+#include <stdio.h> // snprintf
+#include <string.h> // memcpy, memset
+#include <errno.h> // EINTR, EAGAIN
+#include <fcntl.h> // open, O_RDONLY, O_NONBLOCK, O_CLOEXEC
+#include <unistd.h> // read, write, close
+#include <time.h> // CLOCK_MONOTONIC
+#include <pthread.h> // pthread_create, pthread_join
+#include <sys/ioctl.h> // ioctl
+#include <sys/epoll.h> // epoll_create1, epoll_ctl, epoll_wait
+#include <sys/eventfd.h> // eventfd
+#include <linux/input.h> // struct input_event, EVIOCGBIT, EVIOCGRAB, etc.
+
+// linux/input.h redefines KEY_EXIT from keyboard.h as a key code, but only key
+// codes are used in this file.
+
+// Older headers only have the timeval in input_event, which newer ones replace
+// on 32 bit systems with 64 bit time.
+#ifndef input_event_sec
+#define input_event_sec time.tv_sec
+#define input_event_usec time.tv_usec
+#endif
+
+// Devices looked for are /dev/input/event0 to event<MAX_DEVICES - 1>.
+#define MAX_DEVICES 32
+
+// Events read from a device at a time.
+#define READ_EVENTS 64
+
+// Bits of specialKeys and buttons, which are counted separately.
+#define KEY_BITS 8
+
+typedef struct
+{
+    // Keys held now.
+    unsigned char moveKeys;
+
+    // Running totals.
+    int32_t mouseX;
+    int32_t mouseY;
+    uint32_t keyPresses[KEY_BITS];
+    uint32_t buttonPresses[KEY_BITS];
+
+    // Time of the latest event, from the monotonic clock in nanoseconds.
+    uint64_t time;
+} MX_INPUT_STATE_T;
+
+static int _devices[MAX_DEVICES];
+static int _devices_count;
+
+// Set if any of the devices is a keyboard.
+static bool _keyboard;
+static int _epoll = -1;
+static int _wake = -1;
+static pthread_t _thread;
+static bool _running;
+
+// Published by the input thread under _sequence.
+static unsigned int _sequence;
+static MX_INPUT_STATE_T _shared;
+
+// The input thread's working copy, and the main thread's last copy.
+static MX_INPUT_STATE_T _state;
+static MX_INPUT_STATE_T _seen;
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns true if the bit is set in an evdev capability bitmap.
+///////////////////////////////////////////////////////////////////////////////
+static bool test_bit(const unsigned long* bits, int bit)
+{
+    const int per_long = 8 * sizeof(unsigned long);
+    return (bits[bit / per_long] >> (bit % per_long)) & 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Opens the device if it's a keyboard or mouse, setting keyboard or mouse to
+// say which. Returns its descriptor, or -1.
+///////////////////////////////////////////////////////////////////////////////
+static int open_device(const char* path, bool* keyboard, bool* mouse)
+{
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    unsigned long types[(EV_MAX + 8 * sizeof(unsigned long)) / (8 * sizeof(unsigned long))];
+    unsigned long keys[(KEY_MAX + 8 * sizeof(unsigned long)) / (8 * sizeof(unsigned long))];
+    memset(types, 0, sizeof(types));
+    memset(keys, 0, sizeof(keys));
+    *keyboard = false;
+    *mouse = false;
+    if (ioctl(fd, EVIOCGBIT(0, sizeof(types)), types) >= 0 && test_bit(types, EV_KEY) &&
+        ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys) >= 0)
+    {
+        *keyboard = test_bit(keys, KEY_ESC) && test_bit(keys, KEY_W);
+        *mouse = test_bit(types, EV_REL) && test_bit(keys, BTN_LEFT);
+    }
+    int clock = CLOCK_MONOTONIC;
+    if ((!*keyboard && !*mouse) || ioctl(fd, EVIOCSCLOCKID, &clock) < 0 || ioctl(fd, EVIOCGRAB, 1) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+#ifdef DEBUG_THIS
+    char name[64] = "";
+    ioctl(fd, EVIOCGNAME(sizeof(name)), name);
+    mxDebug("Using %s: %s (%s%s)", path, name, *keyboard ? "keyboard" : "", *mouse ? " mouse" : "");
+#endif
+    return fd;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Adds a count to each counter whose bit is set.
+///////////////////////////////////////////////////////////////////////////////
+static void count_bits(unsigned char bits, uint32_t* counters)
+{
+    for (int i = 0; i < KEY_BITS; i++)
+        if (bits & (1 << i)) counters[i]++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Applies an event to the input thread's working copy of the state.
+///////////////////////////////////////////////////////////////////////////////
+static void handle_event(const struct input_event* event)
+{
+    if (event->type == EV_REL)
+    {
+        if (event->code == REL_X) _state.mouseX += event->value;
+        else if (event->code == REL_Y) _state.mouseY += event->value;
+    }
+    else if (event->type == EV_KEY && event->value != 2) // Ignore key repeats.
+    {
+        bool press = event->value == 1;
+        if (event->code == BTN_LEFT || event->code == BTN_RIGHT || event->code == BTN_MIDDLE)
+        {
+            if (!press) return;
+            count_bits(event->code == BTN_LEFT ? MOUSE_LEFT :
+                       event->code == BTN_RIGHT ? MOUSE_RIGHT : MOUSE_MIDDLE,
+                       _state.buttonPresses);
+        }
+        else
+        {
+            unsigned char specialKeys = 0;
+            mxKeyboardApplyKey(event->code, press, &_state.moveKeys, &specialKeys);
+            count_bits(specialKeys, _state.keyPresses);
+        }
+    }
+    else return;
+
+    _state.time = (uint64_t) event->input_event_sec * 1000000000u + (uint64_t) event->input_event_usec * 1000u;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Makes the working copy of the state visible to the main thread.
+///////////////////////////////////////////////////////////////////////////////
+static void publish()
+{
+    unsigned int sequence = _sequence;
+    __atomic_store_n(&_sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&_shared, &_state, sizeof(_state));
+    __atomic_store_n(&_sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Waits for events from any device and publishes the state after each batch.
+///////////////////////////////////////////////////////////////////////////////
+static void* input_main(void* arg)
+{
+    struct epoll_event ready[MAX_DEVICES + 1];
+    struct input_event events[READ_EVENTS];
+    while (__atomic_load_n(&_running, __ATOMIC_ACQUIRE))
+    {
+        int count = epoll_wait(_epoll, ready, MAX_DEVICES + 1, -1);
+        if (count < 0 && errno != EINTR) break;
+
+        bool changed = false;
+        for (int i = 0; i < count; i++)
+        {
+            int fd = ready[i].data.fd;
+            if (fd == _wake) continue;
+
+            ssize_t bytes;
+            while ((bytes = read(fd, events, sizeof(events))) > 0)
+            {
+                for (size_t j = 0; j < (size_t) bytes / sizeof(struct input_event); j++)
+                    handle_event(&events[j]);
+                changed = true;
+            }
+
+            // A device that has gone, such as an unplugged mouse, is dropped.
+            if (bytes == 0 || (bytes < 0 && errno != EAGAIN && errno != EINTR))
+                epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, NULL);
+        }
+        if (changed) publish();
+    }
+    return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Opens all the keyboards and mice that can be opened and starts the input
+// thread. keyboard and mouse are set if at least one of each was opened, and
+// the other should be read from the console. Returns false if there are none,
+// or the thread can't be started, in which case neither is set.
+///////////////////////////////////////////////////////////////////////////////
+bool mxInputSetup(bool* keyboard, bool* mouse)
+{
+    memset(&_state, 0, sizeof(_state));
+    memset(&_seen, 0, sizeof(_seen));
+    memset(&_shared, 0, sizeof(_shared));
+    _sequence = 0;
+
+    *keyboard = false;
+    *mouse = false;
+    _devices_count = 0;
+    for (int i = 0; i < MAX_DEVICES; i++)
+    {
+        char path[32];
+        bool is_keyboard, is_mouse;
+        snprintf(path, sizeof(path), "/dev/input/event%d", i);
+        int fd = open_device(path, &is_keyboard, &is_mouse);
+        if (fd < 0) continue;
+        _devices[_devices_count++] = fd;
+        *keyboard = *keyboard || is_keyboard;
+        *mouse = *mouse || is_mouse;
+    }
+    if (_devices_count == 0) return false;
+
+    _epoll = epoll_create1(EPOLL_CLOEXEC);
+    _wake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (_epoll < 0 || _wake < 0)
+    {
+        mxInputCleanup();
+        *keyboard = *mouse = false;
+        return false;
+    }
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = _wake;
+    epoll_ctl(_epoll, EPOLL_CTL_ADD, _wake, &event);
+    for (int i = 0; i < _devices_count; i++)
+    {
+        event.data.fd = _devices[i];
+        epoll_ctl(_epoll, EPOLL_CTL_ADD, _devices[i], &event);
+    }
+
+    _running = true;
+    if (pthread_create(&_thread, NULL, input_main, NULL) != 0)
+    {
+        _running = false;
+        mxInputCleanup();
+        *keyboard = *mouse = false;
+        return false;
+    }
+    _keyboard = *keyboard;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Takes the latest input state. The movement keys are those held now, if a
+// keyboard was opened, and the special keys, mouse movement and buttons are
+// those pressed or moved since the last call, which are added to the given
+// values. eventTime is set to the time of the latest event, or left alone if
+// there have been none since the last call. Returns true if there have been.
+///////////////////////////////////////////////////////////////////////////////
+bool mxInputUpdate(unsigned char* moveKeys, unsigned char* specialKeys,
+                   float* mouseDeltaX, float* mouseDeltaY, unsigned char* buttons,
+                   uint64_t* eventTime)
+{
+    MX_INPUT_STATE_T state;
+    unsigned int before, after;
+    do
+    {
+        before = __atomic_load_n(&_sequence, __ATOMIC_ACQUIRE);
+        memcpy(&state, &_shared, sizeof(state));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&_sequence, __ATOMIC_RELAXED);
+    } while ((before & 1) != 0 || before != after);
+
+    if (state.time == _seen.time) return false;
+
+    if (_keyboard) *moveKeys = state.moveKeys;
+    *mouseDeltaX += (float) (state.mouseX - _seen.mouseX);
+    *mouseDeltaY += (float) (state.mouseY - _seen.mouseY);
+    for (int i = 0; i < KEY_BITS; i++)
+    {
+        if (state.keyPresses[i] != _seen.keyPresses[i]) *specialKeys |= 1 << i;
+        if (state.buttonPresses[i] != _seen.buttonPresses[i]) *buttons |= 1 << i;
+    }
+    *eventTime = state.time;
+    _seen = state;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxInputCleanup()
+{
+    if (_running)
+    {
+        __atomic_store_n(&_running, false, __ATOMIC_RELEASE);
+        uint64_t one = 1;
+        if (write(_wake, &one, sizeof(one)) == sizeof(one)) pthread_join(_thread, NULL);
+    }
+    for (int i = 0; i < _devices_count; i++)
+    {
+        ioctl(_devices[i], EVIOCGRAB, 0);
+        close(_devices[i]);
+    }
+    _devices_count = 0;
+    _keyboard = false;
+    if (_epoll >= 0) close(_epoll);
+    if (_wake >= 0) close(_wake);
+    _epoll = _wake = -1;
+}
@@ -0,0 +1,13 @@
+#ifndef MX_INPUT_H
+#define MX_INPUT_H
+
+#include <stdbool.h> // bool
+#include <stdint.h> // uint64_t
+
+bool mxInputSetup(bool* keyboard, bool* mouse);
+bool mxInputUpdate(unsigned char* moveKeys, unsigned char* specialKeys,
+                   float* mouseDeltaX, float* mouseDeltaY, unsigned char* buttons,
+                   uint64_t* eventTime);
+void mxInputCleanup();
+
+#endif /* MX_INPUT_H */
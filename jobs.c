@@ -0,0 +1,288 @@
+///////////////////////////////////////////////////////////////////////////////
+// This file runs jobs on a pool of worker threads, so that slow work such as
+// generating and meshing chunks doesn't hold up the frame.
+//
+// Only the main thread submits jobs, as no job starts another, so the pool is
+// fed from two shared deques that the main thread owns: one for urgent jobs,
+// which workers look in first, and one for the rest. The main thread pushes
+// jobs at the bottom, and idle workers steal them from the top, so each deque
+// is run oldest first. The deques are the lock free design of Chase and Lev,
+// with the memory ordering given in "Correct and Efficient Work-Stealing for
+// Weak Memory Models" by Le, Pop, Cohen and Zappa Nardelli (PPoPP 2013).
+//
+// Finished jobs go back to the main thread through a single producer, single
+// consumer queue per worker. The main thread never waits for a worker: a job
+// that can't be queued is refused, and finished jobs are collected by polling.
+// Workers sleep on a semaphore that is posted once for each job submitted.
+///////////////////////////////////////////////////////////////////////////////
+
+#define _POSIX_C_SOURCE 200112L
+
+// Enable or disable debugging in this file.
+#define DEBUG_THIS
+
+#ifdef DEBUG_THIS
+#include "debug.h"
+#endif
+
+#include "jobs.h"
+
+#include <stdlib.h> // NULL
+#include <errno.h> // EINTR
+#include <pthread.h> // pthread_create, pthread_join
+#include <semaphore.h> // sem_init, sem_post, sem_wait
+#include <sched.h> // sched_yield
+#include <unistd.h> // sysconf
+
+// Sizes of the queues. Must be powers of two.
+#define DEQUE_CAPACITY      (1024)
+#define FINISHED_CAPACITY   (256)
+
+typedef struct
+{
+    long top;
+    long bottom;
+    MX_JOB_T* jobs[DEQUE_CAPACITY];
+} MX_DEQUE_T;
+
+typedef struct
+{
+    // Written by the consumer and the producer respectively.
+    unsigned int head;
+    unsigned int tail;
+    MX_JOB_T* jobs[FINISHED_CAPACITY];
+} MX_FINISHED_T;
+
+typedef struct
+{
+    pthread_t thread;
+    MX_FINISHED_T finished;
+} MX_WORKER_T;
+
+static MX_WORKER_T _workers[MX_JOBS_MAX_WORKERS];
+static int _workers_count;
+
+// Jobs waiting to be run, and jobs run on the main thread when there are no
+// workers.
+static MX_DEQUE_T _main_deque;
+static MX_DEQUE_T _urgent_deque;
+static MX_FINISHED_T _main_finished;
+
+static sem_t _available;
+static bool _stopping;
+
+// Jobs submitted but not yet finished.
+static int _pending;
+
+///////////////////////////////////////////////////////////////////////////////
+// Adds a job at the bottom of the deque. Only the owner may push. Returns
+// false if the deque is full.
+///////////////////////////////////////////////////////////////////////////////
+static bool deque_push(MX_DEQUE_T* d, MX_JOB_T* job)
+{
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    if (b - t >= DEQUE_CAPACITY) return false;
+    __atomic_store_n(&d->jobs[b & (DEQUE_CAPACITY - 1)], job, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Removes the job at the top of the deque. Any thread may steal. Returns NULL
+// if the deque is empty or another thread got there first.
+///////////////////////////////////////////////////////////////////////////////
+static MX_JOB_T* deque_steal(MX_DEQUE_T* d)
+{
+    long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) return NULL;
+
+    MX_JOB_T* job = __atomic_load_n(&d->jobs[t & (DEQUE_CAPACITY - 1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return NULL;
+    return job;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns false if the queue is full.
+///////////////////////////////////////////////////////////////////////////////
+static bool finished_push(MX_FINISHED_T* q, MX_JOB_T* job)
+{
+    unsigned int tail = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    unsigned int head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    if (tail - head == FINISHED_CAPACITY) return false;
+    q->jobs[tail & (FINISHED_CAPACITY - 1)] = job;
+    __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static MX_JOB_T* finished_pop(MX_FINISHED_T* q)
+{
+    unsigned int head = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    unsigned int tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+    if (head == tail) return NULL;
+    MX_JOB_T* job = q->jobs[head & (FINISHED_CAPACITY - 1)];
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+    return job;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Looks for an urgent job, then any other.
+///////////////////////////////////////////////////////////////////////////////
+static MX_JOB_T* find_job()
+{
+    MX_JOB_T* job = deque_steal(&_urgent_deque);
+    if (job != NULL) return job;
+    return deque_steal(&_main_deque);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static void* worker_main(void* arg)
+{
+    MX_WORKER_T* self = (MX_WORKER_T*) arg;
+
+    for (;;)
+    {
+        // Each post is for one job, so having been woken, a job will turn
+        // up even if another worker steals the first one looked at.
+        while (sem_wait(&_available) != 0 && errno == EINTR) {}
+        if (__atomic_load_n(&_stopping, __ATOMIC_ACQUIRE)) break;
+
+        MX_JOB_T* job;
+        while ((job = find_job()) == NULL) sched_yield();
+
+        job->run(job);
+        while (!finished_push(&self->finished, job)) sched_yield();
+    }
+    return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Starts the given number of workers. A negative number starts one for each
+// processor but the first, which is left for the main thread. With no
+// workers, jobs are run as soon as they are submitted.
+///////////////////////////////////////////////////////////////////////////////
+bool mxJobsSetup(int workers)
+{
+    if (workers < 0) workers = (int) sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    if (workers < 0) workers = 0;
+    if (workers > MX_JOBS_MAX_WORKERS) workers = MX_JOBS_MAX_WORKERS;
+
+    if (sem_init(&_available, 0, 0) != 0) return false;
+    _stopping = false;
+    _pending = 0;
+
+    for (_workers_count = 0; _workers_count < workers; _workers_count++)
+    {
+        MX_WORKER_T* worker = &_workers[_workers_count];
+        if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) return false;
+    }
+
+#ifdef DEBUG_THIS
+    mxDebug("%d workers", _workers_count);
+#endif
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int mxJobsWorkerCount()
+{
+    return _workers_count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static bool submit(MX_JOB_T* job, MX_DEQUE_T* deque)
+{
+    if (_workers_count == 0)
+    {
+        if (!finished_push(&_main_finished, job)) return false;
+        job->run(job);
+    }
+    else
+    {
+        if (!deque_push(deque, job)) return false;
+        sem_post(&_available);
+    }
+    __atomic_add_fetch(&_pending, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Queues the job to be run. Only the main thread may submit jobs. Returns
+// false if the queue is full, in which case the job should be submitted again
+// later.
+///////////////////////////////////////////////////////////////////////////////
+bool mxJobsSubmit(MX_JOB_T* job)
+{
+    return submit(job, &_main_deque);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Queues the job to be run ahead of any submitted with mxJobsSubmit, such as
+// remeshing a chunk the player has just changed. Only the main thread may
+// submit urgent jobs. Returns false if the queue is full.
+///////////////////////////////////////////////////////////////////////////////
+bool mxJobsSubmitUrgent(MX_JOB_T* job)
+{
+    return submit(job, &_urgent_deque);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Calls finish for every job that has been run since the last call, on the
+// calling thread, which must be the main thread. Returns how many there were.
+///////////////////////////////////////////////////////////////////////////////
+int mxJobsFinish()
+{
+    int count = 0;
+    MX_JOB_T* job;
+    while ((job = finished_pop(&_main_finished)) != NULL)
+    {
+        job->finish(job);
+        count++;
+    }
+    for (int i = 0; i < _workers_count; i++)
+    {
+        while ((job = finished_pop(&_workers[i].finished)) != NULL)
+        {
+            job->finish(job);
+            count++;
+        }
+    }
+    __atomic_sub_fetch(&_pending, count, __ATOMIC_RELAXED);
+    return count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the number of jobs submitted and not yet finished.
+///////////////////////////////////////////////////////////////////////////////
+int mxJobsPending()
+{
+    return __atomic_load_n(&_pending, __ATOMIC_RELAXED);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Stops the workers once they have finished the jobs they are running. Jobs
+// still queued are dropped without being run or finished, so the modules that
+// own them must free them.
+///////////////////////////////////////////////////////////////////////////////
+void mxJobsCleanup()
+{
+    __atomic_store_n(&_stopping, true, __ATOMIC_RELEASE);
+    for (int i = 0; i < _workers_count; i++) sem_post(&_available);
+    for (int i = 0; i < _workers_count; i++) pthread_join(_workers[i].thread, NULL);
+    sem_destroy(&_available);
+
+    for (int i = 0; i < _workers_count; i++)
+    {
+        _workers[i].finished.head = _workers[i].finished.tail = 0;
+    }
+    _main_deque.top = _main_deque.bottom = 0;
+    _urgent_deque.top = _urgent_deque.bottom = 0;
+    _main_finished.head = _main_finished.tail = 0;
+    _workers_count = 0;
+    _pending = 0;
+}
@@ -0,0 +1,28 @@
+#ifndef MX_JOBS_H
+#define MX_JOBS_H
+
+#include <stdbool.h> // bool
+
+// Most workers that can be started.
+#define MX_JOBS_MAX_WORKERS (16)
+
+// A job is embedded as the first member of a larger struct holding its data.
+// run is called on a worker thread, then finish is called on the main thread
+// by mxJobsFinish, so that only the main thread touches shared state such as
+// the world and OpenGL.
+typedef struct MX_JOB_T MX_JOB_T;
+struct MX_JOB_T
+{
+    void (*run)(MX_JOB_T* job);
+    void (*finish)(MX_JOB_T* job);
+};
+
+bool mxJobsSetup(int workers);
+int mxJobsWorkerCount();
+bool mxJobsSubmit(MX_JOB_T* job);
+bool mxJobsSubmitUrgent(MX_JOB_T* job);
+int mxJobsFinish();
+int mxJobsPending();
+void mxJobsCleanup();
+
+#endif /* MX_JOBS_H */
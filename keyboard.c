@@ -70,6 +70,99 @@ bool mxKeyboardSetup()
     return true;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Updates the key bits for a key being pressed or released, given its Linux
+// keycode. This is shared with the evdev input in input.c, which gets the
+// same keycodes.
+///////////////////////////////////////////////////////////////////////////////
+void mxKeyboardApplyKey(int keycode, bool press, unsigned char *moveKeys, unsigned char *specialKeys)
+{
+    switch (keycode)
+    {
+        case 1:
+            *specialKeys |= KEY_EXIT;
+            break;
+        case 88:
+            *specialKeys |= KEY_RESET_POS;
+            break;
+        case 87:
+            if (press) *specialKeys |= KEY_PROFILE_REPORT;
+            break;
+        case 33:
+            if (press) *specialKeys |= KEY_TOGGLE_FLYING;
+            break;
+        case 17:
+        case 103:
+            if (press) 
+            {
+                *moveKeys |= MOVE_FORWARD;
+                *moveKeys |= MOVE_FORWARD_OVER_BACK;
+            }
+            else 
+            {
+                *moveKeys &= (0xFF & ~MOVE_FORWARD);
+            }
+            break;
+        case 31:
+        case 108:
+            if (press) 
+            {
+                *moveKeys |= MOVE_BACK;
+                *moveKeys &= (0xFF & ~MOVE_FORWARD_OVER_BACK);
+            }
+            else 
+            {
+                *moveKeys &= (0xFF & ~MOVE_BACK);
+            }
+            break;
+        case 30:
+        case 105:
+            if (press) 
+            {
+                *moveKeys |= MOVE_LEFT;
+                *moveKeys |= MOVE_LEFT_OVER_RIGHT;
+            }
+            else 
+            {
+                *moveKeys &= (0xFF & ~MOVE_LEFT);
+            }
+            break;
+        case 32:
+        case 106:
+            if (press) 
+            {
+                *moveKeys |= MOVE_RIGHT;
+                *moveKeys &= (0xFF & ~MOVE_LEFT_OVER_RIGHT);
+            }
+            else 
+            {
+                *moveKeys &= (0xFF & ~MOVE_RIGHT);
+            }
+            break;
+        case 13:
+        case 57:
+            if (press)
+            {
+                *moveKeys |= MOVE_UP;
+            }
+            else
+            {
+                *moveKeys &= (0xFF & ~MOVE_UP);
+            }
+            break;
+        case 12:
+            if (press)
+            {
+                *moveKeys |= MOVE_DOWN;
+            }
+            else
+            {
+                *moveKeys &= (0xFF & ~MOVE_DOWN);
+            }
+            break;
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 void mxKeyboardUpdate(unsigned char *moveKeys, unsigned char *specialKeys)
 {
@@ -100,83 +193,7 @@ void mxKeyboardUpdate(unsigned char *moveKeys, unsigned char *specialKeys)
 		mxDebug("Keycode: %3d %s", keycode, press ? "press" : "release");
 #endif
 
-        switch (keycode)
-        {
-            case 1:
-                *specialKeys |= KEY_EXIT;
-                break;
-            case 88:
-                *specialKeys |= KEY_RESET_POS;
-                break;
-            case 17:
-            case 103:
-                if (press) 
-                {
-                    *moveKeys |= MOVE_FORWARD;
-                    *moveKeys |= MOVE_FORWARD_OVER_BACK;
-                }
-                else 
-                {
-                    *moveKeys &= (0xFF & ~MOVE_FORWARD);
-                }
-                break;
-            case 31:
-            case 108:
-                if (press) 
-                {
-                    *moveKeys |= MOVE_BACK;
-                    *moveKeys &= (0xFF & ~MOVE_FORWARD_OVER_BACK);
-                }
-                else 
-                {
-                    *moveKeys &= (0xFF & ~MOVE_BACK);
-                }
-                break;
-            case 30:
-            case 105:
-                if (press) 
-                {
-                    *moveKeys |= MOVE_LEFT;
-                    *moveKeys |= MOVE_LEFT_OVER_RIGHT;
-                }
-                else 
-                {
-                    *moveKeys &= (0xFF & ~MOVE_LEFT);
-                }
-                break;
-            case 32:
-            case 106:
-                if (press) 
-                {
-                    *moveKeys |= MOVE_RIGHT;
-                    *moveKeys &= (0xFF & ~MOVE_LEFT_OVER_RIGHT);
-                }
-                else 
-                {
-                    *moveKeys &= (0xFF & ~MOVE_RIGHT);
-                }
-                break;
-            case 13:
-                if (press)
-                {
-                    *moveKeys |= MOVE_UP;
-                }
-                else
-                {
-                    *moveKeys &= (0xFF & ~MOVE_UP);
-                }
-                break;
-            case 12:
-                if (press)
-                {
-                    *moveKeys |= MOVE_DOWN;
-                }
-                else
-                {
-                    *moveKeys &= (0xFF & ~MOVE_DOWN);
-                }
-                break;
-        }
+        mxKeyboardApplyKey(keycode, press, moveKeys, specialKeys);
 	}
 }
 
@@ -16,9 +16,12 @@
 // specialKeys bits.
 #define KEY_EXIT				0x01
 #define KEY_RESET_POS			0x02
+#define KEY_PROFILE_REPORT		0x04
+#define KEY_TOGGLE_FLYING		0x08
 
 bool mxKeyboardSetup();
 void mxKeyboardUpdate(unsigned char *moveKeys, unsigned char *specialKeys);
+void mxKeyboardApplyKey(int keycode, bool press, unsigned char *moveKeys, unsigned char *specialKeys);
 void mxKeyboardCleanup();
 
 #endif /* MX_KEYBOARD_H */
\ No newline at end of file
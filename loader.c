@@ -0,0 +1,542 @@
+///////////////////////////////////////////////////////////////////////////////
+// This file brings chunks into the world. Chunks are generated by jobs on the
+// worker threads, each into a chunk of its own, and are only added to the
+// world when the job is finished on the main thread. Neighbouring chunks are
+// then marked dirty, as the faces and shading along their borders may have
+// changed.
+//
+// Requests wait in a queue until there is a free job to generate them, so any
+// number of chunks can be asked for at once.
+//
+// Chunks that have been saved to a region file are loaded from it instead of
+// being generated. Chunks that have been changed are saved every few seconds
+// by jobs, so the main thread never waits for the disk, and any that are
+// still unsaved at cleanup are saved there.
+//
+// Chunks unloaded from the world are kept in a cache of the most recently
+// used, so that turning back brings them straight back without a job. When
+// the cache is full the least recently used chunk is freed, once it has been
+// saved if it was changed. A chunk that fails to save stays in the cache to
+// try again later, and its changes are only lost if there's no room left to
+// keep it. Without a world directory changes to it are lost.
+///////////////////////////////////////////////////////////////////////////////
+
+// Enable or disable debugging in this file.
+//#define DEBUG_THIS
+
+#ifdef DEBUG_THIS
+#include "debug.h"
+#endif
+
+#include "loader.h"
+#include "generator.h" // mxGeneratorFill
+#include "jobs.h" // mxJobsSubmit, MX_JOB_T
+#include "profiler.h" // mxProfileNow, mxProfileAdd
+#include "region.h" // mxRegionOpen, mxRegionClose, mxRegionLoad, mxRegionSave
+#include "world.h" // mxWorldAllocChunk, mxWorldAddChunk, mxWorldGetChunk
+
+#include <stdlib.h> // NULL, free
+#include <string.h> // memcpy, memmove
+#include <stdint.h> // uint64_t
+
+// Most chunks that can be being generated at once.
+#define MAX_GENERATE_JOBS 64
+
+// Most requests that can be waiting for a job. Must be a power of two.
+#define MAX_REQUESTS 4096
+
+// Most chunks that can be being saved at once.
+#define MAX_SAVE_JOBS 16
+
+// Changed chunks are saved once every this many updates.
+#define SAVE_INTERVAL 600
+
+// Most unloaded chunks kept in memory, about 2 MB of blocks.
+#define CACHE_SIZE 512
+
+typedef struct
+{
+    int cx;
+    int cy;
+    int cz;
+
+    // When the request was made, for measuring load latency.
+    uint64_t time;
+} MX_REQUEST_T;
+
+typedef struct
+{
+    MX_JOB_T job;
+
+    // The chunk being generated, or NULL when the job is free.
+    MX_CHUNK_T* chunk;
+
+    // Region the chunk may have been saved in, or NULL if there's none.
+    MX_REGION_T* region;
+    uint64_t requested;
+} MX_GENERATE_JOB_T;
+
+typedef struct
+{
+    MX_JOB_T job;
+
+    // The chunk being saved, or NULL when the job is free, and the number of
+    // edits it had when its blocks were copied.
+    MX_CHUNK_T* chunk;
+    unsigned int edits;
+
+    // Set if the chunk has been dropped from the cache, and is to be freed
+    // once saved.
+    bool release;
+
+    MX_REGION_T* region;
+    bool saved;
+    MX_BLOCK_T blocks[MX_CHUNK_VOLUME];
+} MX_SAVE_JOB_T;
+
+static MX_GENERATE_JOB_T _jobs[MAX_GENERATE_JOBS];
+static int _jobs_busy;
+
+static MX_SAVE_JOB_T _saves[MAX_SAVE_JOBS];
+static int _updates;
+
+// Requests waiting for a job, oldest first.
+static MX_REQUEST_T _requests[MAX_REQUESTS];
+static unsigned int _requests_head;
+static unsigned int _requests_count;
+
+// Unloaded chunks, least recently used first.
+static MX_CHUNK_T* _cache[CACHE_SIZE];
+static int _cache_count;
+
+static void cache_add(MX_CHUNK_T* chunk);
+static bool save_and_free(MX_CHUNK_T* chunk);
+
+///////////////////////////////////////////////////////////////////////////////
+// Adds a chunk to the world and marks its neighbours dirty. Returns false if
+// there's already a chunk there, or out of memory, in which case the caller
+// still owns the chunk.
+///////////////////////////////////////////////////////////////////////////////
+static bool add_to_world(MX_CHUNK_T* chunk, uint64_t requested)
+{
+    if (mxWorldGetChunk(chunk->cx, chunk->cy, chunk->cz) != NULL || !mxWorldAddChunk(chunk)) return false;
+    chunk->dirty = true;
+    mxProfileAdd(MX_PROFILE_CHUNK_LOAD, mxProfileNow() - requested);
+
+    // Ambient occlusion on the faces of a chunk depends on the blocks in all
+    // the chunks around it, not just those sharing a face.
+    for (int dy = -1; dy <= 1; dy++)
+    {
+        for (int dz = -1; dz <= 1; dz++)
+        {
+            for (int dx = -1; dx <= 1; dx++)
+            {
+                MX_CHUNK_T* neighbour = mxWorldGetChunk(chunk->cx + dx, chunk->cy + dy, chunk->cz + dz);
+                if (neighbour != NULL && neighbour != chunk) neighbour->dirty = true;
+            }
+        }
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Frees a chunk that couldn't be added to the world, without losing changes
+// that haven't been saved. If the chunk in the world has none of its own,
+// the changed blocks are copied into it, as it may be in use and can't be
+// replaced; if it has, its blocks are newer and are kept. Without a chunk in
+// the world, as when out of memory, the changed chunk is saved first, or kept
+// in the cache if that fails.
+///////////////////////////////////////////////////////////////////////////////
+static void drop_chunk(MX_CHUNK_T* chunk)
+{
+    MX_CHUNK_T* existing = mxWorldGetChunk(chunk->cx, chunk->cy, chunk->cz);
+    if (chunk->edits == chunk->saved_edits || (existing != NULL && existing->edits != existing->saved_edits))
+    {
+        free(chunk);
+        return;
+    }
+    if (existing == NULL)
+    {
+        if (!save_and_free(chunk)) cache_add(chunk);
+        return;
+    }
+
+#ifdef DEBUG_THIS
+    mxDebug("Merged unsaved chunk %d, %d, %d into the world", chunk->cx, chunk->cy, chunk->cz);
+#endif
+
+    memcpy(existing->blocks, chunk->blocks, sizeof(existing->blocks));
+    existing->solid_count = chunk->solid_count;
+    existing->edits++;
+    existing->dirty = true;
+    free(chunk);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static void generate_run(MX_JOB_T* job)
+{
+    MX_GENERATE_JOB_T* generate = (MX_GENERATE_JOB_T*) job;
+    if (!mxRegionLoad(generate->region, generate->chunk)) mxGeneratorFill(generate->chunk);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static void generate_finish(MX_JOB_T* job)
+{
+    MX_GENERATE_JOB_T* generate = (MX_GENERATE_JOB_T*) job;
+    MX_CHUNK_T* chunk = generate->chunk;
+    generate->chunk = NULL;
+    mxRegionClose(generate->region);
+    _jobs_busy--;
+    if (!add_to_world(chunk, generate->requested)) drop_chunk(chunk);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Starts generating the requested chunk. Returns false if there's no free
+// job, or out of memory.
+///////////////////////////////////////////////////////////////////////////////
+static bool start_generate(const MX_REQUEST_T* request)
+{
+    MX_GENERATE_JOB_T* generate = NULL;
+    for (int i = 0; i < MAX_GENERATE_JOBS && generate == NULL; i++)
+        if (_jobs[i].chunk == NULL) generate = &_jobs[i];
+    if (generate == NULL) return false;
+
+    generate->chunk = mxWorldAllocChunk(request->cx, request->cy, request->cz);
+    if (generate->chunk == NULL) return false;
+    generate->region = mxRegionOpen(request->cx, request->cy, request->cz, false);
+    generate->requested = request->time;
+    generate->job.run = generate_run;
+    generate->job.finish = generate_finish;
+    if (!mxJobsSubmit(&generate->job))
+    {
+        mxRegionClose(generate->region);
+        free(generate->chunk);
+        generate->chunk = NULL;
+        return false;
+    }
+    _jobs_busy++;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static void save_run(MX_JOB_T* job)
+{
+    MX_SAVE_JOB_T* save = (MX_SAVE_JOB_T*) job;
+    MX_CHUNK_T* chunk = save->chunk;
+    save->saved = mxRegionSave(save->region, chunk->cx, chunk->cy, chunk->cz, save->blocks);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static void save_finish(MX_JOB_T* job)
+{
+    MX_SAVE_JOB_T* save = (MX_SAVE_JOB_T*) job;
+    MX_CHUNK_T* chunk = save->chunk;
+    save->chunk = NULL;
+    mxRegionClose(save->region);
+    if (save->saved) chunk->saved_edits = save->edits;
+    if (!save->release) return;
+
+    // A chunk that failed to save goes back in the cache to try again later,
+    // unless it has been loaded again meanwhile.
+    if (chunk->edits == chunk->saved_edits) free(chunk);
+    else if (mxWorldGetChunk(chunk->cx, chunk->cy, chunk->cz) != NULL) drop_chunk(chunk);
+    else cache_add(chunk);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the save job for the chunk, or NULL if it isn't being saved.
+///////////////////////////////////////////////////////////////////////////////
+static MX_SAVE_JOB_T* find_save(int cx, int cy, int cz)
+{
+    for (int i = 0; i < MAX_SAVE_JOBS; i++)
+    {
+        MX_CHUNK_T* chunk = _saves[i].chunk;
+        if (chunk != NULL && chunk->cx == cx && chunk->cy == cy && chunk->cz == cz) return &_saves[i];
+    }
+    return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Starts a job to save the chunk, which closes the region when done. Returns
+// false if there's no free job, in which case the region is still open.
+///////////////////////////////////////////////////////////////////////////////
+static bool start_save(MX_CHUNK_T* chunk, MX_REGION_T* region, bool release)
+{
+    MX_SAVE_JOB_T* save = NULL;
+    for (int i = 0; i < MAX_SAVE_JOBS && save == NULL; i++)
+        if (_saves[i].chunk == NULL) save = &_saves[i];
+    if (save == NULL) return false;
+
+    save->chunk = chunk;
+    save->edits = chunk->edits;
+    save->release = release;
+    save->region = region;
+    memcpy(save->blocks, chunk->blocks, sizeof(save->blocks));
+    save->job.run = save_run;
+    save->job.finish = save_finish;
+    if (!mxJobsSubmit(&save->job))
+    {
+        save->chunk = NULL;
+        return false;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Starts saving every changed chunk in the world that isn't already being
+// saved, for as long as there are free jobs.
+///////////////////////////////////////////////////////////////////////////////
+static void start_saves()
+{
+    int count = mxWorldChunkCount();
+    for (int i = 0; i < count; i++)
+    {
+        MX_CHUNK_T* chunk = mxWorldChunk(i);
+        if (chunk->edits == chunk->saved_edits || find_save(chunk->cx, chunk->cy, chunk->cz) != NULL) continue;
+
+        MX_REGION_T* region = mxRegionOpen(chunk->cx, chunk->cy, chunk->cz, true);
+        if (region != NULL && !start_save(chunk, region, false))
+        {
+            mxRegionClose(region);
+            return;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Saves the chunk if it has changed, waiting for the disk. A full region is
+// compacted when closed if nobody else is using it, so a failed save is tried
+// once more. Returns false if the changes couldn't be saved. Without a world
+// directory there is nowhere to save them, and true is returned.
+///////////////////////////////////////////////////////////////////////////////
+static bool save_chunk(MX_CHUNK_T* chunk)
+{
+    for (int attempt = 0; attempt < 2 && chunk->edits != chunk->saved_edits; attempt++)
+    {
+        MX_REGION_T* region = mxRegionOpen(chunk->cx, chunk->cy, chunk->cz, true);
+        if (region == NULL) return true;
+        if (mxRegionSave(region, chunk->cx, chunk->cy, chunk->cz, chunk->blocks))
+            chunk->saved_edits = chunk->edits;
+        mxRegionClose(region);
+    }
+    return chunk->edits == chunk->saved_edits;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Saves the chunk if it has changed, waiting for the disk, and frees it.
+// Returns false if it couldn't be saved, in which case it isn't freed.
+///////////////////////////////////////////////////////////////////////////////
+static bool save_and_free(MX_CHUNK_T* chunk)
+{
+    if (!save_chunk(chunk)) return false;
+    free(chunk);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Saves the chunk if it has changed and frees it, losing the changes if they
+// can't be saved. Only for when there's nowhere left to keep it.
+///////////////////////////////////////////////////////////////////////////////
+static void save_or_lose(MX_CHUNK_T* chunk)
+{
+    if (save_and_free(chunk)) return;
+
+#ifdef DEBUG_THIS
+    mxDebug("Lost changes to chunk %d, %d, %d", chunk->cx, chunk->cy, chunk->cz);
+#endif
+    free(chunk);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static int cache_find(int cx, int cy, int cz)
+{
+    for (int i = _cache_count - 1; i >= 0; i--)
+    {
+        MX_CHUNK_T* chunk = _cache[i];
+        if (chunk->cx == cx && chunk->cy == cy && chunk->cz == cz) return i;
+    }
+    return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static MX_CHUNK_T* cache_take(int index)
+{
+    MX_CHUNK_T* chunk = _cache[index];
+    memmove(&_cache[index], &_cache[index + 1], (_cache_count - index - 1) * sizeof(MX_CHUNK_T*));
+    _cache_count--;
+    return chunk;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Adds the chunk to the cache as the most recently used. If the cache is full,
+// the least recently used chunk that isn't being saved is dropped, starting
+// a job to save it first if it has changed. If there's no free job for that
+// it is saved here, which waits for the disk, and if that fails it is kept
+// and the next oldest tried instead. If no chunk can be dropped, the new one
+// is saved and freed instead of being kept.
+///////////////////////////////////////////////////////////////////////////////
+static void cache_add(MX_CHUNK_T* chunk)
+{
+    for (int i = 0; i < _cache_count && _cache_count == CACHE_SIZE; i++)
+    {
+        MX_CHUNK_T* oldest = _cache[i];
+        if (find_save(oldest->cx, oldest->cy, oldest->cz) != NULL) continue;
+
+        MX_REGION_T* region = NULL;
+        if (oldest->edits != oldest->saved_edits)
+            region = mxRegionOpen(oldest->cx, oldest->cy, oldest->cz, true);
+        if (region != NULL && start_save(oldest, region, true))
+        {
+            cache_take(i);
+            continue;
+        }
+        mxRegionClose(region);
+        if (save_chunk(oldest)) free(cache_take(i));
+    }
+
+    if (_cache_count == CACHE_SIZE)
+    {
+        save_or_lose(chunk);
+        return;
+    }
+    _cache[_cache_count++] = chunk;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Asks for the chunk at the given chunk coordinates to be loaded. Returns
+// false if the request queue is full.
+///////////////////////////////////////////////////////////////////////////////
+bool mxLoaderRequest(int cx, int cy, int cz)
+{
+    if (_requests_count == MAX_REQUESTS) return false;
+    MX_REQUEST_T* request = &_requests[(_requests_head + _requests_count++) & (MAX_REQUESTS - 1)];
+    request->cx = cx;
+    request->cy = cy;
+    request->cz = cz;
+    request->time = mxProfileNow();
+
+#ifdef DEBUG_THIS
+    mxDebug("Requested chunk %d, %d, %d", cx, cy, cz);
+#endif
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns true if the chunk at the given chunk coordinates has been requested
+// and is not in the world yet.
+///////////////////////////////////////////////////////////////////////////////
+bool mxLoaderLoading(int cx, int cy, int cz)
+{
+    for (unsigned int i = 0; i < _requests_count; i++)
+    {
+        const MX_REQUEST_T* request = &_requests[(_requests_head + i) & (MAX_REQUESTS - 1)];
+        if (request->cx == cx && request->cy == cy && request->cz == cz) return true;
+    }
+    for (int i = 0; i < MAX_GENERATE_JOBS; i++)
+    {
+        const MX_CHUNK_T* chunk = _jobs[i].chunk;
+        if (chunk != NULL && chunk->cx == cx && chunk->cy == cy && chunk->cz == cz) return true;
+    }
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Takes a chunk that has been removed from the world, keeping it in the cache
+// until it is asked for again or pushed out by other chunks.
+///////////////////////////////////////////////////////////////////////////////
+void mxLoaderUnload(MX_CHUNK_T* chunk)
+{
+    cache_add(chunk);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the number of unloaded chunks held in memory.
+///////////////////////////////////////////////////////////////////////////////
+int mxLoaderCachedCount()
+{
+    return _cache_count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Brings in waiting requests that are in the cache, starts generating as many
+// of the rest as there are free jobs, and now and then starts saving changed
+// chunks. Called once a frame.
+///////////////////////////////////////////////////////////////////////////////
+void mxLoaderUpdate()
+{
+    if (++_updates == SAVE_INTERVAL)
+    {
+        _updates = 0;
+        start_saves();
+    }
+
+    while (_requests_count > 0)
+    {
+        const MX_REQUEST_T* request = &_requests[_requests_head];
+        int index = cache_find(request->cx, request->cy, request->cz);
+        MX_SAVE_JOB_T* save = find_save(request->cx, request->cy, request->cz);
+        if (index >= 0)
+        {
+            MX_CHUNK_T* chunk = cache_take(index);
+            if (!add_to_world(chunk, request->time)) drop_chunk(chunk);
+        }
+        else if (save != NULL && save->release)
+        {
+            // It was on its way out; keep it after the save instead. If it
+            // can't be added, the save job still owns it and frees it.
+            if (add_to_world(save->chunk, request->time)) save->release = false;
+        }
+        else if (mxWorldGetChunk(request->cx, request->cy, request->cz) == NULL &&
+                 !start_generate(request))
+        {
+            break;
+        }
+        _requests_head = (_requests_head + 1) & (MAX_REQUESTS - 1);
+        _requests_count--;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the number of chunks requested and not yet added to the world.
+///////////////////////////////////////////////////////////////////////////////
+int mxLoaderPending()
+{
+    return (int) _requests_count + _jobs_busy;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Saves any changed chunks, waiting for the disk, and frees the cache and
+// chunks that were still being generated. The workers must have been stopped
+// first, and the world not yet cleaned up.
+///////////////////////////////////////////////////////////////////////////////
+void mxLoaderCleanup()
+{
+    int count = mxWorldChunkCount();
+    for (int i = 0; i < count; i++)
+    {
+        MX_CHUNK_T* chunk = mxWorldChunk(i);
+        if (save_chunk(chunk)) continue;
+
+#ifdef DEBUG_THIS
+        mxDebug("Lost changes to chunk %d, %d, %d", chunk->cx, chunk->cy, chunk->cz);
+#endif
+    }
+    for (int i = 0; i < MAX_SAVE_JOBS; i++)
+    {
+        if (_saves[i].chunk != NULL) mxRegionClose(_saves[i].region);
+        if (_saves[i].chunk != NULL && _saves[i].release) save_or_lose(_saves[i].chunk);
+        _saves[i].chunk = NULL;
+    }
+    for (int i = 0; i < _cache_count; i++) save_or_lose(_cache[i]);
+    _cache_count = 0;
+    _updates = 0;
+
+    for (int i = 0; i < MAX_GENERATE_JOBS; i++)
+    {
+        if (_jobs[i].chunk != NULL) mxRegionClose(_jobs[i].region);
+        free(_jobs[i].chunk);
+        _jobs[i].chunk = NULL;
+    }
+    _jobs_busy = 0;
+    _requests_head = _requests_count = 0;
+}
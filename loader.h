@@ -0,0 +1,16 @@
+#ifndef MX_LOADER_H
+#define MX_LOADER_H
+
+#include "world.h" // MX_CHUNK_T
+
+#include <stdbool.h> // bool
+
+bool mxLoaderRequest(int cx, int cy, int cz);
+bool mxLoaderLoading(int cx, int cy, int cz);
+void mxLoaderUnload(MX_CHUNK_T* chunk);
+int mxLoaderCachedCount();
+void mxLoaderUpdate();
+int mxLoaderPending();
+void mxLoaderCleanup();
+
+#endif /* MX_LOADER_H */
@@ -6,21 +6,80 @@
 #endif
 
 #include "display.h"
+#include "generator.h"
 #include "gfx_engine.h"
+#include "input.h"
+#include "jobs.h"
 #include "keyboard.h"
+#include "loader.h"
 #include "mouse.h"
 #include "player.h"
+#include "profiler.h"
+#include "raycast.h"
+#include "record.h"
+#include "region.h"
+#include "script.h"
+#include "stream.h"
+#include "world.h"
 
-#include <stdlib.h> // exit
-#include <stdio.h> // printf
+#include <stdlib.h> // exit, atoi
+#include <stdio.h> // printf, sscanf
+#include <string.h> // strcmp
+#include <math.h> // floor, fmod
 #include <signal.h> // signal, SIGINT, etc.
+#ifdef HAVE_LIBBCM_HOST
 #include <bcm_host.h> // bcm_host_init
-#include <sys/time.h> // gettimeofday
-#include <gpm.h> // GPM_B_LEFT, GPM_B_RIGHT, GPM_DOWN, GPM_UP
+#endif
+
+// Default seed for generating the world.
+#define WORLD_SEED 1u
+
+// Default radius around the player within which chunks are loaded, in chunks.
+#define STREAM_RADIUS 8
+
+// Default number of display refreshes to wait for when swapping buffers.
+#define SWAP_INTERVAL 1
+
+// Default directory for saved chunks. Headless runs don't save unless given
+// a directory, so that they always start from the generated world.
+#define WORLD_DIRECTORY "world"
+
+// Defaults for headless mode.
+#define HEADLESS_FRAMES 300
+#define HEADLESS_WIDTH 640
+#define HEADLESS_HEIGHT 480
+
+// Edits made by --edits are within this many blocks of the player
+// horizontally, and of the ground vertically.
+#define EDIT_RANGE 64
+#define EDIT_DEPTH 2
+
+// The game is updated at a fixed rate, whatever the frame rate, and frames
+// show the game between the last two updates. After a long frame no more
+// than MAX_UPDATES are made to catch up, and the rest of the time is lost, so
+// that a slow machine doesn't fall further and further behind.
+#define UPDATE_MILLIS (1000.0 / 60.0)
+#define MAX_UPDATES 5
 
 // This variable is used to terminate the main event loop.
 static volatile bool _terminate;
 
+// Set when input comes from evdev, and which of the keyboard and mouse do.
+// The console keyboard and GPM are used for those that don't.
+static bool _evdev;
+static bool _evdev_keyboard;
+static bool _evdev_mouse;
+
+// Set when rendering offscreen with scripted input instead of the console.
+static bool _headless;
+
+// Set by SIGUSR1 to ask for a profile report at the end of the frame.
+static volatile sig_atomic_t _report;
+
+// Where and how the profile report is written.
+static int _profile_format = MX_PROFILE_TEXT;
+static const char* _profile_file;
+
 ///////////////////////////////////////////////////////////////////////////////
 // This function ends the main event loop cleanly, in response to exit signals.
 ///////////////////////////////////////////////////////////////////////////////
@@ -35,7 +94,7 @@ static void exit_handler(int sig)
 
     // NOTE: Segmentation fault was not terminating the loop normally.
     //       Ensure that we have an operable keyboard in this case!
-    if (sig == SIGSEGV)
+    if (sig == SIGSEGV && !_headless && !_evdev_keyboard)
         mxKeyboardCleanup();
     
     // Reset signal handler to default value.
@@ -44,18 +103,342 @@ static void exit_handler(int sig)
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// This function returns the number of milliseconds since the epoch.
+// Asks for a profile report without stopping, e.g. with "kill -USR1 <pid>".
+///////////////////////////////////////////////////////////////////////////////
+static void report_handler(int sig)
+{
+    _report = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes the profile report to the file given on the command line, or else to
+// stderr.
+///////////////////////////////////////////////////////////////////////////////
+static void report()
+{
+    FILE* f = _profile_file != NULL ? fopen(_profile_file, "w") : stderr;
+    if (f == NULL)
+    {
+        fprintf(stderr, "Failed to write %s\n", _profile_file);
+        return;
+    }
+    mxProfileReport(f, _profile_format);
+    if (f != stderr) fclose(f);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// This function returns the time in milliseconds from the monotonic clock,
+// which unlike the time of day never jumps when the system time is set.
 ///////////////////////////////////////////////////////////////////////////////
 static double time()
 {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return (double) tv.tv_sec * 1000.0 + (double) tv.tv_usec / 1000.0;
+    return (double) mxProfileNow() / 1e6;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static void usage(const char* name)
+{
+    fprintf(stderr,
+        "Usage: %s [--seed N] [--world DIR] [--radius N] [--workers N]\n"
+        "          [--swap-interval N] [--fps N] [--record FILE] [--replay FILE]\n"
+        "          [--profile text|csv|json] [--profile-file FILE]\n"
+        "          [--headless [--frames N] [--size WxH] [--script FILE] [--dump FILE]\n"
+        "                      [--edits N] [--walk]]\n"
+        "  --seed N       seed the world is generated from (default %u)\n"
+        "  --world DIR    directory changed chunks are saved in (default %s)\n"
+        "  --radius N     load chunks within N chunks of the player (default %d)\n"
+        "  --workers N    number of worker threads (default one per extra processor)\n"
+        "  --swap-interval N  display refreshes to wait for on each swap (default %d)\n"
+        "  --fps N        limit the frame rate to N frames per second (default none)\n"
+        "  --record FILE  record the input of every frame to FILE\n"
+        "  --replay FILE  play back the input recorded in FILE, then exit\n"
+        "  --profile FMT  format of the frame time report written at exit and on\n"
+        "                 SIGUSR1 or F11 (default text)\n"
+        "  --profile-file FILE  write the report to FILE instead of stderr\n"
+        "  --headless     render offscreen with scripted input, printing frame times\n"
+        "  --frames N     number of frames to render (default %d, or the whole\n"
+        "                 recording with --replay)\n"
+        "  --size WxH     size of the offscreen frame (default %dx%d)\n"
+        "  --script FILE  input script to play (default is built in)\n"
+        "  --dump FILE    write the final frame to FILE as a PPM image\n"
+        "  --edits N      make N random block edits around the player each frame\n"
+        "  --walk         walk on the ground instead of flying\n",
+        name, WORLD_SEED, WORLD_DIRECTORY, STREAM_RADIUS, SWAP_INTERVAL,
+        HEADLESS_FRAMES, HEADLESS_WIDTH, HEADLESS_HEIGHT);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Makes random edits near the ground around the player, adding blocks where
+// there are none and removing them where there are, so that the time taken
+// for edits to be meshed can be measured. Edits are repeatable for a given
+// state, as they come from their own random number generator.
+///////////////////////////////////////////////////////////////////////////////
+static void random_edits(int count, unsigned int* state)
+{
+    float x, y, z;
+    mxPlayerGetPosition(&x, &y, &z);
+    int px = (int) floor(x / MX_BLOCK_SIZE + 0.5f);
+    int pz = (int) floor(z / MX_BLOCK_SIZE + 0.5f);
+
+    for (int i = 0; i < count; i++)
+    {
+        // Numerical Recipes' linear congruential generator.
+        unsigned int r[3];
+        for (int j = 0; j < 3; j++)
+        {
+            *state = *state * 1664525u + 1013904223u;
+            r[j] = *state >> 8;
+        }
+        int bx = px + (int) (r[0] % (2 * EDIT_RANGE + 1)) - EDIT_RANGE;
+        int bz = pz + (int) (r[1] % (2 * EDIT_RANGE + 1)) - EDIT_RANGE;
+        int by = mxGeneratorHeight(bx, bz) + (int) (r[2] % (2 * EDIT_DEPTH + 1)) - EDIT_DEPTH;
+
+        // Only edit loaded chunks, so as not to make empty chunks that would
+        // stop the real ones loading.
+        if (mxWorldGetChunk(bx >> MX_CHUNK_BITS, by >> MX_CHUNK_BITS, bz >> MX_CHUNK_BITS) == NULL) continue;
+        MX_BLOCK_T type = mxWorldGetBlock(bx, by, bz) == MX_BLOCK_AIR ? MX_BLOCK_DIRT : MX_BLOCK_AIR;
+        mxWorldSetBlock(bx, by, bz, type);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Removes the block the player is looking at for the left button, or places
+// dirt against the face they're looking at for the right button, unless that
+// would put it where the player is. Like random edits, only loaded chunks are
+// edited, as setting a block elsewhere would make an empty chunk that stops
+// the real one loading.
+///////////////////////////////////////////////////////////////////////////////
+static void edit_picked_block(unsigned char buttons)
+{
+    MX_RAYCAST_HIT_T hit;
+    if (!(buttons & (MOUSE_LEFT | MOUSE_RIGHT)) || !mxPlayerPick(&hit)) return;
+    if (buttons & MOUSE_LEFT)
+    {
+        if (mxWorldGetChunk(hit.x >> MX_CHUNK_BITS, hit.y >> MX_CHUNK_BITS, hit.z >> MX_CHUNK_BITS) == NULL) return;
+        mxWorldSetBlock(hit.x, hit.y, hit.z, MX_BLOCK_AIR);
+        return;
+    }
+
+    int nx, ny, nz;
+    mxRaycastFaceNormal(hit.face, &nx, &ny, &nz);
+    if (nx == 0 && ny == 0 && nz == 0) return;
+
+    float x, y, z;
+    mxPlayerGetPosition(&x, &y, &z);
+    if (hit.x + nx == (int) floor(x / MX_BLOCK_SIZE + 0.5f) &&
+        hit.y + ny == (int) floor(y / MX_BLOCK_SIZE + 0.5f) &&
+        hit.z + nz == (int) floor(z / MX_BLOCK_SIZE + 0.5f)) return;
+    if (mxWorldGetChunk((hit.x + nx) >> MX_CHUNK_BITS, (hit.y + ny) >> MX_CHUNK_BITS,
+                        (hit.z + nz) >> MX_CHUNK_BITS) == NULL) return;
+    mxWorldSetBlock(hit.x + nx, hit.y + ny, hit.z + nz, MX_BLOCK_DIRT);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Handles the special keys pressed this frame. Returns false if the game
+// should exit.
+///////////////////////////////////////////////////////////////////////////////
+static bool handle_special_keys(unsigned char specialKeys)
+{
+    if (specialKeys & KEY_EXIT) return false;
+    if (specialKeys & KEY_RESET_POS) mxPlayerMoveToStartPosition();
+    if (specialKeys & KEY_TOGGLE_FLYING) mxPlayerSetFlying(!mxPlayerIsFlying());
+    if (specialKeys & KEY_PROFILE_REPORT) _report = true;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Updates the game for the time the given frame took in fixed steps,
+// carrying any remainder over to the next frame in lag. Looking around is
+// applied straight away, so it responds as quickly as possible.
+///////////////////////////////////////////////////////////////////////////////
+static void update_game(const MX_RECORD_FRAME_T* input, double* lag)
+{
+    *lag += input->millis;
+    MX_PROFILE(MX_PROFILE_PLAYER)
+    {
+        mxPlayerLook(input->mouseDeltaX, input->mouseDeltaY);
+        for (int updates = 0; *lag >= UPDATE_MILLIS && updates < MAX_UPDATES; updates++)
+        {
+            mxGraphicsUpdate(UPDATE_MILLIS);
+            mxPlayerUpdate(input->moveKeys, UPDATE_MILLIS);
+            *lag -= UPDATE_MILLIS;
+        }
+        if (*lag >= UPDATE_MILLIS) *lag = fmod(*lag, UPDATE_MILLIS);
+        mxPlayerPlaceCamera((float) (*lag / UPDATE_MILLIS));
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Renders a fixed number of frames offscreen, driven by an input script or a
+// recording, and prints how long each stage of each frame took as CSV on
+// stdout. Returns the exit status.
+///////////////////////////////////////////////////////////////////////////////
+static int run_headless(int frames, unsigned int width, unsigned int height,
+                        int workers, int radius, const char* script, const char* replay,
+                        const char* dump, int edits, bool walk)
+{
+    unsigned int edit_state = 1;
+    double lag = 0.0;
+    bool ok = replay != NULL ? mxReplaySetup(replay) : mxScriptSetup(script);
+    if (frames < 0) frames = replay != NULL ? mxReplayFrames() : HEADLESS_FRAMES;
+    ok = ok && mxDisplaySetupHeadless(width, height);
+    ok = ok && mxWorldSetup();
+    ok = ok && mxStreamSetup(radius);
+    ok = ok && mxJobsSetup(workers);
+    ok = ok && mxGraphicsSetup(width, height);
+    ok = ok && mxPlayerSetup();
+
+    // Scripts fly by default, so that they can go anywhere. Recordings start
+    // the way the game does.
+    if (replay == NULL) mxPlayerSetFlying(!walk);
+
+    // Frames only depend on the script if the world is fully loaded.
+    if (ok) mxGraphicsFinishLoading();
+
+    int frame = 0;
+    if (ok) printf("frame,input_ms,player_ms,paint_ms,swap_ms,frame_ms,drawn,culled,"
+                   "draws,triangles,binds,upload_bytes,state_changes,redundant,hidden,coarse\n");
+    for (; ok && !_terminate && frame < frames; frame++)
+    {
+        bool more = true;
+        bool stop = false;
+        MX_PROFILE(MX_PROFILE_FRAME)
+        {
+            MX_RECORD_FRAME_T input = { UPDATE_MILLIS, 0, 0, 0, 0.f, 0.f };
+            MX_PROFILE(MX_PROFILE_INPUT)
+            {
+                if (replay != NULL) more = mxReplayUpdate(&input);
+                else mxScriptUpdate(&input.moveKeys, &input.mouseDeltaX, &input.mouseDeltaY);
+            }
+            stop = !more || !handle_special_keys(input.specialKeys);
+            if (!stop)
+            {
+                // A recording is played back the way it was recorded, with
+                // its own frame times. Otherwise each frame is one update, so
+                // that a given script and frame count always render the same
+                // final frame, and shows the latest state.
+                if (replay != NULL)
+                {
+                    update_game(&input, &lag);
+                    edit_picked_block(input.buttons);
+                }
+                else
+                {
+                    mxGraphicsUpdate(UPDATE_MILLIS);
+                    MX_PROFILE(MX_PROFILE_PLAYER)
+                    {
+                        mxPlayerLook(input.mouseDeltaX, input.mouseDeltaY);
+                        mxPlayerUpdate(input.moveKeys, UPDATE_MILLIS);
+                        mxPlayerPlaceCamera(1.f);
+                    }
+                }
+                random_edits(edits, &edit_state);
+                MX_PROFILE(MX_PROFILE_PAINT) mxGraphicsPaint();
+                MX_PROFILE(MX_PROFILE_SWAP) mxDisplaySwapBuffers();
+            }
+        }
+        if (stop) break;
+
+        printf("%d,%.4f,%.4f,%.4f,%.4f,%.4f,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\n", frame,
+               mxProfileLast(MX_PROFILE_INPUT), mxProfileLast(MX_PROFILE_PLAYER),
+               mxProfileLast(MX_PROFILE_PAINT), mxProfileLast(MX_PROFILE_SWAP),
+               mxProfileLast(MX_PROFILE_FRAME),
+               (int) mxProfileLast(MX_PROFILE_CHUNKS_DRAWN),
+               (int) mxProfileLast(MX_PROFILE_CHUNKS_CULLED),
+               (int) mxProfileLast(MX_PROFILE_DRAW_CALLS),
+               (int) mxProfileLast(MX_PROFILE_TRIANGLES),
+               (int) mxProfileLast(MX_PROFILE_TEXTURE_BINDS),
+               (int) mxProfileLast(MX_PROFILE_UPLOAD_BYTES),
+               (int) mxProfileLast(MX_PROFILE_STATE_CHANGES),
+               (int) mxProfileLast(MX_PROFILE_REDUNDANT_STATE),
+               (int) mxProfileLast(MX_PROFILE_CHUNKS_HIDDEN),
+               (int) mxProfileLast(MX_PROFILE_CHUNKS_COARSE));
+        if (_report)
+        {
+            _report = false;
+            report();
+        }
+    }
+
+    if (ok && frame > 0)
+    {
+        report();
+
+        // Chunks stream in as the player moves, so finish loading and paint
+        // again to make the dump independent of how fast the workers are.
+        if (dump != NULL)
+        {
+            mxGraphicsFinishLoading();
+            mxGraphicsPaint();
+        }
+        if (dump != NULL && !mxGraphicsSaveFrame(dump))
+        {
+            fprintf(stderr, "Failed to write %s\n", dump);
+            ok = false;
+        }
+    }
+
+    mxJobsCleanup();
+    mxPlayerCleanup();
+    mxGraphicsCleanup();
+    mxStreamCleanup();
+    mxLoaderCleanup();
+    mxRegionCleanup();
+    mxWorldCleanup();
+    mxDisplayCleanup();
+    mxScriptCleanup();
+    mxReplayCleanup();
+    return ok ? 0 : 1;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 int main(int argc, char **argv)
 {
+    // Command line options.
+    int frames = -1;
+    int edits = 0;
+    bool walk = false;
+    unsigned int width = HEADLESS_WIDTH;
+    unsigned int height = HEADLESS_HEIGHT;
+    const char* script = NULL;
+    const char* dump = NULL;
+    const char* record = NULL;
+    const char* replay = NULL;
+    int workers = -1;
+    unsigned int seed = WORLD_SEED;
+    const char* world = NULL;
+    int radius = STREAM_RADIUS;
+    int swap_interval = SWAP_INTERVAL;
+    int fps = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        bool more = i + 1 < argc;
+        if (strcmp(argv[i], "--headless") == 0) _headless = true;
+        else if (strcmp(argv[i], "--frames") == 0 && more) frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--size") == 0 && more &&
+                 sscanf(argv[++i], "%ux%u", &width, &height) == 2) continue;
+        else if (strcmp(argv[i], "--script") == 0 && more) script = argv[++i];
+        else if (strcmp(argv[i], "--dump") == 0 && more) dump = argv[++i];
+        else if (strcmp(argv[i], "--edits") == 0 && more) edits = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--walk") == 0) walk = true;
+        else if (strcmp(argv[i], "--workers") == 0 && more) workers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && more) seed = (unsigned int) strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--world") == 0 && more) world = argv[++i];
+        else if (strcmp(argv[i], "--radius") == 0 && more) radius = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--swap-interval") == 0 && more) swap_interval = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--fps") == 0 && more) fps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--record") == 0 && more) record = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && more) replay = argv[++i];
+        else if (strcmp(argv[i], "--profile") == 0 && more &&
+                 (_profile_format = mxProfileFormat(argv[++i])) >= 0) continue;
+        else if (strcmp(argv[i], "--profile-file") == 0 && more) _profile_file = argv[++i];
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
     // Exit handler setup.
     signal(SIGINT, exit_handler); // Ctrl-c
 	signal(SIGHUP, exit_handler);
@@ -66,7 +449,7 @@ int main(int argc, char **argv)
 	signal(SIGIOT, exit_handler);
 	signal(SIGFPE, exit_handler);
 	signal(SIGKILL, exit_handler);
-	signal(SIGUSR1, exit_handler);
+	signal(SIGUSR1, report_handler);
 	signal(SIGSEGV, exit_handler);
 	signal(SIGUSR2, exit_handler);
 	signal(SIGPIPE, exit_handler);
@@ -81,74 +464,146 @@ int main(int argc, char **argv)
 	signal(SIGTTIN, exit_handler);
 	signal(SIGTTOU, exit_handler);
     
+    mxGeneratorSetup(seed);
+    if (world == NULL && !_headless) world = WORLD_DIRECTORY;
+    if (!mxRegionSetup(world))
+    {
+        fprintf(stderr, "Failed to open %s\n", world);
+        return 1;
+    }
+    mxDisplaySetFrameLimit(fps);
+    if (_headless) return run_headless(frames, width, height, workers, radius, script, replay, dump, edits, walk);
+
     // Variables used in main loop.
     double t; // current time.
-    double lastTime = time();
-    float timeSinceLastUpdate = 0.f;
+    double lastTime;
+    double timeSinceLastFrame;
+    double lag = 0.0; // time the game is behind by.
     int frameCounter = 0;
-    int frameCounterMillis = 0;
+    double frameCounterMillis = 0.0;
     float mouseDeltaX, mouseDeltaY = 0.f;
     unsigned char mouseButtons = 0;
     unsigned char eventType = 0;
     unsigned char moveKeys = 0;
     unsigned char specialKeys = 0;
+    uint64_t inputTime = 0;
 
 	// Initial setup.
     double start = time();
 #ifdef DEBUG_THIS
     mxDebugStr("** Started **");
 #endif
+#ifdef HAVE_LIBBCM_HOST
     bcm_host_init();
-    uint32_t screen_width, screen_height;
-    if (!mxKeyboardSetup()) _terminate = true;
-    if (!_terminate && !mxMouseSetup()) _terminate = true;
+#endif
+    unsigned int screen_width, screen_height;
+    _evdev = mxInputSetup(&_evdev_keyboard, &_evdev_mouse);
+    if (!_evdev_keyboard && !mxKeyboardSetup()) _terminate = true;
+    if (!_evdev_mouse && !_terminate && !mxMouseSetup()) _terminate = true;
     if (!_terminate && !mxDisplaySetup(&screen_width, &screen_height)) _terminate = true;
+    if (!_terminate && !mxDisplaySetSwapInterval(swap_interval))
+        mxDebug("Swap interval %d not supported", swap_interval);
+    if (!_terminate && !mxWorldSetup()) _terminate = true;
+    if (!_terminate && !mxStreamSetup(radius)) _terminate = true;
+    if (!_terminate && !mxJobsSetup(workers)) _terminate = true;
     if (!_terminate && !mxGraphicsSetup(screen_width, screen_height)) _terminate = true;
     if (!_terminate && !mxPlayerSetup()) _terminate = true;
+    if (!_terminate && record != NULL && !mxRecordSetup(record))
+    {
+        fprintf(stderr, "Failed to write %s\n", record);
+        _terminate = true;
+    }
+    if (!_terminate && replay != NULL && !mxReplaySetup(replay))
+    {
+        fprintf(stderr, "Failed to read %s\n", replay);
+        _terminate = true;
+    }
 
-    // Loop until terminated or exit key is pressed.
+    // Loop until terminated or exit key is pressed. Time spent setting up
+    // doesn't need catching up on.
+    lastTime = time();
     while (!_terminate)
     {
-        // Measure time between each frame for smooth animation.
-        timeSinceLastUpdate = (float) ((t = time()) - lastTime);
+        // Measure time between each frame.
+        timeSinceLastFrame = (t = time()) - lastTime;
         lastTime = t;
 
         // Log FPS once a second.
-        frameCounterMillis += (int) timeSinceLastUpdate;
+        frameCounterMillis += timeSinceLastFrame;
         if (frameCounterMillis >= 1000)
         {
-            mxDebug("FPS: %d", frameCounter);
+            mxDebug("FPS: %d, missed frames: %u", frameCounter, mxDisplayMissedFrames());
             frameCounterMillis -= 1000;
             frameCounter = 0;
         }
         frameCounter++;
 
-        // Handle controls.
-        mouseDeltaX = mouseDeltaY = 0.f;
-        mxMouseUpdate(&mouseDeltaX, &mouseDeltaY, &mouseButtons, &eventType);
-        mxKeyboardUpdate(&moveKeys, &specialKeys);
+        uint64_t frameStart = mxProfileNow();
 
-        // Handle special keys.
-        if (specialKeys & KEY_EXIT) break;
-        if (specialKeys & KEY_RESET_POS) mxPlayerMoveToStartPosition();
+        // Handle controls. Events from evdev have already been read by the
+        // input thread, and are timed until the frame showing them is swapped.
+        bool newInput = false;
+        MX_PROFILE(MX_PROFILE_INPUT)
+        {
+            mouseDeltaX = mouseDeltaY = 0.f;
+            mouseButtons = 0;
+            if (_evdev)
+            {
+                newInput = mxInputUpdate(&moveKeys, &specialKeys, &mouseDeltaX, &mouseDeltaY,
+                                         &mouseButtons, &inputTime);
+            }
+            if (!_evdev_mouse) mxMouseUpdate(&mouseDeltaX, &mouseDeltaY, &mouseButtons, &eventType);
+            if (!_evdev_keyboard) mxKeyboardUpdate(&moveKeys, &specialKeys);
+        }
+
+        // When playing back a recording, its input and frame times are used
+        // instead, apart from the keys to exit and report.
+        MX_RECORD_FRAME_T input = {
+            timeSinceLastFrame, moveKeys, specialKeys, mouseButtons, mouseDeltaX, mouseDeltaY
+        };
+        if (replay != NULL)
+        {
+            unsigned char keys = specialKeys & (KEY_EXIT | KEY_PROFILE_REPORT);
+            if (!mxReplayUpdate(&input)) break;
+            input.specialKeys |= keys;
+        }
+        mxRecordFrame(&input);
         specialKeys = 0;
+        if (!handle_special_keys(input.specialKeys)) break;
+
+        // Update the game and paint the new frame.
+        update_game(&input, &lag);
+        edit_picked_block(input.buttons);
+        MX_PROFILE(MX_PROFILE_PAINT) mxGraphicsPaint();
+        MX_PROFILE(MX_PROFILE_SWAP) mxDisplaySwapBuffers();
+        uint64_t frameEnd = mxProfileNow();
+        mxProfileAdd(MX_PROFILE_FRAME, frameEnd - frameStart);
+        if (newInput) mxProfileAdd(MX_PROFILE_INPUT_LATENCY, frameEnd - inputTime);
 
-        // Update and paint new frame.
-        mxGraphicsUpdate(timeSinceLastUpdate);
-        mxPlayerUpdate(moveKeys, mouseDeltaX, mouseDeltaY, timeSinceLastUpdate);
-        mxGraphicsPaint();
+        if (_report)
+        {
+            _report = false;
+            report();
+        }
     }
+    report();
     
     // Cleanup and shutdown gracefully.
+    mxJobsCleanup();
+    mxPlayerCleanup();
     mxGraphicsCleanup();
+    mxStreamCleanup();
+    mxLoaderCleanup();
+    mxRegionCleanup();
+    mxWorldCleanup();
     mxDisplayCleanup();
-    mxMouseCleanup();
-    mxKeyboardCleanup();
+    mxRecordCleanup();
+    mxReplayCleanup();
+    if (_evdev) mxInputCleanup();
+    if (!_evdev_mouse) mxMouseCleanup();
+    if (!_evdev_keyboard) mxKeyboardCleanup();
 #ifdef DEBUG_THIS
     mxDebug("** Finished (%f seconds elapsed) **", (time() - start) / 1000.f);    
 #endif
     return 0;
 }
-#endif
-    return 0;
-}
@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////////////////////////////////
+// This file replaces the matrix stack of OpenGL ES 1, which isn't available
+// in OpenGL ES 2. The functions follow the behaviour of their GLES 1
+// counterparts, so that translate and scale multiply onto the given matrix.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "matrix.h"
+
+#include <string.h> // memcpy, memset
+
+#define M(m, row, col) (m)[(col) * 4 + (row)]
+
+///////////////////////////////////////////////////////////////////////////////
+void mxMatrixIdentity(MX_MATRIX_T m)
+{
+    memset(m, 0, sizeof(MX_MATRIX_T));
+    M(m, 0, 0) = 1.f;
+    M(m, 1, 1) = 1.f;
+    M(m, 2, 2) = 1.f;
+    M(m, 3, 3) = 1.f;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets result to a * b. The result may be the same matrix as either input.
+///////////////////////////////////////////////////////////////////////////////
+void mxMatrixMultiply(MX_MATRIX_T result, const MX_MATRIX_T a, const MX_MATRIX_T b)
+{
+    MX_MATRIX_T tmp;
+    for (int col = 0; col < 4; col++)
+    {
+        for (int row = 0; row < 4; row++)
+        {
+            M(tmp, row, col) = M(a, row, 0) * M(b, 0, col)
+                             + M(a, row, 1) * M(b, 1, col)
+                             + M(a, row, 2) * M(b, 2, col)
+                             + M(a, row, 3) * M(b, 3, col);
+        }
+    }
+    memcpy(result, tmp, sizeof(MX_MATRIX_T));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Equivalent to glTranslatef.
+///////////////////////////////////////////////////////////////////////////////
+void mxMatrixTranslate(MX_MATRIX_T m, float x, float y, float z)
+{
+    for (int row = 0; row < 4; row++)
+        M(m, row, 3) += M(m, row, 0) * x + M(m, row, 1) * y + M(m, row, 2) * z;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Equivalent to glScalef.
+///////////////////////////////////////////////////////////////////////////////
+void mxMatrixScale(MX_MATRIX_T m, float x, float y, float z)
+{
+    for (int row = 0; row < 4; row++)
+    {
+        M(m, row, 0) *= x;
+        M(m, row, 1) *= y;
+        M(m, row, 2) *= z;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets m to the perspective projection that glFrustumf would multiply by.
+///////////////////////////////////////////////////////////////////////////////
+void mxMatrixFrustum(MX_MATRIX_T m, float left, float right, float bottom, float top, float zNear, float zFar)
+{
+    memset(m, 0, sizeof(MX_MATRIX_T));
+    M(m, 0, 0) = 2.f * zNear / (right - left);
+    M(m, 0, 2) = (right + left) / (right - left);
+    M(m, 1, 1) = 2.f * zNear / (top - bottom);
+    M(m, 1, 2) = (top + bottom) / (top - bottom);
+    M(m, 2, 2) = -(zFar + zNear) / (zFar - zNear);
+    M(m, 2, 3) = -2.f * zFar * zNear / (zFar - zNear);
+    M(m, 3, 2) = -1.f;
+}
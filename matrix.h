@@ -0,0 +1,13 @@
+#ifndef MX_MATRIX_H
+#define MX_MATRIX_H
+
+// Matrices are 4x4 and stored in column-major order, as OpenGL expects.
+typedef float MX_MATRIX_T[16];
+
+void mxMatrixIdentity(MX_MATRIX_T m);
+void mxMatrixMultiply(MX_MATRIX_T result, const MX_MATRIX_T a, const MX_MATRIX_T b);
+void mxMatrixTranslate(MX_MATRIX_T m, float x, float y, float z);
+void mxMatrixScale(MX_MATRIX_T m, float x, float y, float z);
+void mxMatrixFrustum(MX_MATRIX_T m, float left, float right, float bottom, float top, float zNear, float zFar);
+
+#endif /* MX_MATRIX_H */
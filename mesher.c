@@ -0,0 +1,434 @@
+///////////////////////////////////////////////////////////////////////////////
+// This file turns chunks of blocks into triangle meshes. Faces that touch a
+// solid neighbour can never be seen and are dropped, and the remaining faces
+// are merged into as few quads as possible using greedy meshing: each slice
+// of the chunk is scanned, and each visible face is grown first along one
+// axis and then the other for as long as it meets faces with the same
+// texture.
+//
+// The method is described in more detail here:
+// http://0fps.net/2012/06/30/meshing-in-a-minecraft-game/
+//
+// Chunks far from the camera are meshed the same way from a coarser copy of
+// their blocks, with each cell standing for 2, 4 or 8 blocks a side. The
+// coarse copy is bordered with air, so its faces on the chunk's sides are
+// always kept. These act as skirts, closing the gaps where a coarse chunk
+// meets a neighbour drawn at another level.
+//
+// Each face corner also gets an ambient occlusion level, from the blocks
+// beside and diagonally in front of it, which darkens inside corners. Faces
+// are only merged when all of their corners are equally lit, and unmerged
+// faces are split into triangles along the diagonal that keeps the shading
+// symmetric. This is described here:
+// http://0fps.net/2013/07/03/ambient-occlusion-for-minecraft-like-worlds/
+//
+// The mesher also works out which faces of a chunk can see each other through
+// the air inside it, by flood filling each pocket of air and noting the faces
+// it reaches. Chunks that can't be seen through are used to cull chunks
+// hidden behind them, as described here:
+// https://tomcc.github.io/2014/08/31/visibility-1.html
+//
+// Nothing in this file calls OpenGL, so meshes can be built on any thread.
+///////////////////////////////////////////////////////////////////////////////
+
+// Enable or disable debugging in this file.
+//#define DEBUG_THIS
+
+#ifdef DEBUG_THIS
+#include "debug.h"
+#endif
+
+#include "mesher.h"
+
+#include <stdlib.h> // realloc, free
+#include <string.h> // memcpy, memset
+
+typedef struct
+{
+    // Axis along the face normal, and whether the normal points along it.
+    int n_axis;
+    int n_sign;
+
+    // Axes the face texture's s and t run along, and their directions. These
+    // are chosen so that the quad's corners wind anticlockwise when seen from
+    // outside of the block.
+    int s_axis;
+    int s_sign;
+    int t_axis;
+    int t_sign;
+} FACE_AXES_T;
+
+static const FACE_AXES_T _face_axes[MX_FACE_COUNT] = {
+    { 2,  1,   0,  1,   1, 1 }, // Front
+    { 2, -1,   0, -1,   1, 1 }, // Back
+    { 0, -1,   2,  1,   1, 1 }, // Left
+    { 0,  1,   2, -1,   1, 1 }, // Right
+    { 1,  1,   2,  1,   0, 1 }, // Top
+    { 1, -1,   0,  1,   2, 1 }, // Bottom
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Copies the chunk and a one block border from its neighbours into padded,
+// which must hold MX_PADDED_VOLUME blocks.
+///////////////////////////////////////////////////////////////////////////////
+void mxMesherGather(const MX_CHUNK_T* chunk, MX_BLOCK_T* padded)
+{
+    int base_x = chunk->cx << MX_CHUNK_BITS;
+    int base_y = chunk->cy << MX_CHUNK_BITS;
+    int base_z = chunk->cz << MX_CHUNK_BITS;
+
+    for (int y = -1; y <= MX_CHUNK_SIZE; y++)
+    {
+        for (int z = -1; z <= MX_CHUNK_SIZE; z++)
+        {
+            MX_BLOCK_T* row = &padded[MX_PADDED_INDEX(-1, y, z)];
+            if (y >= 0 && y < MX_CHUNK_SIZE && z >= 0 && z < MX_CHUNK_SIZE)
+            {
+                // Inside rows come straight from the chunk, apart from the ends.
+                row[0] = mxWorldGetBlock(base_x - 1, base_y + y, base_z + z);
+                memcpy(row + 1, &chunk->blocks[MX_BLOCK_INDEX(0, y, z)], MX_CHUNK_SIZE);
+                row[MX_CHUNK_SIZE + 1] = mxWorldGetBlock(base_x + MX_CHUNK_SIZE, base_y + y, base_z + z);
+            }
+            else
+            {
+                for (int x = -1; x <= MX_CHUNK_SIZE; x++)
+                    row[x + 1] = mxWorldGetBlock(base_x + x, base_y + y, base_z + z);
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static bool reserve(MX_MESH_VERTEX_T** vertices, int* capacity, int needed)
+{
+    if (needed <= *capacity) return true;
+
+    int new_capacity = *capacity ? *capacity : 1024;
+    while (new_capacity < needed) new_capacity *= 2;
+    MX_MESH_VERTEX_T* p = (MX_MESH_VERTEX_T*) realloc(*vertices, new_capacity * sizeof(MX_MESH_VERTEX_T));
+    if (p == NULL) return false;
+    *vertices = p;
+    *capacity = new_capacity;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the ambient occlusion levels of the four corners of a face, two bits
+// each with corner 0 lowest, from 0 for fully occluded to 3 for open. front is
+// the index of the empty block the face looks into, and side_s and side_t the
+// offsets from there towards the blocks beside each corner.
+///////////////////////////////////////////////////////////////////////////////
+static unsigned int face_ao(const MX_BLOCK_T* padded, int front, const int side_s[4], const int side_t[4])
+{
+    unsigned int ao = 0;
+    for (int c = 0; c < MX_MESH_QUAD_VERTICES; c++)
+    {
+        int s = padded[front + side_s[c]] != MX_BLOCK_AIR;
+        int t = padded[front + side_t[c]] != MX_BLOCK_AIR;
+        int corner = padded[front + side_s[c] + side_t[c]] != MX_BLOCK_AIR;
+        unsigned int level = (s && t) ? 0 : 3 - (s + t + corner);
+        ao |= level << (2 * c);
+    }
+    return ao;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes the four vertices of a quad covering [i0, i1] x [j0, j1] along the
+// face's s and t axes, lying in the plane at the given position along the
+// normal axis, with the given corner occlusion levels.
+///////////////////////////////////////////////////////////////////////////////
+static void emit_quad(MX_MESH_VERTEX_T* out, int face, int plane,
+                      int i0, int j0, int i1, int j1, unsigned char tile, unsigned int ao)
+{
+    const FACE_AXES_T* axes = &_face_axes[face];
+
+    // Triangles share the diagonal from the first vertex to the third, which
+    // should join the two corners that are darker together.
+    int ao_02 = (ao & 3) + ((ao >> 4) & 3);
+    int ao_13 = ((ao >> 2) & 3) + ((ao >> 6) & 3);
+    int first = ao_02 > ao_13 ? 1 : 0;
+
+    for (int v = 0; v < MX_MESH_QUAD_VERTICES; v++)
+    {
+        int c = (v + first) % MX_MESH_QUAD_VERTICES;
+
+        // Corners go (0, 0), (1, 0), (1, 1), (0, 1) in texture space.
+        int s = (c == 1 || c == 2);
+        int t = (c >= 2);
+
+        int pos[3];
+        pos[axes->n_axis] = plane;
+        pos[axes->s_axis] = (s ^ (axes->s_sign < 0)) ? i1 : i0;
+        pos[axes->t_axis] = (t ^ (axes->t_sign < 0)) ? j1 : j0;
+
+        MX_MESH_VERTEX_T* vertex = &out[v];
+        vertex->x = (unsigned char) pos[0];
+        vertex->y = (unsigned char) pos[1];
+        vertex->z = (unsigned char) pos[2];
+        vertex->tile = tile;
+        vertex->face = (unsigned char) face;
+        vertex->ao = (unsigned char) ((ao >> (2 * c)) & 3);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Fills coarse, which must hold MX_LOD_PADDED_VOLUME(lod) blocks, with the
+// padded chunk at the given level of detail. A cell is solid if at least half
+// of its blocks are, and then takes the type most often on top of its
+// columns, so that grassy ground stays green from afar. The border is air.
+///////////////////////////////////////////////////////////////////////////////
+void mxMesherDownsample(const MX_BLOCK_T* padded, int lod, MX_BLOCK_T* coarse)
+{
+    int scale = 1 << lod;
+    int size = MX_CHUNK_SIZE >> lod;
+    int stride = size + 2;
+    memset(coarse, MX_BLOCK_AIR, MX_LOD_PADDED_VOLUME(lod));
+
+    for (int cy = 0; cy < size; cy++)
+    {
+        for (int cz = 0; cz < size; cz++)
+        {
+            for (int cx = 0; cx < size; cx++)
+            {
+                // The top block of each column, and how many columns have
+                // each of those types.
+                MX_BLOCK_T tops[MX_CHUNK_SIZE * MX_CHUNK_SIZE];
+                int top_counts[MX_CHUNK_SIZE * MX_CHUNK_SIZE];
+                int top_types = 0;
+                int solid = 0;
+
+                for (int z = cz * scale; z < (cz + 1) * scale; z++)
+                {
+                    for (int x = cx * scale; x < (cx + 1) * scale; x++)
+                    {
+                        MX_BLOCK_T top = MX_BLOCK_AIR;
+                        for (int y = (cy + 1) * scale - 1; y >= cy * scale; y--)
+                        {
+                            MX_BLOCK_T type = padded[MX_PADDED_INDEX(x, y, z)];
+                            if (type == MX_BLOCK_AIR) continue;
+                            if (top == MX_BLOCK_AIR) top = type;
+                            solid++;
+                        }
+                        if (top == MX_BLOCK_AIR) continue;
+
+                        int t = 0;
+                        while (t < top_types && tops[t] != top) t++;
+                        if (t == top_types)
+                        {
+                            tops[top_types] = top;
+                            top_counts[top_types++] = 0;
+                        }
+                        top_counts[t]++;
+                    }
+                }
+                if (solid * 2 < scale * scale * scale) continue;
+
+                int best = 0;
+                for (int t = 1; t < top_types; t++)
+                    if (top_counts[t] > top_counts[best]) best = t;
+                coarse[((cy + 1) * stride + (cz + 1)) * stride + (cx + 1)] = tops[best];
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Adds the mesh for the padded chunk to the end of the mesh. padded is either
+// the full chunk, for lod 0, or a copy made by mxMesherDownsample, whose
+// cells are meshed as blocks 1 << lod wide. face_textures is indexed by block
+// type and face. The mesh keeps its buffers between builds, so reusing one
+// mesh for many chunks avoids repeated allocation; set its vertex_count to 0
+// to start again. Returns false if out of memory.
+///////////////////////////////////////////////////////////////////////////////
+bool mxMesherBuild(const MX_BLOCK_T* padded, int lod, const MX_FACE_TEXTURES_T* face_textures, MX_MESH_T* mesh)
+{
+    int scale = 1 << lod;
+    int size = MX_CHUNK_SIZE >> lod;
+    int stride = size + 2;
+
+    // One entry per face in a slice; zero for no face, otherwise texture + 1
+    // in the low byte and the corner occlusion levels in the high byte.
+    unsigned short mask[MX_CHUNK_SIZE * MX_CHUNK_SIZE];
+    int quad_count = mesh->vertex_count / MX_MESH_QUAD_VERTICES;
+
+    for (int face = 0; face < MX_FACE_COUNT; face++)
+    {
+        const FACE_AXES_T* axes = &_face_axes[face];
+
+        // Offset from a block to the neighbour that would hide this face.
+        int step[3] = { 1, stride * stride, stride };
+        int neighbour = axes->n_sign * step[axes->n_axis];
+
+        // Offsets from the block in front of a face to the blocks beside each
+        // corner, which go (0, 0), (1, 0), (1, 1), (0, 1) in texture space.
+        int side_s[MX_MESH_QUAD_VERTICES];
+        int side_t[MX_MESH_QUAD_VERTICES];
+        for (int c = 0; c < MX_MESH_QUAD_VERTICES; c++)
+        {
+            int s = (c == 1 || c == 2) ? 1 : -1;
+            int t = (c >= 2) ? 1 : -1;
+            side_s[c] = s * axes->s_sign * step[axes->s_axis];
+            side_t[c] = t * axes->t_sign * step[axes->t_axis];
+        }
+
+        for (int slice = 0; slice < size; slice++)
+        {
+            // Find the visible faces in this slice.
+            bool any = false;
+            for (int j = 0; j < size; j++)
+            {
+                for (int i = 0; i < size; i++)
+                {
+                    int pos[3];
+                    pos[axes->n_axis] = slice;
+                    pos[axes->s_axis] = i;
+                    pos[axes->t_axis] = j;
+
+                    int index = ((pos[1] + 1) * stride + (pos[2] + 1)) * stride + (pos[0] + 1);
+                    MX_BLOCK_T type = padded[index];
+                    unsigned short m = 0;
+                    if (type != MX_BLOCK_AIR && padded[index + neighbour] == MX_BLOCK_AIR)
+                    {
+                        unsigned int ao = face_ao(padded, index + neighbour, side_s, side_t);
+                        m = (unsigned short) ((face_textures[type][face] + 1) | (ao << 8));
+                        any = true;
+                    }
+                    mask[j * size + i] = m;
+                }
+            }
+            if (!any) continue;
+
+            int plane = axes->n_sign > 0 ? slice + 1 : slice;
+
+            // Merge runs of matching faces into quads.
+            for (int j = 0; j < size; j++)
+            {
+                for (int i = 0; i < size;)
+                {
+                    unsigned short m = mask[j * size + i];
+                    if (m == 0)
+                    {
+                        i++;
+                        continue;
+                    }
+
+                    // Faces with unevenly lit corners can't be merged, as the
+                    // shading would be stretched across the whole quad.
+                    unsigned int ao = m >> 8;
+                    bool even = ao == 0x00 || ao == 0x55 || ao == 0xAA || ao == 0xFF;
+
+                    // Grow along s.
+                    int w = 1;
+                    while (even && i + w < size && mask[j * size + i + w] == m) w++;
+
+                    // Grow along t while the whole row matches.
+                    int h = 1;
+                    for (; even && j + h < size; h++)
+                    {
+                        const unsigned short* row = &mask[(j + h) * size + i];
+                        int k = 0;
+                        while (k < w && row[k] == m) k++;
+                        if (k < w) break;
+                    }
+
+                    // Clear the merged faces.
+                    for (int y = 0; y < h; y++)
+                        memset(&mask[(j + y) * size + i], 0, w * sizeof(mask[0]));
+
+                    if (!reserve(&mesh->vertices, &mesh->vertex_capacity, (quad_count + 1) * MX_MESH_QUAD_VERTICES))
+                        return false;
+                    emit_quad(&mesh->vertices[quad_count * MX_MESH_QUAD_VERTICES], face, plane * scale,
+                              i * scale, j * scale, (i + w) * scale, (j + h) * scale,
+                              (unsigned char) ((m & 0xFF) - 1), ao);
+                    quad_count++;
+                    i += w;
+                }
+            }
+        }
+    }
+
+    mesh->vertex_count = quad_count * MX_MESH_QUAD_VERTICES;
+
+#ifdef DEBUG_THIS
+    mxDebug("%d quads", quad_count);
+#endif
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the faces of the padded chunk that are joined by air inside it. The
+// border blocks are ignored.
+///////////////////////////////////////////////////////////////////////////////
+MX_CONNECTIVITY_T mxMesherConnectivity(const MX_BLOCK_T* padded)
+{
+    unsigned char seen[MX_CHUNK_VOLUME];
+    int stack[MX_CHUNK_VOLUME];
+    MX_CONNECTIVITY_T connectivity = 0;
+
+    memset(seen, 0, sizeof(seen));
+    for (int start = 0; start < MX_CHUNK_VOLUME && connectivity != MX_CONNECTIVITY_ALL; start++)
+    {
+        int sx = start & MX_CHUNK_MASK;
+        int sz = (start >> MX_CHUNK_BITS) & MX_CHUNK_MASK;
+        int sy = start >> (2 * MX_CHUNK_BITS);
+        if (seen[start] || padded[MX_PADDED_INDEX(sx, sy, sz)] != MX_BLOCK_AIR) continue;
+
+        // Fill this pocket of air, noting the faces it touches.
+        unsigned int faces = 0;
+        int top = 0;
+        seen[start] = 1;
+        stack[top++] = start;
+        while (top > 0)
+        {
+            int i = stack[--top];
+            int p[3] = { i & MX_CHUNK_MASK, i >> (2 * MX_CHUNK_BITS), (i >> MX_CHUNK_BITS) & MX_CHUNK_MASK };
+            if (p[0] == 0) faces |= 1u << MX_FACE_LEFT;
+            if (p[0] == MX_CHUNK_MASK) faces |= 1u << MX_FACE_RIGHT;
+            if (p[1] == 0) faces |= 1u << MX_FACE_BOTTOM;
+            if (p[1] == MX_CHUNK_MASK) faces |= 1u << MX_FACE_TOP;
+            if (p[2] == 0) faces |= 1u << MX_FACE_BACK;
+            if (p[2] == MX_CHUNK_MASK) faces |= 1u << MX_FACE_FRONT;
+
+            for (int face = 0; face < MX_FACE_COUNT; face++)
+            {
+                const FACE_AXES_T* axes = &_face_axes[face];
+                int q[3] = { p[0], p[1], p[2] };
+                q[axes->n_axis] += axes->n_sign;
+                if (q[axes->n_axis] < 0 || q[axes->n_axis] > MX_CHUNK_MASK) continue;
+
+                int j = MX_BLOCK_INDEX(q[0], q[1], q[2]);
+                if (seen[j] || padded[MX_PADDED_INDEX(q[0], q[1], q[2])] != MX_BLOCK_AIR) continue;
+                seen[j] = 1;
+                stack[top++] = j;
+            }
+        }
+
+        for (int a = 0; a < MX_FACE_COUNT; a++)
+            for (int b = 0; b < MX_FACE_COUNT; b++)
+                if ((faces >> a & 1) && (faces >> b & 1)) connectivity |= MX_CONNECTIVITY_BIT(a, b);
+    }
+    return connectivity;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the directions, as unit vectors along the x, y and z axes, in which
+// the face's texture coordinates s and t increase. Taking the dot product of
+// a vertex position with these gives its texture coordinates.
+///////////////////////////////////////////////////////////////////////////////
+void mxMesherTextureAxes(int face, float s[3], float t[3])
+{
+    const FACE_AXES_T* axes = &_face_axes[face];
+    for (int i = 0; i < 3; i++)
+    {
+        s[i] = i == axes->s_axis ? (float) axes->s_sign : 0.f;
+        t[i] = i == axes->t_axis ? (float) axes->t_sign : 0.f;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxMesherFree(MX_MESH_T* mesh)
+{
+    free(mesh->vertices);
+    memset(mesh, 0, sizeof(MX_MESH_T));
+}
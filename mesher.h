@@ -0,0 +1,80 @@
+#ifndef MX_MESHER_H
+#define MX_MESHER_H
+
+#include "world.h" // MX_BLOCK_T, MX_CHUNK_T, MX_CHUNK_SIZE
+
+#include <stdbool.h> // bool
+#include <stdint.h> // uint64_t
+
+// The mesher reads a copy of the chunk with a one block border taken from the
+// neighbouring chunks, so faces on chunk borders can be tested without any
+// further world lookups.
+#define MX_PADDED_SIZE   (MX_CHUNK_SIZE + 2)
+#define MX_PADDED_VOLUME (MX_PADDED_SIZE * MX_PADDED_SIZE * MX_PADDED_SIZE)
+#define MX_PADDED_INDEX(x, y, z) \
+        ((((y) + 1) * MX_PADDED_SIZE + ((z) + 1)) * MX_PADDED_SIZE + ((x) + 1))
+
+// Distant chunks are drawn from coarser copies of their blocks, where each
+// cell stands for 2, 4 or 8 blocks along each side. A copy at level lod is
+// MX_CHUNK_SIZE >> lod cells across, and is padded with a one cell border of
+// air like the full chunk, so that its outer faces are always kept.
+#define MX_LOD_COUNT     (4)
+#define MX_LOD_PADDED_SIZE(lod)   ((MX_CHUNK_SIZE >> (lod)) + 2)
+#define MX_LOD_PADDED_VOLUME(lod) \
+        (MX_LOD_PADDED_SIZE(lod) * MX_LOD_PADDED_SIZE(lod) * MX_LOD_PADDED_SIZE(lod))
+
+// Block faces.
+#define MX_FACE_FRONT   (0) // +z
+#define MX_FACE_BACK    (1) // -z
+#define MX_FACE_LEFT    (2) // -x
+#define MX_FACE_RIGHT   (3) // +x
+#define MX_FACE_TOP     (4) // +y
+#define MX_FACE_BOTTOM  (5) // -y
+#define MX_FACE_COUNT   (6)
+
+// Vertices are block corners relative to the chunk origin, packed into six
+// bytes. Texture coordinates aren't stored, as they are the position along
+// the face's texture axes (see mxMesherTextureAxes), and so repeat across
+// merged faces. The tile is the index of a texture in the atlas, and ao is
+// the ambient occlusion level at the corner, from 0 (darkest) to 3.
+typedef struct
+{
+    unsigned char x;
+    unsigned char y;
+    unsigned char z;
+    unsigned char tile;
+    unsigned char face;
+    unsigned char ao;
+} MX_MESH_VERTEX_T;
+
+// Each quad is four vertices going anticlockwise, and is drawn as the two
+// triangles (0, 1, 2) and (0, 2, 3) from a shared index buffer.
+#define MX_MESH_QUAD_VERTICES   (4)
+#define MX_MESH_QUAD_INDICES    (6)
+
+typedef struct
+{
+    MX_MESH_VERTEX_T* vertices;
+    int vertex_count;
+    int vertex_capacity;
+} MX_MESH_T;
+
+// The texture used for each face of each block type.
+typedef unsigned char MX_FACE_TEXTURES_T[MX_FACE_COUNT];
+
+// Which faces of a chunk are joined by air inside it, so that something seen
+// through one may be seen through the other. There is a bit for each pair of
+// faces, set both ways round.
+typedef uint64_t MX_CONNECTIVITY_T;
+#define MX_CONNECTIVITY_BIT(a, b) ((MX_CONNECTIVITY_T) 1 << ((a) * MX_FACE_COUNT + (b)))
+#define MX_CONNECTIVITY_ALL (MX_CONNECTIVITY_BIT(MX_FACE_COUNT - 1, MX_FACE_COUNT) - 1)
+#define MX_FACES_CONNECTED(set, a, b) (((set) & MX_CONNECTIVITY_BIT(a, b)) != 0)
+
+void mxMesherGather(const MX_CHUNK_T* chunk, MX_BLOCK_T* padded);
+void mxMesherDownsample(const MX_BLOCK_T* padded, int lod, MX_BLOCK_T* coarse);
+bool mxMesherBuild(const MX_BLOCK_T* padded, int lod, const MX_FACE_TEXTURES_T* face_textures, MX_MESH_T* mesh);
+MX_CONNECTIVITY_T mxMesherConnectivity(const MX_BLOCK_T* padded);
+void mxMesherTextureAxes(int face, float s[3], float t[3]);
+void mxMesherFree(MX_MESH_T* mesh);
+
+#endif /* MX_MESHER_H */
@@ -5,7 +5,12 @@
 #include "debug.h"
 #endif
 
+#include "mouse.h"
+
 #include <stdbool.h> // bool, true, false
+
+#ifdef HAVE_LIBGPM
+
 #include <sys/time.h> // FD_ZERO, FD_SET, FD_ISSET, select
 #include <gpm.h> // Gpm_GetEvent
 
@@ -40,6 +45,8 @@ bool mxMouseSetup()
 
 ///////////////////////////////////////////////////////////////////////////////
 // This function is called by the main event loop to fetch state of the mouse.
+// Movement is added to the deltas, and buttons that are pressed are added to
+// the buttons bits, so that a click between updates isn't missed.
 ///////////////////////////////////////////////////////////////////////////////
 void mxMouseUpdate(float *deltaX, float *deltaY, 
                    unsigned char *buttons, unsigned char *eventType)
@@ -72,7 +79,12 @@ void mxMouseUpdate(float *deltaX, float *deltaY,
                 
                 *deltaX += event.dx;
                 *deltaY += event.dy;
-                *buttons = event.buttons;
+                if (event.type & GPM_DOWN)
+                {
+                    if (event.buttons & GPM_B_LEFT) *buttons |= MOUSE_LEFT;
+                    if (event.buttons & GPM_B_RIGHT) *buttons |= MOUSE_RIGHT;
+                    if (event.buttons & GPM_B_MIDDLE) *buttons |= MOUSE_MIDDLE;
+                }
                 *eventType = event.type;
             }
         }
@@ -83,4 +95,27 @@ void mxMouseUpdate(float *deltaX, float *deltaY,
 void mxMouseCleanup()
 {
     Gpm_Close();
-}
\ No newline at end of file
+}
+
+#else
+
+///////////////////////////////////////////////////////////////////////////////
+// Without GPM there is no console mouse; only headless mode can be used.
+///////////////////////////////////////////////////////////////////////////////
+bool mxMouseSetup()
+{
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxMouseUpdate(float *deltaX, float *deltaY, 
+                   unsigned char *buttons, unsigned char *eventType)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxMouseCleanup()
+{
+}
+
+#endif /* HAVE_LIBGPM */
\ No newline at end of file
@@ -3,6 +3,11 @@
 
 #include <stdbool.h> // bool
 
+// buttons bits, for buttons pressed since the last update.
+#define MOUSE_LEFT              0x01
+#define MOUSE_RIGHT             0x02
+#define MOUSE_MIDDLE            0x04
+
 bool mxMouseSetup();
 void mxMouseUpdate(float* deltaX, float* deltaY, 
 				   unsigned char* buttons, unsigned char* eventType);
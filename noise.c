@@ -0,0 +1,123 @@
+///////////////////////////////////////////////////////////////////////////////
+// This file implements gradient noise, as described by Ken Perlin in
+// "Improving Noise" (SIGGRAPH 2002), with two changes that let the compiler
+// evaluate several samples at once with vector instructions.
+//
+// First, instead of looking the corners of each cell up in a permutation
+// table, which vector units can't do, the gradient at a corner is made from
+// the bits of an integer hash of its coordinates and the seed. Second, each
+// function takes arrays of positions, and the loop body is plain arithmetic
+// with no branches or table lookups, so the loop vectorises.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "noise.h"
+
+// Scale the results so that they reach roughly -1 and 1.
+#define SCALE_2D 1.4f
+#define SCALE_3D 1.1f
+
+///////////////////////////////////////////////////////////////////////////////
+static inline uint32_t hash(int32_t x, int32_t y, int32_t z, uint32_t seed)
+{
+    uint32_t h = seed ^ ((uint32_t) x * 0x8da6b343u) ^ ((uint32_t) y * 0xd8163841u) ^ ((uint32_t) z * 0xcb1ab31fu);
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    h *= 0x297a2d39u;
+    h ^= h >> 15;
+    return h;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Maps ten bits of the hash to a gradient component between -1 and 1.
+///////////////////////////////////////////////////////////////////////////////
+static inline float component(uint32_t h, int shift)
+{
+    return (float) (int32_t) ((h >> shift) & 1023u) * (2.f / 1023.f) - 1.f;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static inline float grad2(uint32_t h, float x, float y)
+{
+    return component(h, 0) * x + component(h, 10) * y;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static inline float grad3(uint32_t h, float x, float y, float z)
+{
+    return component(h, 0) * x + component(h, 10) * y + component(h, 20) * z;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Perlin's fade curve, 6t^5 - 15t^4 + 10t^3.
+///////////////////////////////////////////////////////////////////////////////
+static inline float fade(float t)
+{
+    return t * t * t * (t * (t * 6.f - 15.f) + 10.f);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static inline float lerp(float a, float b, float t)
+{
+    return a + t * (b - a);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Rounds down, without calling floorf, which doesn't vectorise everywhere.
+///////////////////////////////////////////////////////////////////////////////
+static inline int32_t floor_int(float x)
+{
+    int32_t i = (int32_t) x;
+    return i - (x < (float) i);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxNoise2(const float* x, const float* y, int count, uint32_t seed, float* restrict out)
+{
+    for (int i = 0; i < count; i++)
+    {
+        int32_t ix = floor_int(x[i]);
+        int32_t iy = floor_int(y[i]);
+        float fx = x[i] - (float) ix;
+        float fy = y[i] - (float) iy;
+
+        float n00 = grad2(hash(ix, iy, 0, seed), fx, fy);
+        float n10 = grad2(hash(ix + 1, iy, 0, seed), fx - 1.f, fy);
+        float n01 = grad2(hash(ix, iy + 1, 0, seed), fx, fy - 1.f);
+        float n11 = grad2(hash(ix + 1, iy + 1, 0, seed), fx - 1.f, fy - 1.f);
+
+        float u = fade(fx);
+        float v = fade(fy);
+        out[i] = lerp(lerp(n00, n10, u), lerp(n01, n11, u), v) * SCALE_2D;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxNoise3(const float* x, const float* y, const float* z, int count, uint32_t seed, float* restrict out)
+{
+    for (int i = 0; i < count; i++)
+    {
+        int32_t ix = floor_int(x[i]);
+        int32_t iy = floor_int(y[i]);
+        int32_t iz = floor_int(z[i]);
+        float fx = x[i] - (float) ix;
+        float fy = y[i] - (float) iy;
+        float fz = z[i] - (float) iz;
+
+        float n000 = grad3(hash(ix, iy, iz, seed), fx, fy, fz);
+        float n100 = grad3(hash(ix + 1, iy, iz, seed), fx - 1.f, fy, fz);
+        float n010 = grad3(hash(ix, iy + 1, iz, seed), fx, fy - 1.f, fz);
+        float n110 = grad3(hash(ix + 1, iy + 1, iz, seed), fx - 1.f, fy - 1.f, fz);
+        float n001 = grad3(hash(ix, iy, iz + 1, seed), fx, fy, fz - 1.f);
+        float n101 = grad3(hash(ix + 1, iy, iz + 1, seed), fx - 1.f, fy, fz - 1.f);
+        float n011 = grad3(hash(ix, iy + 1, iz + 1, seed), fx, fy - 1.f, fz - 1.f);
+        float n111 = grad3(hash(ix + 1, iy + 1, iz + 1, seed), fx - 1.f, fy - 1.f, fz - 1.f);
+
+        float u = fade(fx);
+        float v = fade(fy);
+        float w = fade(fz);
+        float a = lerp(lerp(n000, n100, u), lerp(n010, n110, u), v);
+        float b = lerp(lerp(n001, n101, u), lerp(n011, n111, u), v);
+        out[i] = lerp(a, b, w) * SCALE_3D;
+    }
+}
@@ -0,0 +1,12 @@
+#ifndef MX_NOISE_H
+#define MX_NOISE_H
+
+#include <stdint.h> // uint32_t
+
+// Gradient noise is evaluated for arrays of sample positions at once. The
+// results are roughly in the range -1 to 1, and are the same for the same
+// seed and position on any thread.
+void mxNoise2(const float* x, const float* y, int count, uint32_t seed, float* restrict out);
+void mxNoise3(const float* x, const float* y, const float* z, int count, uint32_t seed, float* restrict out);
+
+#endif /* MX_NOISE_H */
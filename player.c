@@ -1,19 +1,65 @@
+///////////////////////////////////////////////////////////////////////////////
+// This file moves the player. Walking players are boxes that fall, jump and
+// collide with solid blocks, while flying players go where they like.
+//
+// Movement is simulated in the fixed steps the game is updated in, so that
+// jumps and falls are the same at any frame rate. The camera is placed
+// between the last two steps according to how far the time has got towards
+// the next one, so that movement still looks smooth when steps and frames
+// don't line up. Looking around is applied every frame.
+//
+// Collisions are found by moving the player's box along each axis in turn,
+// stopping it at the first solid block in its way. Only the blocks that the
+// box sweeps through are looked at. Chunks that aren't loaded count as solid,
+// so the player waits for the ground to load rather than falling through it.
+///////////////////////////////////////////////////////////////////////////////
+
 #include "player.h"
 #include "keyboard.h"
 #include "gfx_engine.h"
+#include "world.h" // mxWorldGetChunk, MX_BLOCK_SIZE
 
+#include <stdlib.h> // NULL
 #include <math.h>
 
-#define MOUSE_LOOK_SPEED 0.075f
+#define MOUSE_LOOK_SPEED 1.25f // degrees per unit of mouse movement
 #define MOVEMENT_SPEED 0.075f
 #define TURN_SPEED 0.1f
 #define MAX_PITCH 89.99f
 #define MIN_PITCH -MAX_PITCH
+#define PICK_RANGE (8.f * MX_BLOCK_SIZE)
+
+// Start above the hills, looking down on them.
+#define START_HEIGHT 600.f
+#define START_PITCH -30.f
+
+// Walking player's box, in blocks. The eye is this far above the feet.
+#define HALF_WIDTH 0.3f
+#define HEIGHT 1.8f
+#define EYE_HEIGHT 1.62f
+
+// Speeds in blocks per second, and acceleration in blocks per second squared.
+// A jump is just high enough to get onto a block, and walking into a block
+// when on the ground steps up onto it.
+#define GRAVITY 32.f
+#define JUMP_SPEED 9.2f
+#define MAX_FALL_SPEED 60.f
+#define STEP_HEIGHT 1.f
+
+// Gap kept between the box and blocks it touches, in blocks, so that it isn't
+// found to be inside them due to rounding.
+#define SKIN 0.001f
 
 #ifndef M_PI
 #define M_PI 3.141592654
 #endif
 
+typedef struct
+{
+    float min[3];
+    float max[3];
+} BOX_T;
+
 static float _upX;
 static float _upY;
 static float _upZ;
@@ -23,12 +69,22 @@ static float _posZ;
 static float _pitch;
 static float _yaw;
 
+// Position before the last step, for placing the camera.
+static float _lastX;
+static float _lastY;
+static float _lastZ;
+
+static bool _flying;
+static bool _onGround;
+static float _fallSpeed;
+
 ///////////////////////////////////////////////////////////////////////////////
 bool mxPlayerSetup()
 {
     _upX = 0.f;
     _upY = 1.f;
     _upZ = 0.f;
+    _flying = false;
     mxPlayerMoveToStartPosition();
     return true;
 }
@@ -36,11 +92,29 @@ bool mxPlayerSetup()
 ///////////////////////////////////////////////////////////////////////////////
 void mxPlayerMoveToStartPosition()
 {
-    _posX = 0.f;
-    _posY = 0.f;
-    _posZ = -100.f;
-    _pitch = 0.f;
+    _posX = _lastX = 0.f;
+    _posY = _lastY = START_HEIGHT;
+    _posZ = _lastZ = -100.f;
+    _pitch = START_PITCH;
     _yaw = 90.f;
+    _onGround = false;
+    _fallSpeed = 0.f;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Switches between walking, with collisions, and flying through everything.
+///////////////////////////////////////////////////////////////////////////////
+void mxPlayerSetFlying(bool flying)
+{
+    _flying = flying;
+    _onGround = false;
+    _fallSpeed = 0.f;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool mxPlayerIsFlying()
+{
+    return _flying;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -95,52 +169,238 @@ static void move_sideways(float amount)
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-void mxPlayerUpdate(unsigned char moveKeys, 
-					float mouseDeltaX, float mouseDeltaY, 
-					float timeSinceLastUpdate)
+// Returns 1 to move forward, -1 to move back or 0 to stay put, whichever was
+// pressed last if both are held.
+///////////////////////////////////////////////////////////////////////////////
+static float forward_keys(unsigned char moveKeys)
 {
-    float moveAmount = MOVEMENT_SPEED * timeSinceLastUpdate;
-    float mouseMoveAmount = MOUSE_LOOK_SPEED * timeSinceLastUpdate;
-
-    // Move forward and backward.
     if (moveKeys & MOVE_FORWARD && moveKeys & MOVE_BACK)
+        return moveKeys & MOVE_FORWARD_OVER_BACK ? 1.f : -1.f;
+    if (moveKeys & MOVE_FORWARD) return 1.f;
+    if (moveKeys & MOVE_BACK) return -1.f;
+    return 0.f;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns 1 to move right, -1 to move left or 0 to stay put, whichever was
+// pressed last if both are held.
+///////////////////////////////////////////////////////////////////////////////
+static float sideways_keys(unsigned char moveKeys)
+{
+    if (moveKeys & MOVE_LEFT && moveKeys & MOVE_RIGHT)
+        return moveKeys & MOVE_LEFT_OVER_RIGHT ? -1.f : 1.f;
+    if (moveKeys & MOVE_LEFT) return -1.f;
+    if (moveKeys & MOVE_RIGHT) return 1.f;
+    return 0.f;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Moves a flying player for one step, straight through anything in the way.
+///////////////////////////////////////////////////////////////////////////////
+static void fly_step(unsigned char moveKeys, float millis)
+{
+    float moveAmount = MOVEMENT_SPEED * millis;
+    float forward = forward_keys(moveKeys);
+    float sideways = sideways_keys(moveKeys);
+    if (forward != 0.f) move_forward(forward * moveAmount);
+    if (sideways != 0.f) move_sideways(sideways * moveAmount);
+
+    // There's no MOVE_UP_OVER_DOWN due to not having available bits.
+    if (moveKeys & MOVE_UP) move(0, moveAmount, 0);
+    else if (moveKeys & MOVE_DOWN) move(0, -moveAmount, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns true if the block is solid, or isn't loaded yet.
+///////////////////////////////////////////////////////////////////////////////
+static bool solid_at(const int* block)
+{
+    MX_CHUNK_T* chunk = mxWorldGetChunk(block[0] >> MX_CHUNK_BITS,
+                                        block[1] >> MX_CHUNK_BITS,
+                                        block[2] >> MX_CHUNK_BITS);
+    if (chunk == NULL) return true;
+    return chunk->blocks[MX_BLOCK_INDEX(block[0] & MX_CHUNK_MASK,
+                                        block[1] & MX_CHUNK_MASK,
+                                        block[2] & MX_CHUNK_MASK)] != MX_BLOCK_AIR;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns true if any solid block is in the layer of blocks at the given
+// coordinate along the axis, across the extent of the box on the others.
+///////////////////////////////////////////////////////////////////////////////
+static bool layer_solid(const BOX_T* box, int axis, int layer)
+{
+    int a1 = (axis + 1) % 3;
+    int a2 = (axis + 2) % 3;
+    int block[3];
+    block[axis] = layer;
+    for (block[a1] = (int) floorf(box->min[a1]); block[a1] <= (int) floorf(box->max[a1]); block[a1]++)
+        for (block[a2] = (int) floorf(box->min[a2]); block[a2] <= (int) floorf(box->max[a2]); block[a2]++)
+            if (solid_at(block)) return true;
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Moves the box by up to delta blocks along the axis, stopping short of the
+// first solid block in the way, and returns how far it moved. Blocks the box
+// is already inside don't stop it, so it can always get out of them.
+///////////////////////////////////////////////////////////////////////////////
+static float move_box(BOX_T* box, int axis, float delta)
+{
+    if (delta > 0.f)
     {
-        if (moveKeys & MOVE_FORWARD_OVER_BACK) move_forward(moveAmount);
-        else move_forward(-moveAmount);
+        int last = (int) floorf(box->max[axis] + delta);
+        for (int layer = (int) floorf(box->max[axis]) + 1; layer <= last; layer++)
+        {
+            if (!layer_solid(box, axis, layer)) continue;
+            delta = fmaxf(0.f, layer - SKIN - box->max[axis]);
+            break;
+        }
     }
-    else if (moveKeys & MOVE_FORWARD) move_forward(moveAmount);
-    else if (moveKeys & MOVE_BACK) move_forward(-moveAmount);
+    else if (delta < 0.f)
+    {
+        int last = (int) floorf(box->min[axis] + delta);
+        for (int layer = (int) floorf(box->min[axis]) - 1; layer >= last; layer--)
+        {
+            if (!layer_solid(box, axis, layer)) continue;
+            delta = fminf(0.f, layer + 1 + SKIN - box->min[axis]);
+            break;
+        }
+    }
+    box->min[axis] += delta;
+    box->max[axis] += delta;
+    return delta;
+}
 
-    // Move left and right.
-    if (moveKeys & MOVE_LEFT && moveKeys & MOVE_RIGHT)
+///////////////////////////////////////////////////////////////////////////////
+// Moves a walking player for one step, falling, jumping and stepping up onto
+// blocks in the way, without going into any solid block.
+///////////////////////////////////////////////////////////////////////////////
+static void walk_step(unsigned char moveKeys, float millis)
+{
+    float seconds = millis / 1000.f;
+    float distance = MOVEMENT_SPEED * millis / MX_BLOCK_SIZE;
+    float forward = forward_keys(moveKeys) * distance;
+    float sideways = sideways_keys(moveKeys) * distance;
+    float yaw = degrees_to_radians(_yaw);
+    float side = degrees_to_radians(normal_yaw(_yaw + 90));
+    float dx = cosf(yaw) * forward + cosf(side) * sideways;
+    float dz = sinf(yaw) * forward + sinf(side) * sideways;
+
+    if (moveKeys & MOVE_UP && _onGround) _fallSpeed = -JUMP_SPEED;
+    _fallSpeed = fminf(_fallSpeed + GRAVITY * seconds, MAX_FALL_SPEED);
+    float dy = -_fallSpeed * seconds;
+
+    // The box in blocks, which have their corners on whole numbers.
+    float x = _posX / MX_BLOCK_SIZE + 0.5f;
+    float y = _posY / MX_BLOCK_SIZE + 0.5f - EYE_HEIGHT;
+    float z = _posZ / MX_BLOCK_SIZE + 0.5f;
+    const BOX_T start = {
+        { x - HALF_WIDTH, y, z - HALF_WIDTH },
+        { x + HALF_WIDTH, y + HEIGHT, z + HALF_WIDTH }
+    };
+    BOX_T box = start;
+
+    // Falls and jumps first, so that a player on the ground slides along it.
+    float moved = move_box(&box, 1, dy);
+    if (moved != dy) _fallSpeed = 0.f;
+    _onGround = dy < 0.f && moved > dy;
+
+    BOX_T level = box;
+    float moved_x = move_box(&box, 0, dx);
+    float moved_z = move_box(&box, 2, dz);
+
+    // When walking into something, try going over it instead, and do that if
+    // it gets further.
+    if (_onGround && (moved_x != dx || moved_z != dz))
     {
-        if (moveKeys & MOVE_LEFT_OVER_RIGHT) move_sideways(-moveAmount);
-        else move_sideways(moveAmount);
+        BOX_T stepped = level;
+        float up = move_box(&stepped, 1, STEP_HEIGHT);
+        float stepped_x = move_box(&stepped, 0, dx);
+        float stepped_z = move_box(&stepped, 2, dz);
+        move_box(&stepped, 1, -up);
+        if (stepped_x * stepped_x + stepped_z * stepped_z > moved_x * moved_x + moved_z * moved_z)
+            box = stepped;
     }
-    else if (moveKeys & MOVE_LEFT) move_sideways(-moveAmount);
-    else if (moveKeys & MOVE_RIGHT) move_sideways(moveAmount);
-    
-    // Move up and down.
-    // TODO: This control is for testing purposes only.
-    // NOTE: There's no MOVE_UP_OVER_DOWN due to not having available bits, and this will be removed later anyway.
-    if (moveKeys & MOVE_UP) move(0, moveAmount, 0);
-    else if (moveKeys & MOVE_DOWN) move(0, -moveAmount, 0);
 
-    // Mouse control.
-    _yaw = normal_yaw(_yaw + (mouseDeltaX * mouseMoveAmount));
-    _pitch = limit_pitch(_pitch + (mouseDeltaY * -mouseMoveAmount));
+    move((box.min[0] - start.min[0]) * MX_BLOCK_SIZE,
+         (box.min[1] - start.min[1]) * MX_BLOCK_SIZE,
+         (box.min[2] - start.min[2]) * MX_BLOCK_SIZE);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Turns the player by the mouse movement since the last frame.
+///////////////////////////////////////////////////////////////////////////////
+void mxPlayerLook(float mouseDeltaX, float mouseDeltaY)
+{
+    _yaw = normal_yaw(_yaw + (mouseDeltaX * MOUSE_LOOK_SPEED));
+    _pitch = limit_pitch(_pitch + (mouseDeltaY * -MOUSE_LOOK_SPEED));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Moves the player for one update of the given length, which should always
+// be the same.
+///////////////////////////////////////////////////////////////////////////////
+void mxPlayerUpdate(unsigned char moveKeys, float millis)
+{
+    _lastX = _posX;
+    _lastY = _posY;
+    _lastZ = _posZ;
+    if (_flying) fly_step(moveKeys, millis);
+    else walk_step(moveKeys, millis);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Places the camera at the player's eye, the given fraction of the way from
+// where it was before the last update to where it is now.
+///////////////////////////////////////////////////////////////////////////////
+void mxPlayerPlaceCamera(float t)
+{
+    float eyeX = _lastX + (_posX - _lastX) * t;
+    float eyeY = _lastY + (_posY - _lastY) * t;
+    float eyeZ = _lastZ + (_posZ - _lastZ) * t;
 
     // Calculate view target based on new position.
-    float viewTargetX = _posX + cos(degrees_to_radians(_yaw));
-    float viewTargetY = _posY + tan(degrees_to_radians(_pitch));
-    float viewTargetZ = _posZ + sin(degrees_to_radians(_yaw));
+    float viewTargetX = eyeX + cos(degrees_to_radians(_yaw));
+    float viewTargetY = eyeY + tan(degrees_to_radians(_pitch));
+    float viewTargetZ = eyeZ + sin(degrees_to_radians(_yaw));
 
     // Update view position.
-    mxGraphicsLookAt(_posX, _posY, _posZ, viewTargetX, viewTargetY, viewTargetZ);
+    mxGraphicsLookAt(eyeX, eyeY, eyeZ, viewTargetX, viewTargetY, viewTargetZ);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the player's eye position, in world units, as of the last step.
+///////////////////////////////////////////////////////////////////////////////
+void mxPlayerGetPosition(float* x, float* y, float* z)
+{
+    *x = _posX;
+    *y = _posY;
+    *z = _posZ;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the unit vector the player is looking along.
+///////////////////////////////////////////////////////////////////////////////
+void mxPlayerGetDirection(float* x, float* y, float* z)
+{
+    float cosPitch = cos(degrees_to_radians(_pitch));
+    *x = cos(degrees_to_radians(_yaw)) * cosPitch;
+    *y = sin(degrees_to_radians(_pitch));
+    *z = sin(degrees_to_radians(_yaw)) * cosPitch;
 }
-X, _upY, _upZ);
+
+///////////////////////////////////////////////////////////////////////////////
+// Finds the block the player is looking at, if there is one within reach.
+///////////////////////////////////////////////////////////////////////////////
+bool mxPlayerPick(MX_RAYCAST_HIT_T* hit)
+{
+    float dx, dy, dz;
+    mxPlayerGetDirection(&dx, &dy, &dz);
+    return mxRaycast(_posX, _posY, _posZ, dx, dy, dz, PICK_RANGE, hit);
 }
-//////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
 void mxPlayerCleanup()
 {
     // Nothing to do currently.
@@ -1,11 +1,20 @@
 #ifndef MX_PLAYER_H
 #define MX_PLAYER_H
 
+#include "raycast.h" // MX_RAYCAST_HIT_T
+
 #include <stdbool.h> // bool
 
 bool mxPlayerSetup();
 void mxPlayerMoveToStartPosition();
-void mxPlayerUpdate(unsigned char moveKeys, float mouseDeltaX, float mouseDeltaY, float timeSinceLastUpdate);
+void mxPlayerSetFlying(bool flying);
+bool mxPlayerIsFlying();
+void mxPlayerLook(float mouseDeltaX, float mouseDeltaY);
+void mxPlayerUpdate(unsigned char moveKeys, float millis);
+void mxPlayerPlaceCamera(float t);
+void mxPlayerGetPosition(float* x, float* y, float* z);
+void mxPlayerGetDirection(float* x, float* y, float* z);
+bool mxPlayerPick(MX_RAYCAST_HIT_T* hit);
+void mxPlayerCleanup();
 
 #endif /* MX_PLAYER_H */
-AYER_H */
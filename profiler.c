@@ -0,0 +1,229 @@
+///////////////////////////////////////////////////////////////////////////////
+// This file collects timings for the stages of each frame. The latest samples
+// for each stage are kept in a ring buffer, so that the report can show the
+// spread of frame times and not just the average: a single long frame is
+// noticed by the player, but disappears in an FPS count.
+//
+// Adding a sample takes one atomic increment and a store, with no locks, so
+// samples can be added from any thread. A report taken while samples are
+// being added may include a slot that is about to be overwritten, which
+// doesn't matter for statistics over thousands of samples.
+//
+// Counts, such as the number of chunks drawn, are kept and reported in the
+// same way, which shows how they vary from frame to frame.
+///////////////////////////////////////////////////////////////////////////////
+
+#define _POSIX_C_SOURCE 199309L
+
+// Enable or disable debugging in this file.
+//#define DEBUG_THIS
+
+#ifdef DEBUG_THIS
+#include "debug.h"
+#endif
+
+#include "profiler.h"
+
+#include <stdlib.h> // qsort
+#include <string.h> // strcmp, memset
+#include <time.h> // clock_gettime, CLOCK_MONOTONIC
+
+#define SAMPLES_MASK (MX_PROFILE_SAMPLES - 1)
+
+typedef struct
+{
+    // Total number of samples ever added; the next is written at head & mask.
+    uint32_t head;
+
+    // Nanoseconds, limited to about four seconds, or counts.
+    uint32_t samples[MX_PROFILE_SAMPLES];
+} MX_PROFILE_RING_T;
+
+typedef struct
+{
+    const char* name;
+
+    // Units of the report, and what a sample is multiplied by to get them.
+    const char* unit;
+    double scale;
+} MX_PROFILE_STAGE_T;
+
+static const MX_PROFILE_STAGE_T _stages[MX_PROFILE_STAGE_COUNT] = {
+    { "input",  "ms", 1e-6 },
+    { "player", "ms", 1e-6 },
+    { "paint",  "ms", 1e-6 },
+    { "swap",   "ms", 1e-6 },
+    { "frame",  "ms", 1e-6 },
+    { "drawn",  "chunks", 1.0 },
+    { "culled", "chunks", 1.0 },
+    { "resident", "chunks", 1.0 },
+    { "memory", "KB", 1.0 },
+    { "load",   "ms", 1e-6 },
+    { "edit",   "ms", 1e-6 },
+    { "missed", "frames", 1.0 },
+    { "latency", "ms", 1e-6 },
+    { "draws",  "calls", 1.0 },
+    { "triangles", "tris", 1.0 },
+    { "gpu",    "ms", 1e-6 },
+    { "vertices", "verts", 1.0 },
+    { "binds",  "binds", 1.0 },
+    { "uploads", "bytes", 1.0 },
+    { "states", "calls", 1.0 },
+    { "redundant", "calls", 1.0 },
+    { "hidden", "chunks", 1.0 },
+    { "coarse", "chunks", 1.0 }
+};
+
+static MX_PROFILE_RING_T _rings[MX_PROFILE_STAGE_COUNT];
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the time from a monotonic clock in nanoseconds.
+///////////////////////////////////////////////////////////////////////////////
+uint64_t mxProfileNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxProfileCount(int stage, uint32_t count)
+{
+    MX_PROFILE_RING_T* ring = &_rings[stage];
+    uint32_t index = __atomic_fetch_add(&ring->head, 1, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&ring->samples[index & SAMPLES_MASK], count, __ATOMIC_RELAXED);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxProfileAdd(int stage, uint64_t nanoseconds)
+{
+    mxProfileCount(stage, nanoseconds > UINT32_MAX ? UINT32_MAX : (uint32_t) nanoseconds);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the latest sample for the stage, in milliseconds for times, or 0 if
+// there is none.
+///////////////////////////////////////////////////////////////////////////////
+double mxProfileLast(int stage)
+{
+    const MX_PROFILE_RING_T* ring = &_rings[stage];
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (head == 0) return 0.0;
+    uint32_t sample = __atomic_load_n(&ring->samples[(head - 1) & SAMPLES_MASK], __ATOMIC_RELAXED);
+    return sample * _stages[stage].scale;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static int compare_samples(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*) a;
+    uint32_t y = *(const uint32_t*) b;
+    return (x > y) - (x < y);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Percentiles use the nearest rank method on the sorted samples.
+///////////////////////////////////////////////////////////////////////////////
+static double percentile(const uint32_t* sorted, int count, int p, double scale)
+{
+    int rank = (p * count + 99) / 100;
+    if (rank < 1) rank = 1;
+    return sorted[rank - 1] * scale;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Summarises the samples currently held for the stage.
+///////////////////////////////////////////////////////////////////////////////
+void mxProfileStats(int stage, MX_PROFILE_STATS_T* stats)
+{
+    static uint32_t sorted[MX_PROFILE_SAMPLES];
+    const MX_PROFILE_RING_T* ring = &_rings[stage];
+
+    double scale = _stages[stage].scale;
+
+    memset(stats, 0, sizeof(MX_PROFILE_STATS_T));
+    stats->name = _stages[stage].name;
+    stats->unit = _stages[stage].unit;
+
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    int count = head < MX_PROFILE_SAMPLES ? (int) head : MX_PROFILE_SAMPLES;
+    if (count == 0) return;
+
+    double total = 0.0;
+    for (int i = 0; i < count; i++)
+    {
+        sorted[i] = __atomic_load_n(&ring->samples[(head - count + i) & SAMPLES_MASK], __ATOMIC_RELAXED);
+        total += sorted[i];
+    }
+    qsort(sorted, count, sizeof(uint32_t), compare_samples);
+
+    stats->count = count;
+    stats->min = sorted[0] * scale;
+    stats->avg = total / count * scale;
+    stats->p50 = percentile(sorted, count, 50, scale);
+    stats->p95 = percentile(sorted, count, 95, scale);
+    stats->p99 = percentile(sorted, count, 99, scale);
+    stats->max = sorted[count - 1] * scale;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes the statistics for every stage that has samples.
+///////////////////////////////////////////////////////////////////////////////
+void mxProfileReport(FILE* f, int format)
+{
+    static const char* const text_row = "%-9s %-6s %7d %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n";
+    static const char* const csv_row = "%s,%s,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n";
+    static const char* const json_row =
+        "%s\n    \"%s\": { \"unit\": \"%s\", \"count\": %d, \"min\": %.4f, \"avg\": %.4f, "
+        "\"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }";
+
+    if (format == MX_PROFILE_TEXT)
+        fprintf(f, "%-9s %-6s %7s %9s %9s %9s %9s %9s %9s\n",
+                "stage", "unit", "count", "min", "avg", "p50", "p95", "p99", "max");
+    else if (format == MX_PROFILE_CSV)
+        fprintf(f, "stage,unit,count,min,avg,p50,p95,p99,max\n");
+    else
+        fprintf(f, "{");
+
+    const char* separator = "";
+    for (int stage = 0; stage < MX_PROFILE_STAGE_COUNT; stage++)
+    {
+        MX_PROFILE_STATS_T s;
+        mxProfileStats(stage, &s);
+        if (s.count == 0) continue;
+
+        if (format == MX_PROFILE_JSON)
+        {
+            fprintf(f, json_row, separator, s.name, s.unit, s.count, s.min, s.avg, s.p50, s.p95, s.p99, s.max);
+            separator = ",";
+        }
+        else
+        {
+            fprintf(f, format == MX_PROFILE_CSV ? csv_row : text_row,
+                    s.name, s.unit, s.count, s.min, s.avg, s.p50, s.p95, s.p99, s.max);
+        }
+    }
+
+    if (format == MX_PROFILE_JSON) fprintf(f, "\n}\n");
+    fflush(f);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Throws away every sample, so that the next report only covers what happens
+// from now on. Samples must not be being added at the same time.
+///////////////////////////////////////////////////////////////////////////////
+void mxProfileReset()
+{
+    memset(_rings, 0, sizeof(_rings));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the report format with the given name, or -1 if there's none.
+///////////////////////////////////////////////////////////////////////////////
+int mxProfileFormat(const char* name)
+{
+    if (strcmp(name, "text") == 0) return MX_PROFILE_TEXT;
+    if (strcmp(name, "csv") == 0) return MX_PROFILE_CSV;
+    if (strcmp(name, "json") == 0) return MX_PROFILE_JSON;
+    return -1;
+}
@@ -0,0 +1,103 @@
+#ifndef MX_PROFILER_H
+#define MX_PROFILER_H
+
+#include <stdio.h> // FILE
+#include <stdint.h> // uint64_t
+
+// Stages of a frame that are timed.
+#define MX_PROFILE_INPUT            (0)
+#define MX_PROFILE_PLAYER           (1)
+#define MX_PROFILE_PAINT            (2)
+#define MX_PROFILE_SWAP             (3)
+#define MX_PROFILE_FRAME            (4)
+
+// Per frame counts, which are reported in the same way as times.
+#define MX_PROFILE_CHUNKS_DRAWN     (5)
+#define MX_PROFILE_CHUNKS_CULLED    (6)
+#define MX_PROFILE_CHUNKS_RESIDENT  (7)
+#define MX_PROFILE_RESIDENT_KB      (8)
+
+// Time from a chunk being requested until it is in the world, per chunk.
+#define MX_PROFILE_CHUNK_LOAD       (9)
+
+// Time from a chunk being edited until its new mesh is uploaded, per chunk.
+#define MX_PROFILE_CHUNK_EDIT       (10)
+
+// Display frames missed before each frame was shown.
+#define MX_PROFILE_FRAMES_MISSED    (11)
+
+// Time from the latest input event read in a frame until the frame is shown.
+#define MX_PROFILE_INPUT_LATENCY    (12)
+
+// Draw calls made and triangles drawn each frame.
+#define MX_PROFILE_DRAW_CALLS       (13)
+#define MX_PROFILE_TRIANGLES        (14)
+
+// Time waiting for the GPU to finish drawing a frame, where it is measured.
+#define MX_PROFILE_GPU              (15)
+
+// GL work each frame, counted by gl_state.c: vertices drawn, textures bound,
+// bytes of buffer data uploaded, and state changes made and skipped.
+#define MX_PROFILE_VERTICES         (16)
+#define MX_PROFILE_TEXTURE_BINDS    (17)
+#define MX_PROFILE_UPLOAD_BYTES     (18)
+#define MX_PROFILE_STATE_CHANGES    (19)
+#define MX_PROFILE_REDUNDANT_STATE  (20)
+
+// Chunks in the frustum that weren't drawn as they're hidden behind rock.
+#define MX_PROFILE_CHUNKS_HIDDEN    (21)
+
+// Chunks drawn at a coarser level of detail than their blocks.
+#define MX_PROFILE_CHUNKS_COARSE    (22)
+
+#define MX_PROFILE_STAGE_COUNT      (23)
+
+// Report formats.
+#define MX_PROFILE_TEXT (0)
+#define MX_PROFILE_CSV  (1)
+#define MX_PROFILE_JSON (2)
+
+// Number of samples kept for each stage. Must be a power of two.
+#define MX_PROFILE_SAMPLES (4096)
+
+// Times the statement or block that follows it and adds the time taken to
+// the given stage, for example:
+//
+//     MX_PROFILE(MX_PROFILE_PAINT) mxGraphicsPaint();
+//
+// The macro is a for loop, so break and continue inside the block only leave
+// the macro's own loop, not any loop around it, and the sample is lost. Set a
+// flag instead and test it after the block. Leaving with return or goto also
+// loses the sample. Define MX_NO_PROFILE to compile the timers out.
+#ifndef MX_NO_PROFILE
+#define MX_PROFILE(stage) \
+        for (uint64_t _mx_t0 = mxProfileNow(), _mx_once = 1; _mx_once; \
+             _mx_once = 0, mxProfileAdd((stage), mxProfileNow() - _mx_t0))
+#else
+#define MX_PROFILE(stage)
+#endif
+
+// Summary of the samples held for a stage, in milliseconds for times.
+typedef struct
+{
+    const char* name;
+    const char* unit;
+    int count;
+    double min;
+    double avg;
+    double p50;
+    double p95;
+    double p99;
+    double max;
+} MX_PROFILE_STATS_T;
+
+uint64_t mxProfileNow();
+void mxProfileAdd(int stage, uint64_t nanoseconds);
+void mxProfileCount(int stage, uint32_t count);
+double mxProfileLast(int stage);
+void mxProfileStats(int stage, MX_PROFILE_STATS_T* stats);
+void mxProfileReport(FILE* f, int format);
+void mxProfileReset();
+int mxProfileFormat(const char* name);
+
+#endif /* MX_PROFILER_H */
@@ -0,0 +1,146 @@
+///////////////////////////////////////////////////////////////////////////////
+// This file finds the first solid block along a ray, such as the one the
+// player is looking at. The ray is followed through the grid one block at a
+// time, using the method described in "A Fast Voxel Traversal Algorithm for
+// Ray Tracing" by Amanatides and Woo:
+// http://www.cse.yorku.ca/~amana/research/grid.pdf
+//
+// Each step only compares the distances to the next block boundary on each
+// axis and adds to one of them, and the chunk is only looked up again when
+// the ray crosses into another, so long rays and many rays a frame are cheap.
+// Chunks that aren't loaded are treated as empty. Like the rest of the world,
+// this must only be used from the main thread.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "raycast.h"
+
+#include <stdlib.h> // NULL
+#include <math.h> // floorf, sqrtf, INFINITY
+
+// The face a ray goes in through when stepping along each axis, for a
+// positive then a negative step.
+static const int _entry_faces[3][2] = {
+    { MX_FACE_LEFT, MX_FACE_RIGHT },
+    { MX_FACE_BOTTOM, MX_FACE_TOP },
+    { MX_FACE_BACK, MX_FACE_FRONT },
+};
+
+// The direction each face points in.
+static const int _face_normals[MX_FACE_COUNT][3] = {
+    {  0,  0,  1 }, // Front
+    {  0,  0, -1 }, // Back
+    { -1,  0,  0 }, // Left
+    {  1,  0,  0 }, // Right
+    {  0,  1,  0 }, // Top
+    {  0, -1,  0 }, // Bottom
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Follows the ray from the given position, in world units, along the given
+// direction, which needn't be a unit vector, for up to max_distance units.
+// Returns true and fills in hit if it reaches a solid block, otherwise false.
+///////////////////////////////////////////////////////////////////////////////
+bool mxRaycast(float x, float y, float z, float dx, float dy, float dz,
+               float max_distance, MX_RAYCAST_HIT_T* hit)
+{
+    float length = sqrtf(dx * dx + dy * dy + dz * dz);
+    if (length == 0.f) return false;
+
+    // Work in blocks, with block corners on whole numbers, since blocks are
+    // centred on their coordinates.
+    const float origin[3] = {
+        x / MX_BLOCK_SIZE + 0.5f,
+        y / MX_BLOCK_SIZE + 0.5f,
+        z / MX_BLOCK_SIZE + 0.5f
+    };
+    const float direction[3] = { dx / length, dy / length, dz / length };
+    float max_t = max_distance / MX_BLOCK_SIZE;
+
+    // For each axis, the distance along the ray to the next block boundary,
+    // and between boundaries.
+    int block[3];
+    int step[3];
+    float t_next[3];
+    float t_delta[3];
+    for (int i = 0; i < 3; i++)
+    {
+        block[i] = (int) floorf(origin[i]);
+        if (direction[i] > 0.f)
+        {
+            step[i] = 1;
+            t_delta[i] = 1.f / direction[i];
+            t_next[i] = (block[i] + 1 - origin[i]) * t_delta[i];
+        }
+        else if (direction[i] < 0.f)
+        {
+            step[i] = -1;
+            t_delta[i] = -1.f / direction[i];
+            t_next[i] = (origin[i] - block[i]) * t_delta[i];
+        }
+        else
+        {
+            step[i] = 0;
+            t_delta[i] = t_next[i] = INFINITY;
+        }
+    }
+
+    const MX_CHUNK_T* chunk = mxWorldGetChunk(block[0] >> MX_CHUNK_BITS,
+                                              block[1] >> MX_CHUNK_BITS,
+                                              block[2] >> MX_CHUNK_BITS);
+    int face = -1;
+    float t = 0.f;
+    for (;;)
+    {
+        if (chunk != NULL)
+        {
+            MX_BLOCK_T type = chunk->blocks[MX_BLOCK_INDEX(block[0] & MX_CHUNK_MASK,
+                                                           block[1] & MX_CHUNK_MASK,
+                                                           block[2] & MX_CHUNK_MASK)];
+            if (type != MX_BLOCK_AIR)
+            {
+                hit->x = block[0];
+                hit->y = block[1];
+                hit->z = block[2];
+                hit->face = face;
+                hit->distance = t * MX_BLOCK_SIZE;
+                hit->type = type;
+                return true;
+            }
+        }
+
+        // Step into the next block along whichever axis has the nearest
+        // boundary.
+        int axis = t_next[0] < t_next[1] ? (t_next[0] < t_next[2] ? 0 : 2)
+                                         : (t_next[1] < t_next[2] ? 1 : 2);
+        t = t_next[axis];
+        if (t > max_t) return false;
+        t_next[axis] += t_delta[axis];
+        face = _entry_faces[axis][step[axis] < 0];
+
+        int before = block[axis] >> MX_CHUNK_BITS;
+        block[axis] += step[axis];
+        if ((block[axis] >> MX_CHUNK_BITS) != before)
+        {
+            chunk = mxWorldGetChunk(block[0] >> MX_CHUNK_BITS,
+                                    block[1] >> MX_CHUNK_BITS,
+                                    block[2] >> MX_CHUNK_BITS);
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the direction the given face points in, which is where a block
+// placed against it goes relative to the block it's on. Faces that are out of
+// range, such as the -1 of a ray that starts in a block, point nowhere.
+///////////////////////////////////////////////////////////////////////////////
+void mxRaycastFaceNormal(int face, int* nx, int* ny, int* nz)
+{
+    if (face < 0 || face >= MX_FACE_COUNT)
+    {
+        *nx = *ny = *nz = 0;
+        return;
+    }
+    *nx = _face_normals[face][0];
+    *ny = _face_normals[face][1];
+    *nz = _face_normals[face][2];
+}
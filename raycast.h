@@ -0,0 +1,27 @@
+#ifndef MX_RAYCAST_H
+#define MX_RAYCAST_H
+
+#include "world.h" // MX_BLOCK_T
+#include "mesher.h" // MX_FACE_FRONT, etc.
+
+#include <stdbool.h> // bool
+
+// The first solid block along a ray. face is the face of the block that the
+// ray went in through, so a block placed against it goes at the block next
+// to that face, or -1 if the ray started inside the block. distance is from
+// the start of the ray to where it went into the block, in world units.
+typedef struct
+{
+    int x;
+    int y;
+    int z;
+    int face;
+    float distance;
+    MX_BLOCK_T type;
+} MX_RAYCAST_HIT_T;
+
+bool mxRaycast(float x, float y, float z, float dx, float dy, float dz,
+               float max_distance, MX_RAYCAST_HIT_T* hit);
+void mxRaycastFaceNormal(int face, int* nx, int* ny, int* nz);
+
+#endif /* MX_RAYCAST_H */
@@ -0,0 +1,182 @@
+///////////////////////////////////////////////////////////////////////////////
+// This file records the input of every frame to a file, and plays it back in
+// place of the keyboard and mouse, so that the same flythrough can be timed
+// on different builds. A recording is a short header followed by 16 bytes a
+// frame: the length of the frame in microseconds, the movement keys, special
+// keys and mouse buttons, and the mouse movement. Like region files, it uses
+// the byte order of the machine.
+//
+// Playing back uses the recorded frame lengths rather than the clock, so the
+// game makes the same updates on every frame however long frames take to
+// draw, and each frame shows the same thing as when it was recorded.
+///////////////////////////////////////////////////////////////////////////////
+
+// Enable or disable debugging in this file.
+#define DEBUG_THIS
+
+#ifdef DEBUG_THIS
+#include "debug.h"
+#endif
+
+#include "record.h"
+
+#include <stdio.h> // fopen, fwrite, fread, fseek, ftell
+#include <stdlib.h> // malloc, free
+#include <string.h> // memcmp, memcpy
+#include <stdint.h> // uint32_t, uint8_t
+
+#define RECORD_MAGIC "MXIN"
+#define RECORD_VERSION 1u
+
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+} RECORD_HEADER_T;
+
+typedef struct
+{
+    uint32_t micros;
+    uint8_t moveKeys;
+    uint8_t specialKeys;
+    uint8_t buttons;
+    uint8_t unused;
+    float mouseDeltaX;
+    float mouseDeltaY;
+} RECORD_FRAME_T;
+
+// The file being recorded to.
+static FILE* _record;
+
+// The recording being played back, read in full when it's opened.
+static RECORD_FRAME_T* _frames;
+static int _frames_count;
+static int _frame;
+
+///////////////////////////////////////////////////////////////////////////////
+// Starts recording to the given file, replacing anything already in it.
+///////////////////////////////////////////////////////////////////////////////
+bool mxRecordSetup(const char* filename)
+{
+    _record = fopen(filename, "wb");
+    if (_record == NULL) return false;
+
+    RECORD_HEADER_T header;
+    memcpy(header.magic, RECORD_MAGIC, sizeof(header.magic));
+    header.version = RECORD_VERSION;
+    if (fwrite(&header, sizeof(header), 1, _record) != 1)
+    {
+        mxRecordCleanup();
+        return false;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Adds a frame to the recording, if there is one. Writes are buffered, so
+// this doesn't usually touch the disk.
+///////////////////////////////////////////////////////////////////////////////
+void mxRecordFrame(const MX_RECORD_FRAME_T* frame)
+{
+    if (_record == NULL) return;
+
+    RECORD_FRAME_T r;
+    double micros = frame->millis * 1000.0 + 0.5;
+    r.micros = micros <= 0.0 ? 0u : micros >= 4294967295.0 ? 4294967295u : (uint32_t) micros;
+    r.moveKeys = frame->moveKeys;
+    r.specialKeys = frame->specialKeys;
+    r.buttons = frame->buttons;
+    r.unused = 0;
+    r.mouseDeltaX = frame->mouseDeltaX;
+    r.mouseDeltaY = frame->mouseDeltaY;
+    if (fwrite(&r, sizeof(r), 1, _record) != 1)
+    {
+#ifdef DEBUG_THIS
+        mxDebugStr("Failed to record frame, recording stopped");
+#endif
+        mxRecordCleanup();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxRecordCleanup()
+{
+    if (_record == NULL) return;
+    fclose(_record);
+    _record = NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Reads the recording in the given file, ready to be played back. Returns
+// false if it can't be read or isn't a recording.
+///////////////////////////////////////////////////////////////////////////////
+bool mxReplaySetup(const char* filename)
+{
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL) return false;
+
+    RECORD_HEADER_T header;
+    long size = -1;
+    if (fread(&header, sizeof(header), 1, f) == 1 &&
+        memcmp(header.magic, RECORD_MAGIC, sizeof(header.magic)) == 0 &&
+        header.version == RECORD_VERSION &&
+        fseek(f, 0, SEEK_END) == 0)
+    {
+        size = ftell(f) - (long) sizeof(header);
+    }
+    if (size < 0 || fseek(f, sizeof(header), SEEK_SET) != 0)
+    {
+#ifdef DEBUG_THIS
+        mxDebug("%s is not an input recording", filename);
+#endif
+        fclose(f);
+        return false;
+    }
+
+    _frames_count = (int) (size / sizeof(RECORD_FRAME_T));
+    _frames = (RECORD_FRAME_T*) malloc(_frames_count * sizeof(RECORD_FRAME_T) + 1);
+    bool ok = _frames != NULL &&
+              fread(_frames, sizeof(RECORD_FRAME_T), _frames_count, f) == (size_t) _frames_count;
+    fclose(f);
+    if (!ok)
+    {
+        mxReplayCleanup();
+        return false;
+    }
+    _frame = 0;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the next frame of the recording, or false when there are no more.
+///////////////////////////////////////////////////////////////////////////////
+bool mxReplayUpdate(MX_RECORD_FRAME_T* frame)
+{
+    if (_frame >= _frames_count) return false;
+
+    const RECORD_FRAME_T* r = &_frames[_frame++];
+    frame->millis = r->micros / 1000.0;
+    frame->moveKeys = r->moveKeys;
+    frame->specialKeys = r->specialKeys;
+    frame->buttons = r->buttons;
+    frame->mouseDeltaX = r->mouseDeltaX;
+    frame->mouseDeltaY = r->mouseDeltaY;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the number of frames in the recording being played back.
+///////////////////////////////////////////////////////////////////////////////
+int mxReplayFrames()
+{
+    return _frames_count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxReplayCleanup()
+{
+    free(_frames);
+    _frames = NULL;
+    _frames_count = 0;
+    _frame = 0;
+}
@@ -0,0 +1,26 @@
+#ifndef MX_RECORD_H
+#define MX_RECORD_H
+
+#include <stdbool.h> // bool
+
+// The input for one frame, and how long the frame took in milliseconds.
+typedef struct
+{
+    double millis;
+    unsigned char moveKeys;
+    unsigned char specialKeys;
+    unsigned char buttons;
+    float mouseDeltaX;
+    float mouseDeltaY;
+} MX_RECORD_FRAME_T;
+
+bool mxRecordSetup(const char* filename);
+void mxRecordFrame(const MX_RECORD_FRAME_T* frame);
+void mxRecordCleanup();
+
+bool mxReplaySetup(const char* filename);
+bool mxReplayUpdate(MX_RECORD_FRAME_T* frame);
+int mxReplayFrames();
+void mxReplayCleanup();
+
+#endif /* MX_RECORD_H */
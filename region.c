@@ -0,0 +1,615 @@
+///////////////////////////////////////////////////////////////////////////////
+// This file stores chunks in region files. A region file starts with a table
+// giving the offset and length of each chunk's data, and the data follows.
+// Files are memory mapped, so loading a chunk costs a table lookup, the page
+// faults to bring its data in from the file, and decoding it.
+//
+// Chunks are encoded as a palette of the block types used, followed by runs
+// of blocks in index order, each a palette index and a length. Most chunks
+// are a few large runs, and are a few hundred bytes.
+//
+// Saving never overwrites data that the table refers to. The new data is
+// appended and synced to disk, and only then is the chunk's table entry
+// changed, with a single aligned 64-bit store. If the game stops part way
+// through, the table still refers to the previous, complete copy. Data that
+// is no longer referred to is reclaimed when nobody is using the region, by
+// writing the chunks still referred to into a new file and renaming it over
+// the old one, so that the file is replaced whole or not at all.
+//
+// Loading and saving may happen on any thread, but a chunk must not be saved
+// on two threads at once. Regions are opened and closed on the main thread
+// only. Each open must be matched by a close once the region is no longer
+// used, and regions that nobody has used for a while are unmapped, so that a
+// long walk doesn't run out of address space on the Pi. The
+// file format uses the byte order of the machine, which is little endian on
+// the Pi and on PCs.
+///////////////////////////////////////////////////////////////////////////////
+
+#define _XOPEN_SOURCE 500
+
+// Enable or disable debugging in this file.
+#define DEBUG_THIS
+
+#ifdef DEBUG_THIS
+#include "debug.h"
+#endif
+
+#include "region.h"
+#include "profiler.h" // mxProfileNow
+
+#include <stdio.h> // snprintf, rename
+#include <errno.h> // errno, ENOENT
+#include <stdlib.h> // malloc, realloc, free
+#include <string.h> // memcmp, memcpy, memmove, memset, strncpy
+#include <stdint.h> // uint64_t, uint32_t
+#include <fcntl.h> // open, O_RDWR, O_CREAT
+#include <unistd.h> // pwrite, fdatasync, close, unlink
+#include <sys/mman.h> // mmap, munmap, msync
+#include <sys/stat.h> // fstat, mkdir
+
+#define REGION_SIZE     (1 << MX_REGION_BITS)
+#define REGION_HEIGHT   (1 << MX_REGION_HEIGHT_BITS)
+#define REGION_CHUNKS   (REGION_SIZE * REGION_SIZE * REGION_HEIGHT)
+
+// The header is a magic number, the chunk size, then one entry per chunk.
+#define MAGIC           "MXREGION"
+#define HEADER_SIZE     (16 + REGION_CHUNKS * 8)
+
+// Entries hold the offset of the chunk's data in the upper 40 bits, and its
+// length in the lower 24. Zero means the chunk has not been saved.
+#define LENGTH_BITS     (24)
+
+// Address space reserved for each file. Pages past the end of the file can't
+// be read until the file grows, but the mapping never has to move, so other
+// threads can keep reading while data is appended. Saves fail once the file
+// reaches this size, until the region is next compacted.
+#define MAP_SIZE        (64 * 1024 * 1024)
+
+// A region is compacted once it is unused, if its file has passed this size
+// and at least half of it is no longer referred to.
+#define COMPACT_SIZE    (MAP_SIZE / 4)
+
+// Regions are unmapped once they have been unused for this long, in seconds.
+#define IDLE_SECONDS    (10)
+
+// Regions known to have no file, so that chunks there don't each try to open
+// it. The oldest is forgotten when the list is full.
+#define MAX_MISSING     (64)
+
+// Largest encoded chunk: the palette, then a run for every block.
+#define MAX_ENCODED     (1 + 256 + MX_CHUNK_VOLUME * 4)
+
+struct MX_REGION_T
+{
+    int rx;
+    int ry;
+    int rz;
+    int fd;
+    unsigned char* map;
+    uint64_t* entries;
+
+    // Offset at which the next chunk will be written, and the bytes of the
+    // file known to have been written, which are all that may be read
+    // through the map. Entries reaching past that are damaged.
+    uint64_t end;
+    uint64_t size;
+
+    // Bytes of data the table refers to.
+    uint64_t live;
+
+    // Opens not yet closed, and when the last was closed.
+    int users;
+    uint64_t idle_since;
+};
+
+static char _directory[256];
+static bool _enabled;
+
+static MX_REGION_T** _regions;
+static int _regions_count;
+static int _regions_capacity;
+
+typedef struct
+{
+    int rx;
+    int ry;
+    int rz;
+} MX_REGION_COORDS_T;
+
+static MX_REGION_COORDS_T _missing[MAX_MISSING];
+static int _missing_count;
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets the directory where region files are kept, creating it if needed. If
+// directory is NULL, chunks are neither loaded nor saved.
+///////////////////////////////////////////////////////////////////////////////
+bool mxRegionSetup(const char* directory)
+{
+    _enabled = directory != NULL;
+    if (!_enabled) return true;
+
+    strncpy(_directory, directory, sizeof(_directory) - 1);
+    mkdir(_directory, 0755);
+    struct stat st;
+    return stat(_directory, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static int chunk_slot(int cx, int cy, int cz)
+{
+    int x = cx & (REGION_SIZE - 1);
+    int y = cy & (REGION_HEIGHT - 1);
+    int z = cz & (REGION_SIZE - 1);
+    return (y * REGION_SIZE + z) * REGION_SIZE + x;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the index of the region in the list of those with no file, or -1.
+///////////////////////////////////////////////////////////////////////////////
+static int find_missing(int rx, int ry, int rz)
+{
+    for (int i = 0; i < _missing_count; i++)
+        if (_missing[i].rx == rx && _missing[i].ry == ry && _missing[i].rz == rz) return i;
+    return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static void forget_missing(int index)
+{
+    memmove(&_missing[index], &_missing[index + 1], (_missing_count - index - 1) * sizeof(MX_REGION_COORDS_T));
+    _missing_count--;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Adds the region to the list of those with no file, forgetting the oldest
+// if the list is full.
+///////////////////////////////////////////////////////////////////////////////
+static void add_missing(int rx, int ry, int rz)
+{
+    if (_missing_count == MAX_MISSING) forget_missing(0);
+    MX_REGION_COORDS_T* missing = &_missing[_missing_count++];
+    missing->rx = rx;
+    missing->ry = ry;
+    missing->rz = rz;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static void region_filename(int rx, int ry, int rz, const char* suffix, char* filename, int size)
+{
+    snprintf(filename, size, "%s/r.%d.%d.%d.mxr%s", _directory, rx, ry, rz, suffix);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the offset and length of the data for the chunk in the given slot,
+// or false if it hasn't been saved or its entry reaches past the first size
+// bytes of the file.
+///////////////////////////////////////////////////////////////////////////////
+static bool chunk_data(const MX_REGION_T* region, int slot, uint64_t size, uint64_t* offset, int* length)
+{
+    uint64_t entry = __atomic_load_n(&region->entries[slot], __ATOMIC_ACQUIRE);
+    *offset = entry >> LENGTH_BITS;
+    *length = (int) (entry & ((1u << LENGTH_BITS) - 1));
+    return entry != 0 && *offset >= HEADER_SIZE && *offset + *length <= size && *offset + *length <= MAP_SIZE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Opens the region file, writing a new header if it's empty, and maps it.
+///////////////////////////////////////////////////////////////////////////////
+static MX_REGION_T* open_region(int rx, int ry, int rz, bool create)
+{
+    char filename[300];
+    region_filename(rx, ry, rz, "", filename, sizeof(filename));
+    int fd = open(filename, create ? O_RDWR | O_CREAT : O_RDWR, 0644);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    uint64_t size = (uint64_t) st.st_size;
+    if (size == 0)
+    {
+        // A new file: write an empty table and make sure it reaches the disk
+        // before anything refers to it.
+        unsigned char* header = (unsigned char*) calloc(1, HEADER_SIZE);
+        if (header == NULL)
+        {
+            close(fd);
+            return NULL;
+        }
+        memcpy(header, MAGIC, 8);
+        uint32_t bits = MX_CHUNK_BITS;
+        memcpy(header + 8, &bits, sizeof(bits));
+        bool written = pwrite(fd, header, HEADER_SIZE, 0) == HEADER_SIZE && fdatasync(fd) == 0;
+        free(header);
+        if (!written)
+        {
+            close(fd);
+            return NULL;
+        }
+        size = HEADER_SIZE;
+    }
+
+    unsigned char* map = (unsigned char*) mmap(NULL, MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    uint32_t bits;
+    memcpy(&bits, map + 8, sizeof(bits));
+    if (size < HEADER_SIZE || memcmp(map, MAGIC, 8) != 0 || bits != MX_CHUNK_BITS)
+    {
+#ifdef DEBUG_THIS
+        mxDebug("%s is not a region file for this chunk size", filename);
+#endif
+        munmap(map, MAP_SIZE);
+        close(fd);
+        return NULL;
+    }
+
+    MX_REGION_T* region = (MX_REGION_T*) malloc(sizeof(MX_REGION_T));
+    if (region == NULL)
+    {
+        munmap(map, MAP_SIZE);
+        close(fd);
+        return NULL;
+    }
+    region->rx = rx;
+    region->ry = ry;
+    region->rz = rz;
+    region->fd = fd;
+    region->map = map;
+    region->entries = (uint64_t*) (map + 16);
+    region->end = size;
+    region->size = size;
+    region->live = 0;
+    region->users = 0;
+    region->idle_since = 0;
+
+    // Entries reaching past the end of the file can never be read, and are
+    // forgotten, so that only the data of readable chunks counts as live.
+    for (int i = 0; i < REGION_CHUNKS; i++)
+    {
+        uint64_t offset;
+        int length;
+        if (chunk_data(region, i, size, &offset, &length)) region->live += (uint64_t) length;
+        else if (region->entries[i] != 0)
+        {
+#ifdef DEBUG_THIS
+            mxDebug("Chunk %d in %s is damaged", i, filename);
+#endif
+            region->entries[i] = 0;
+        }
+    }
+    return region;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Rewrites the region file with only the chunks the table refers to, and maps
+// the new file in place of the old. The region must not be in use. Returns
+// false if the file couldn't be rewritten, in which case the old one is still
+// mapped and intact.
+///////////////////////////////////////////////////////////////////////////////
+static bool compact_region(MX_REGION_T* region)
+{
+    unsigned char* data = (unsigned char*) malloc(HEADER_SIZE + region->live);
+    if (data == NULL) return false;
+    memcpy(data, region->map, 16);
+    uint64_t* entries = (uint64_t*) (data + 16);
+    uint64_t end = HEADER_SIZE;
+    for (int i = 0; i < REGION_CHUNKS; i++)
+    {
+        uint64_t offset;
+        int length;
+        entries[i] = 0;
+        if (!chunk_data(region, i, region->size, &offset, &length) || end + length > HEADER_SIZE + region->live)
+            continue;
+        memcpy(data + end, region->map + offset, length);
+        entries[i] = (end << LENGTH_BITS) | (uint64_t) length;
+        end += (uint64_t) length;
+    }
+
+    // The new file must be complete on the disk before it replaces the old.
+    char filename[300];
+    char temporary[300];
+    region_filename(region->rx, region->ry, region->rz, "", filename, sizeof(filename));
+    region_filename(region->rx, region->ry, region->rz, ".new", temporary, sizeof(temporary));
+    int fd = open(temporary, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    bool ok = fd >= 0 && pwrite(fd, data, end, 0) == (ssize_t) end && fdatasync(fd) == 0;
+    free(data);
+    unsigned char* map = ok ? (unsigned char*) mmap(NULL, MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                            : (unsigned char*) MAP_FAILED;
+    if (map == MAP_FAILED || rename(temporary, filename) != 0)
+    {
+#ifdef DEBUG_THIS
+        mxDebug("Failed to compact region %d, %d, %d", region->rx, region->ry, region->rz);
+#endif
+        if (map != MAP_FAILED) munmap(map, MAP_SIZE);
+        if (fd >= 0) close(fd);
+        unlink(temporary);
+        return false;
+    }
+
+#ifdef DEBUG_THIS
+    mxDebug("Compacted region %d, %d, %d from %llu to %llu bytes", region->rx, region->ry, region->rz,
+            (unsigned long long) region->size, (unsigned long long) end);
+#endif
+    munmap(region->map, MAP_SIZE);
+    close(region->fd);
+    region->fd = fd;
+    region->map = map;
+    region->entries = (uint64_t*) (map + 16);
+    region->end = end;
+    region->size = end;
+    region->live = end - HEADER_SIZE;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Compacts the region if it is large and mostly data no longer referred to.
+// The region must not be in use.
+///////////////////////////////////////////////////////////////////////////////
+static void compact_if_wasteful(MX_REGION_T* region)
+{
+    if (region->end >= COMPACT_SIZE && region->end - HEADER_SIZE >= 2 * region->live) compact_region(region);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static void unmap_region(MX_REGION_T* region)
+{
+    munmap(region->map, MAP_SIZE);
+    close(region->fd);
+    free(region);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Unmaps the regions that have been unused for IDLE_SECONDS.
+///////////////////////////////////////////////////////////////////////////////
+static void close_idle_regions()
+{
+    uint64_t now = mxProfileNow();
+    for (int i = _regions_count - 1; i >= 0; i--)
+    {
+        MX_REGION_T* region = _regions[i];
+        if (region->users > 0 || now - region->idle_since < IDLE_SECONDS * 1000000000ull) continue;
+
+#ifdef DEBUG_THIS
+        mxDebug("Closing idle region %d, %d, %d", region->rx, region->ry, region->rz);
+#endif
+        unmap_region(region);
+        _regions[i] = _regions[--_regions_count];
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the region holding the given chunk. If there is no file for it yet,
+// one is created if create is set, and otherwise NULL is returned. A region
+// that is returned must be closed with mxRegionClose when done with. Must be
+// called on the main thread.
+///////////////////////////////////////////////////////////////////////////////
+MX_REGION_T* mxRegionOpen(int cx, int cy, int cz, bool create)
+{
+    if (!_enabled) return NULL;
+
+    int rx = cx >> MX_REGION_BITS;
+    int ry = cy >> MX_REGION_HEIGHT_BITS;
+    int rz = cz >> MX_REGION_BITS;
+    for (int i = 0; i < _regions_count; i++)
+    {
+        MX_REGION_T* region = _regions[i];
+        if (region->rx != rx || region->ry != ry || region->rz != rz) continue;
+        region->users++;
+        return region;
+    }
+    close_idle_regions();
+
+    // Only a save creates a file, so a region found to have none still has
+    // none until then.
+    int missing = find_missing(rx, ry, rz);
+    if (missing >= 0 && !create) return NULL;
+
+    if (_regions_count == _regions_capacity)
+    {
+        int capacity = _regions_capacity ? _regions_capacity * 2 : 16;
+        MX_REGION_T** regions = (MX_REGION_T**) realloc(_regions, capacity * sizeof(MX_REGION_T*));
+        if (regions == NULL) return NULL;
+        _regions = regions;
+        _regions_capacity = capacity;
+    }
+
+    errno = 0;
+    MX_REGION_T* region = open_region(rx, ry, rz, create);
+    if (region == NULL && !create && errno == ENOENT) add_missing(rx, ry, rz);
+    if (region == NULL) return NULL;
+    if (missing >= 0) forget_missing(missing);
+    compact_if_wasteful(region);
+    region->users = 1;
+    _regions[_regions_count++] = region;
+    return region;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Ends a use of the region returned by mxRegionOpen, which may be NULL. The
+// region stays mapped for a while in case it is wanted again, and is compacted
+// now if that would reclaim much of its file. Must be called on the main
+// thread, once no load or save in the region is in progress.
+///////////////////////////////////////////////////////////////////////////////
+void mxRegionClose(MX_REGION_T* region)
+{
+    if (region == NULL || --region->users > 0) return;
+    region->idle_since = mxProfileNow();
+    compact_if_wasteful(region);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Encodes the blocks into out, which must hold MAX_ENCODED bytes, and returns
+// the length.
+///////////////////////////////////////////////////////////////////////////////
+static int encode(const MX_BLOCK_T* blocks, unsigned char* out)
+{
+    // Palette of the block types used, in order of first use.
+    unsigned char index[256];
+    memset(index, 0xFF, sizeof(index));
+    unsigned char* palette = out + 1;
+    int palette_count = 0;
+    for (int i = 0; i < MX_CHUNK_VOLUME; i++)
+    {
+        if (index[blocks[i]] != 0xFF) continue;
+        index[blocks[i]] = (unsigned char) palette_count;
+        palette[palette_count++] = blocks[i];
+    }
+    out[0] = (unsigned char) (palette_count - 1);
+
+    // Runs, with the length less one as a little endian base 128 number.
+    unsigned char* p = palette + palette_count;
+    for (int i = 0; i < MX_CHUNK_VOLUME;)
+    {
+        int run = 1;
+        while (i + run < MX_CHUNK_VOLUME && blocks[i + run] == blocks[i]) run++;
+        *p++ = index[blocks[i]];
+        unsigned int n = (unsigned int) run - 1;
+        while (n >= 0x80)
+        {
+            *p++ = (unsigned char) (n | 0x80);
+            n >>= 7;
+        }
+        *p++ = (unsigned char) n;
+        i += run;
+    }
+    return (int) (p - out);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Decodes data into the chunk. Returns false if the data is malformed.
+///////////////////////////////////////////////////////////////////////////////
+static bool decode(const unsigned char* data, int length, MX_CHUNK_T* chunk)
+{
+    const unsigned char* end = data + length;
+    if (length < 1) return false;
+    int palette_count = data[0] + 1;
+    const unsigned char* palette = data + 1;
+    const unsigned char* p = palette + palette_count;
+    if (p > end) return false;
+
+    int solid_count = 0;
+    int i = 0;
+    while (p < end)
+    {
+        unsigned int which = *p++;
+        unsigned int n = 0;
+        int shift = 0;
+        while (p < end && (*p & 0x80) && shift < 21)
+        {
+            n |= (unsigned int) (*p++ & 0x7F) << shift;
+            shift += 7;
+        }
+        if (p == end || which >= (unsigned int) palette_count) return false;
+        n |= (unsigned int) *p++ << shift;
+
+        int run = (int) n + 1;
+        if (run > MX_CHUNK_VOLUME - i) return false;
+        MX_BLOCK_T type = palette[which];
+        memset(&chunk->blocks[i], type, run);
+        if (type != MX_BLOCK_AIR) solid_count += run;
+        i += run;
+    }
+    if (i != MX_CHUNK_VOLUME) return false;
+
+    chunk->solid_count = solid_count;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Fills the chunk from the region file. Returns false if the chunk has never
+// been saved, or its data can't be read.
+///////////////////////////////////////////////////////////////////////////////
+bool mxRegionLoad(MX_REGION_T* region, MX_CHUNK_T* chunk)
+{
+    if (region == NULL) return false;
+
+    int slot = chunk_slot(chunk->cx, chunk->cy, chunk->cz);
+    if (__atomic_load_n(&region->entries[slot], __ATOMIC_ACQUIRE) == 0) return false;
+
+    // Reading past the end of the file through the map would raise SIGBUS.
+    uint64_t offset;
+    int length;
+    uint64_t size = __atomic_load_n(&region->size, __ATOMIC_ACQUIRE);
+    if (chunk_data(region, slot, size, &offset, &length) && decode(region->map + offset, length, chunk)) return true;
+
+#ifdef DEBUG_THIS
+    mxDebug("Chunk %d, %d, %d is damaged", chunk->cx, chunk->cy, chunk->cz);
+#endif
+    memset(chunk->blocks, MX_BLOCK_AIR, sizeof(chunk->blocks));
+    chunk->solid_count = 0;
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writes the chunk's blocks to the region file, returning once they are on
+// the disk. Returns false if they couldn't be written, or the region is full
+// until it is next compacted, in which case the previous copy of the chunk, if
+// any, is still intact.
+///////////////////////////////////////////////////////////////////////////////
+bool mxRegionSave(MX_REGION_T* region, int cx, int cy, int cz, const MX_BLOCK_T* blocks)
+{
+    if (region == NULL) return false;
+
+    unsigned char* data = (unsigned char*) malloc(MAX_ENCODED);
+    if (data == NULL) return false;
+    int length = encode(blocks, data);
+
+    // Reserve space at the end of the file, if it fits in the map. Other
+    // threads may be appending other chunks at the same time.
+    uint64_t offset = __atomic_load_n(&region->end, __ATOMIC_RELAXED);
+    while (offset + length <= MAP_SIZE &&
+           !__atomic_compare_exchange_n(&region->end, &offset, offset + length, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    bool ok = offset + length <= MAP_SIZE &&
+              pwrite(region->fd, data, length, (off_t) offset) == length &&
+              fdatasync(region->fd) == 0;
+    free(data);
+    if (!ok)
+    {
+#ifdef DEBUG_THIS
+        if (offset + length > MAP_SIZE) mxDebug("Region full, failed to save chunk %d, %d, %d", cx, cy, cz);
+        else mxDebug("Failed to save chunk %d, %d, %d", cx, cy, cz);
+#endif
+        return false;
+    }
+
+    // The data may now be read, and the table pointed at it.
+    uint64_t written = offset + length;
+    uint64_t size = __atomic_load_n(&region->size, __ATOMIC_RELAXED);
+    while (size < written &&
+           !__atomic_compare_exchange_n(&region->size, &size, written, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    // Now point the table at the new data and sync the page it's in. The old
+    // data is no longer referred to.
+    int slot = chunk_slot(cx, cy, cz);
+    uint64_t old_offset;
+    int old_length;
+    if (!chunk_data(region, slot, written, &old_offset, &old_length)) old_length = 0;
+    uint64_t* entry = &region->entries[slot];
+    __atomic_store_n(entry, (offset << LENGTH_BITS) | (uint64_t) length, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&region->live, (uint64_t) length - (uint64_t) old_length, __ATOMIC_RELAXED);
+    uintptr_t page_size = (uintptr_t) sysconf(_SC_PAGESIZE);
+    unsigned char* page = (unsigned char*) ((uintptr_t) entry & ~(page_size - 1));
+    return msync(page, page_size, MS_SYNC) == 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Closes every region. No loads or saves may be in progress.
+///////////////////////////////////////////////////////////////////////////////
+void mxRegionCleanup()
+{
+    for (int i = 0; i < _regions_count; i++) unmap_region(_regions[i]);
+    free(_regions);
+    _regions = NULL;
+    _missing_count = 0;
+    _regions_count = 0;
+    _regions_capacity = 0;
+}
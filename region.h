@@ -0,0 +1,21 @@
+#ifndef MX_REGION_H
+#define MX_REGION_H
+
+#include "world.h" // MX_CHUNK_T, MX_BLOCK_T
+
+#include <stdbool.h> // bool
+
+// Each region file holds 32 x 32 columns of chunks, 8 chunks tall.
+#define MX_REGION_BITS          (5)
+#define MX_REGION_HEIGHT_BITS   (3)
+
+typedef struct MX_REGION_T MX_REGION_T;
+
+bool mxRegionSetup(const char* directory);
+MX_REGION_T* mxRegionOpen(int cx, int cy, int cz, bool create);
+void mxRegionClose(MX_REGION_T* region);
+bool mxRegionLoad(MX_REGION_T* region, MX_CHUNK_T* chunk);
+bool mxRegionSave(MX_REGION_T* region, int cx, int cy, int cz, const MX_BLOCK_T* blocks);
+void mxRegionCleanup();
+
+#endif /* MX_REGION_H */
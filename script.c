@@ -0,0 +1,156 @@
+///////////////////////////////////////////////////////////////////////////////
+// This file provides scripted input, used in place of the keyboard and mouse
+// when running headless. A script is a text file where each line holds a
+// number of frames, the movement keys held during those frames, and the mouse
+// movement per frame:
+//
+//     # frames keys dx dy
+//     60 F 0 0
+//     90 FR -2 0.5
+//
+// Keys are any of F, B, L, R, U and D (forward, back, left, right, up and
+// down), or - for none. Anything after a # is ignored. The script starts over
+// when it runs out, so it can drive any number of frames.
+///////////////////////////////////////////////////////////////////////////////
+
+// Enable or disable debugging in this file.
+#define DEBUG_THIS
+
+#ifdef DEBUG_THIS
+#include "debug.h"
+#endif
+
+#include "script.h"
+#include "keyboard.h" // MOVE_FORWARD, etc.
+
+#include <stdio.h> // fopen, fgets, sscanf
+#include <stdlib.h> // realloc, free
+#include <string.h> // strchr
+
+typedef struct
+{
+    int frames;
+    unsigned char moveKeys;
+    float deltaX;
+    float deltaY;
+} MX_SCRIPT_STEP_T;
+
+// Used when no script file is given: back away from the world, circle around
+// it while looking in, then rise and look down on it. This lasts 300 frames.
+static const char* _default_script =
+    "60 B 0 0\n"
+    "180 R -0.33 0\n"
+    "40 U 0 0.35\n"
+    "20 - 0 0\n";
+
+static MX_SCRIPT_STEP_T* _steps;
+static int _steps_count;
+static int _step;
+static int _frame;
+
+///////////////////////////////////////////////////////////////////////////////
+// Parses one line of a script. Returns false if the line is malformed; blank
+// lines and comments are accepted without adding a step.
+///////////////////////////////////////////////////////////////////////////////
+static bool parse_line(char* line)
+{
+    char* comment = strchr(line, '#');
+    if (comment != NULL) *comment = '\0';
+
+    MX_SCRIPT_STEP_T step = { 0, 0, 0.f, 0.f };
+    char keys[16];
+    int n = sscanf(line, "%d %15s %f %f", &step.frames, keys, &step.deltaX, &step.deltaY);
+    if (n <= 0) return true;
+    if (n != 4 || step.frames <= 0) return false;
+
+    for (const char* k = keys; *k; k++)
+    {
+        switch (*k)
+        {
+            case 'F': step.moveKeys |= MOVE_FORWARD | MOVE_FORWARD_OVER_BACK; break;
+            case 'B': step.moveKeys |= MOVE_BACK; break;
+            case 'L': step.moveKeys |= MOVE_LEFT | MOVE_LEFT_OVER_RIGHT; break;
+            case 'R': step.moveKeys |= MOVE_RIGHT; break;
+            case 'U': step.moveKeys |= MOVE_UP; break;
+            case 'D': step.moveKeys |= MOVE_DOWN; break;
+            case '-': break;
+            default: return false;
+        }
+    }
+
+    MX_SCRIPT_STEP_T* p = (MX_SCRIPT_STEP_T*) realloc(_steps, (_steps_count + 1) * sizeof(MX_SCRIPT_STEP_T));
+    if (p == NULL) return false;
+    _steps = p;
+    _steps[_steps_count++] = step;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Loads the script from the given file, or the built in script if filename is
+// NULL. Returns false if the file can't be read or has no steps.
+///////////////////////////////////////////////////////////////////////////////
+bool mxScriptSetup(const char* filename)
+{
+    char line[256];
+    int number = 0;
+
+    if (filename == NULL)
+    {
+        for (const char* s = _default_script; *s;)
+        {
+            const char* end = strchr(s, '\n');
+            size_t length = end - s;
+            memcpy(line, s, length);
+            line[length] = '\0';
+            if (!parse_line(line)) return false;
+            s = end + 1;
+        }
+    }
+    else
+    {
+        FILE* f = fopen(filename, "r");
+        if (f == NULL) return false;
+        while (fgets(line, sizeof(line), f) != NULL)
+        {
+            number++;
+            if (!parse_line(line))
+            {
+#ifdef DEBUG_THIS
+                mxDebug("%s:%d: bad script line", filename, number);
+#endif
+                fclose(f);
+                return false;
+            }
+        }
+        fclose(f);
+    }
+
+    _step = 0;
+    _frame = 0;
+    return _steps_count > 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the input for the next frame.
+///////////////////////////////////////////////////////////////////////////////
+void mxScriptUpdate(unsigned char* moveKeys, float* deltaX, float* deltaY)
+{
+    const MX_SCRIPT_STEP_T* step = &_steps[_step];
+    *moveKeys = step->moveKeys;
+    *deltaX = step->deltaX;
+    *deltaY = step->deltaY;
+
+    if (++_frame == step->frames)
+    {
+        _frame = 0;
+        _step = (_step + 1) % _steps_count;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxScriptCleanup()
+{
+    free(_steps);
+    _steps = NULL;
+    _steps_count = 0;
+}
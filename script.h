@@ -0,0 +1,10 @@
+#ifndef MX_SCRIPT_H
+#define MX_SCRIPT_H
+
+#include <stdbool.h> // bool
+
+bool mxScriptSetup(const char* filename);
+void mxScriptUpdate(unsigned char* moveKeys, float* deltaX, float* deltaY);
+void mxScriptCleanup();
+
+#endif /* MX_SCRIPT_H */
@@ -0,0 +1,125 @@
+///////////////////////////////////////////////////////////////////////////////
+// This file compiles and links shader programs. Programs are cached by their
+// source strings, so asking for the same program again costs a short search
+// rather than a compile. Redundant glUseProgram calls are skipped by the GL
+// state cache.
+///////////////////////////////////////////////////////////////////////////////
+
+// Enable or disable debugging in this file.
+#define DEBUG_THIS
+
+#ifdef DEBUG_THIS
+#include "debug.h"
+#endif
+
+#include "shader.h"
+#include "gl_state.h" // mxGlUseProgram
+
+#include <stdlib.h> // NULL
+
+// Maximum number of programs that can be cached.
+#define MAX_PROGRAMS 8
+
+typedef struct
+{
+    const char* vertex_source;
+    const char* fragment_source;
+    GLuint program;
+} MX_PROGRAM_T;
+
+static MX_PROGRAM_T _programs[MAX_PROGRAMS];
+static int _programs_count;
+
+///////////////////////////////////////////////////////////////////////////////
+static GLuint compile(GLenum type, const char* source)
+{
+    GLuint shader = glCreateShader(type);
+    if (shader == 0) return 0;
+
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+
+    GLint compiled;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled)
+    {
+#ifdef DEBUG_THIS
+        char log[512];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        mxDebug("Shader compile failed: %s", log);
+#endif
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the program built from the given sources, compiling and linking it
+// the first time it is asked for. Returns 0 on failure. attributes is a NULL
+// terminated list of attribute names, which are bound to locations 0, 1, etc.
+///////////////////////////////////////////////////////////////////////////////
+GLuint mxShaderProgram(const char* vertex_source, const char* fragment_source, const char* const* attributes)
+{
+    for (int i = 0; i < _programs_count; i++)
+    {
+        if (_programs[i].vertex_source == vertex_source &&
+            _programs[i].fragment_source == fragment_source)
+        {
+            return _programs[i].program;
+        }
+    }
+    if (_programs_count == MAX_PROGRAMS) return 0;
+
+    GLuint vertex_shader = compile(GL_VERTEX_SHADER, vertex_source);
+    if (vertex_shader == 0) return 0;
+    GLuint fragment_shader = compile(GL_FRAGMENT_SHADER, fragment_source);
+    if (fragment_shader == 0)
+    {
+        glDeleteShader(vertex_shader);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertex_shader);
+    glAttachShader(program, fragment_shader);
+    for (GLuint i = 0; attributes[i] != NULL; i++) glBindAttribLocation(program, i, attributes[i]);
+    glLinkProgram(program);
+
+    // The shaders are freed along with the program.
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+
+    GLint linked;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked)
+    {
+#ifdef DEBUG_THIS
+        char log[512];
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        mxDebug("Program link failed: %s", log);
+#endif
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    MX_PROGRAM_T* p = &_programs[_programs_count++];
+    p->vertex_source = vertex_source;
+    p->fragment_source = fragment_source;
+    p->program = program;
+    return program;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxShaderUse(GLuint program)
+{
+    mxGlUseProgram(program);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxShaderCleanup()
+{
+    mxGlUseProgram(0);
+    for (int i = 0; i < _programs_count; i++) glDeleteProgram(_programs[i].program);
+    _programs_count = 0;
+}
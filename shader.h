@@ -0,0 +1,10 @@
+#ifndef MX_SHADER_H
+#define MX_SHADER_H
+
+#include <GLES2/gl2.h> // GLuint
+
+GLuint mxShaderProgram(const char* vertex_source, const char* fragment_source, const char* const* attributes);
+void mxShaderUse(GLuint program);
+void mxShaderCleanup();
+
+#endif /* MX_SHADER_H */
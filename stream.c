@@ -0,0 +1,233 @@
+///////////////////////////////////////////////////////////////////////////////
+// This file keeps the chunks around the player in the world. Chunks within
+// the load radius are requested from the loader, nearest first, and chunks
+// beyond the larger unload radius are removed and handed back to the loader
+// to cache. The gap between the two radii stops chunks on the boundary being
+// loaded and unloaded again as the player moves back and forth across it.
+//
+// Distances are measured horizontally, in chunks, and vertically the world is
+// loaded a fixed number of chunks above and below the player. Chunks in front
+// of the player are loaded before those behind at the same distance.
+//
+// Only a few requests are given to the loader at a time, so the order can be
+// changed as the player moves and turns.
+///////////////////////////////////////////////////////////////////////////////
+
+// Enable or disable debugging in this file.
+//#define DEBUG_THIS
+
+#ifdef DEBUG_THIS
+#include "debug.h"
+#endif
+
+#include "stream.h"
+#include "gfx_engine.h" // mxGraphicsReleaseChunk, mxGraphicsMeshBytes
+#include "loader.h" // mxLoaderRequest, mxLoaderLoading, mxLoaderUnload
+#include "player.h" // mxPlayerGetPosition, mxPlayerGetDirection
+#include "profiler.h" // mxProfileCount
+#include "world.h" // mxWorldGetChunk, mxWorldRemoveChunk, MX_BLOCK_SIZE
+
+#include <stdlib.h> // malloc, free, qsort
+#include <math.h> // floor, sqrt
+
+// Chunks are unloaded this many chunks further out than they are loaded.
+#define HYSTERESIS 2
+
+// Chunks loaded above and below the player's chunk.
+#define HEIGHT 3
+
+// Most requests given to the loader at once.
+#define MAX_PENDING 32
+
+// The order of requests is worked out again at least this often, in updates,
+// to follow the player turning.
+#define SORT_INTERVAL 30
+
+typedef struct
+{
+    int cx;
+    int cy;
+    int cz;
+    float priority;
+} MX_WANTED_T;
+
+static int _radius;
+
+// Chunks within the load radius that are not in the world, most wanted first.
+static MX_WANTED_T* _wanted;
+static int _wanted_count;
+static int _wanted_next;
+static int _wanted_capacity;
+
+// The player's chunk when the wanted list was made, and updates since then.
+static int _centre[3];
+static bool _sorted;
+static int _updates;
+
+// Distant chunks that couldn't be unloaded last time, as they were in use.
+static int _unload_left;
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets the radius within which chunks are loaded, in chunks.
+///////////////////////////////////////////////////////////////////////////////
+bool mxStreamSetup(int radius)
+{
+    _radius = radius > 0 ? radius : 1;
+    int diameter = 2 * _radius + 1;
+    _wanted_capacity = diameter * diameter * (2 * HEIGHT + 1);
+    _wanted = (MX_WANTED_T*) malloc(_wanted_capacity * sizeof(MX_WANTED_T));
+    _wanted_count = _wanted_next = 0;
+    _sorted = false;
+    return _wanted != NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static int compare_wanted(const void* a, const void* b)
+{
+    float x = ((const MX_WANTED_T*) a)->priority;
+    float y = ((const MX_WANTED_T*) b)->priority;
+    return (x > y) - (x < y);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Lists the chunks within the load radius that still need to be requested, in
+// order of horizontal distance squared, scaled by up to two for chunks behind
+// the player.
+///////////////////////////////////////////////////////////////////////////////
+static void make_wanted(const int centre[3], float dir_x, float dir_z)
+{
+    float length = (float) sqrt(dir_x * dir_x + dir_z * dir_z);
+    if (length > 0.f)
+    {
+        dir_x /= length;
+        dir_z /= length;
+    }
+
+    _wanted_count = _wanted_next = 0;
+    for (int dz = -_radius; dz <= _radius; dz++)
+    {
+        for (int dx = -_radius; dx <= _radius; dx++)
+        {
+            int distance2 = dx * dx + dz * dz;
+            if (distance2 > _radius * _radius) continue;
+
+            float ahead = 0.f;
+            if (distance2 > 0) ahead = (dx * dir_x + dz * dir_z) / (float) sqrt((float) distance2);
+            float priority = (float) distance2 * (1.5f - 0.5f * ahead);
+
+            for (int dy = -HEIGHT; dy <= HEIGHT; dy++)
+            {
+                int cx = centre[0] + dx;
+                int cy = centre[1] + dy;
+                int cz = centre[2] + dz;
+                if (mxWorldGetChunk(cx, cy, cz) != NULL || mxLoaderLoading(cx, cy, cz)) continue;
+
+                MX_WANTED_T* wanted = &_wanted[_wanted_count++];
+                wanted->cx = cx;
+                wanted->cy = cy;
+                wanted->cz = cz;
+
+                // Nearer layers first within a column.
+                wanted->priority = priority + 0.01f * (float) (dy * dy);
+            }
+        }
+    }
+    qsort(_wanted, _wanted_count, sizeof(MX_WANTED_T), compare_wanted);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Unloads chunks beyond the unload radius, except those being meshed, which
+// are left for a later update. Returns the number left.
+///////////////////////////////////////////////////////////////////////////////
+static int unload_far(const int centre[3])
+{
+    int limit = _radius + HYSTERESIS;
+    int left = 0;
+    for (int i = mxWorldChunkCount() - 1; i >= 0; i--)
+    {
+        MX_CHUNK_T* chunk = mxWorldChunk(i);
+        int dx = chunk->cx - centre[0];
+        int dy = chunk->cy - centre[1];
+        int dz = chunk->cz - centre[2];
+        if (dx * dx + dz * dz <= limit * limit && abs(dy) <= HEIGHT + HYSTERESIS) continue;
+
+        if (!mxGraphicsReleaseChunk(chunk))
+        {
+            left++;
+            continue;
+        }
+        mxWorldRemoveChunk(chunk);
+        mxLoaderUnload(chunk);
+    }
+    return left;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Requests chunks near the player and unloads distant ones. Called once a
+// frame, before the loader is updated.
+///////////////////////////////////////////////////////////////////////////////
+void mxStreamUpdate()
+{
+    float x, y, z, dir_x, dir_y, dir_z;
+    mxPlayerGetPosition(&x, &y, &z);
+    mxPlayerGetDirection(&dir_x, &dir_y, &dir_z);
+
+    int centre[3] = {
+        (int) floor(x / MX_BLOCK_SIZE + 0.5f) >> MX_CHUNK_BITS,
+        (int) floor(y / MX_BLOCK_SIZE + 0.5f) >> MX_CHUNK_BITS,
+        (int) floor(z / MX_BLOCK_SIZE + 0.5f) >> MX_CHUNK_BITS
+    };
+    bool moved = !_sorted || centre[0] != _centre[0] || centre[1] != _centre[1] || centre[2] != _centre[2];
+    if (moved || ++_updates >= SORT_INTERVAL)
+    {
+        if (moved || _unload_left > 0) _unload_left = unload_far(centre);
+        make_wanted(centre, dir_x, dir_z);
+        _centre[0] = centre[0];
+        _centre[1] = centre[1];
+        _centre[2] = centre[2];
+        _sorted = true;
+        _updates = 0;
+    }
+
+    while (_wanted_next < _wanted_count && mxLoaderPending() < MAX_PENDING)
+    {
+        const MX_WANTED_T* wanted = &_wanted[_wanted_next];
+        if (mxWorldGetChunk(wanted->cx, wanted->cy, wanted->cz) == NULL &&
+            !mxLoaderRequest(wanted->cx, wanted->cy, wanted->cz))
+        {
+            break;
+        }
+        _wanted_next++;
+    }
+
+    int resident = mxWorldChunkCount();
+    int bytes = (resident + mxLoaderCachedCount()) * (int) sizeof(MX_CHUNK_T) + mxGraphicsMeshBytes();
+    mxProfileCount(MX_PROFILE_CHUNKS_RESIDENT, resident);
+    mxProfileCount(MX_PROFILE_RESIDENT_KB, bytes / 1024);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the number of chunks near the player not yet requested, plus the
+// number of distant chunks not yet unloaded.
+///////////////////////////////////////////////////////////////////////////////
+int mxStreamPending()
+{
+    return _wanted_count - _wanted_next + _unload_left;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the radius within which chunks are loaded, in chunks.
+///////////////////////////////////////////////////////////////////////////////
+int mxStreamRadius()
+{
+    return _radius;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxStreamCleanup()
+{
+    free(_wanted);
+    _wanted = NULL;
+    _wanted_count = _wanted_next = _wanted_capacity = 0;
+    _unload_left = 0;
+}
@@ -0,0 +1,12 @@
+#ifndef MX_STREAM_H
+#define MX_STREAM_H
+
+#include <stdbool.h> // bool
+
+bool mxStreamSetup(int radius);
+void mxStreamUpdate();
+int mxStreamPending();
+int mxStreamRadius();
+void mxStreamCleanup();
+
+#endif /* MX_STREAM_H */
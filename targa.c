@@ -25,20 +25,20 @@
 /*
 NOTE: The original contents of this file have been stripped to load only.
 http://research.cs.wisc.edu/graphics/Gallery/LibTarga/
+
+NOTE: The loader has since been rewritten to read the whole file at once and
+      convert a scanline at a time, as reading and converting each pixel
+      separately was far too slow for texture atlases. RLE packets are
+      expanded with memcpy, colour conversion uses integer arithmetic only,
+      and every read from the file data is bounds checked.
 */
 
 #include <stdio.h>
-#if !defined(__APPLE__)
-#include <malloc.h>
-#else
 #include <stdlib.h>
-#endif
+#include <string.h>
 
 #include "targa.h"
 
-/* uncomment this line if you're compiling on a big-endian machine */
-/* #define WORDS_BIGENDIAN */
-
 #define TGA_IMG_NODATA        (0)
 #define TGA_IMG_UNC_PALETTED  (1)
 #define TGA_IMG_UNC_TRUECOLOR (2)
@@ -47,10 +47,10 @@ http://research.cs.wisc.edu/graphics/Gallery/LibTarga/
 #define TGA_IMG_RLE_TRUECOLOR (10)
 #define TGA_IMG_RLE_GRAYSCALE (11)
 
-#define TGA_LOWER_LEFT  (0)
-#define TGA_LOWER_RIGHT (1)
-#define TGA_UPPER_LEFT  (2)
-#define TGA_UPPER_RIGHT (3)
+#define TGA_IMG_RLE_FLAG      (8)
+
+#define TGA_ORIGIN_RIGHT (0x10)
+#define TGA_ORIGIN_UPPER (0x20)
 
 #define HDR_IDLEN              (0)
 #define HDR_CMAP_TYPE          (1)
@@ -76,14 +76,24 @@ http://research.cs.wisc.edu/graphics/Gallery/LibTarga/
 #define TGA_ERR_READ_FAILS              (9)
 #define TGA_ERR_BAD_IMAGE_TYPE          (10)
 #define TGA_ERR_BAD_DIMENSIONS          (11)
+#define TGA_ERR_NO_MEMORY               (12)
 
 static uint32 TargaError;
 
-static int16 ttohs(int16 val);
-static int32 ttohl(int32 val);
-static uint32 tga_get_pixel(FILE* tga, ubyte bytes_per_pix, ubyte* colormap, ubyte cmap_bytes_entry);
-static uint32 tga_convert_color(uint32 pixel, uint32 bpp_in, ubyte alphabits, uint32 format_out);
-static void tga_write_pixel_to_mem(ubyte* dat, ubyte img_spec, uint32 number, uint32 w, uint32 h, uint32 pixel, uint32 format);
+/* describes how to convert the pixels in the file to RGBA */
+typedef struct
+{
+    uint32 bits;            /* bits per colour, after any colormap lookup */
+    uint32 bytes_per_pix;   /* bytes per pixel in the file */
+    ubyte alphabits;
+    ubyte grayscale;
+    ubyte* palette;         /* RGBA entries, or NULL if not paletted */
+} tga_decoder;
+
+static ubyte* tga_read_file(const char* filename, size_t* size);
+static void tga_decode_rle(ubyte* out, size_t out_size, const ubyte* in, size_t in_size, uint32 bytes_per_pix);
+static void tga_convert_row(ubyte* dst, const ubyte* src, uint32 count, const tga_decoder* dec);
+static void tga_convert_colors(ubyte* dst, const ubyte* src, uint32 count, uint32 bits, ubyte alphabits);
 
 /* returns the last error encountered */
 uint32 tga_get_last_error()
@@ -108,10 +118,17 @@ const char* tga_error_string(int error_code)
         case TGA_ERR_READ_FAILS: return "cannot read from file";
         case TGA_ERR_BAD_IMAGE_TYPE: return "unknown image type";
         case TGA_ERR_BAD_DIMENSIONS: return "image has size 0 width or height (or both)";
+        case TGA_ERR_NO_MEMORY: return "out of memory";
         default: return "unknown error";
     }
 }
 
+/* reads a little-endian 16-bit value */
+static uint16 get16(const ubyte* p)
+{
+    return (uint16) (p[0] | (p[1] << 8));
+}
+
 /* loads and converts a targa from disk */
 void* tga_load(const char* filename, int* width, int* height, unsigned int format)
 {
@@ -126,108 +143,106 @@ void* tga_load(const char* filename, int* width, int* height, unsigned int forma
             return NULL;
     }
 
-    /* open binary image file */
-    FILE* targafile = fopen(filename, "rb");
-    if (targafile == NULL) {
-        TargaError = TGA_ERR_OPEN_FAILS;
-        return NULL;
-    }
+    /* read the whole file in one go */
+    size_t file_size;
+    ubyte* file = tga_read_file(filename, &file_size);
+    if (file == NULL) return NULL;
 
-    /* allocate memory for the header */
-    ubyte* tga_hdr = (ubyte*) malloc(HDR_LENGTH);
-
-    /* read the header in. */
-    if (fread((void*) tga_hdr, 1, HDR_LENGTH, targafile) != HDR_LENGTH)
+    if (file_size < HDR_LENGTH)
     {
-        free(tga_hdr);
+        free(file);
         TargaError = TGA_ERR_BAD_HEADER;
         return NULL;
     }
 
     /* byte order is important here. */
-
-    // length of the image_id string below.
-    ubyte idlen = tga_hdr[HDR_IDLEN];
-
-    // can be any of the IMG_TYPE constants above.
-    ubyte image_type = tga_hdr[HDR_IMAGE_TYPE];
-
-    // paletted image <=> cmap_type.
-    ubyte cmap_type = tga_hdr[HDR_CMAP_TYPE];
-
-    uint16 cmap_first = ttohs(*(uint16*) (&tga_hdr[HDR_CMAP_FIRST]));
-
-    // how long the colormap is.
-    uint16 cmap_length = ttohs(*(uint16*) (&tga_hdr[HDR_CMAP_LENGTH]));
-
-    // how big a palette entry is.
-    ubyte cmap_entry_size = tga_hdr[HDR_CMAP_ENTRY_SIZE];
-
-    // the width of the image.
-    uint16 img_spec_width = ttohs(*(uint16*) (&tga_hdr[HDR_IMG_SPEC_WIDTH]));
-
-    // the height of the image.
-    uint16 img_spec_height = ttohs(*(uint16*) (&tga_hdr[HDR_IMG_SPEC_HEIGHT]));
-
-    // the depth of a pixel in the image.
-    ubyte img_spec_pix_depth = tga_hdr[HDR_IMG_SPEC_PIX_DEPTH];
-
-    // the image descriptor.
-    ubyte img_spec_img_desc = tga_hdr[HDR_IMG_SPEC_IMG_DESC];
-
-    free(tga_hdr);
-
-    uint32 num_pixels = img_spec_width * img_spec_height;
-    if (num_pixels == 0) {
+    ubyte idlen = file[HDR_IDLEN];
+    ubyte cmap_type = file[HDR_CMAP_TYPE];
+    ubyte image_type = file[HDR_IMAGE_TYPE];
+    uint16 cmap_first = get16(&file[HDR_CMAP_FIRST]);
+    uint16 cmap_length = get16(&file[HDR_CMAP_LENGTH]);
+    ubyte cmap_entry_size = file[HDR_CMAP_ENTRY_SIZE];
+    uint16 img_spec_width = get16(&file[HDR_IMG_SPEC_WIDTH]);
+    uint16 img_spec_height = get16(&file[HDR_IMG_SPEC_HEIGHT]);
+    ubyte img_spec_pix_depth = file[HDR_IMG_SPEC_PIX_DEPTH];
+    ubyte img_spec_img_desc = file[HDR_IMG_SPEC_IMG_DESC];
+
+    ubyte* palette = NULL;
+    ubyte* stream = NULL;
+    ubyte* image_data = NULL;
+    ubyte* row = NULL;
+
+    tga_decoder dec;
+    dec.alphabits = img_spec_img_desc & 0x0F;
+    dec.bytes_per_pix = (img_spec_pix_depth + 7) >> 3;
+    dec.bits = img_spec_pix_depth;
+    dec.grayscale = 0;
+    dec.palette = NULL;
+
+    uint32 w = img_spec_width;
+    uint32 h = img_spec_height;
+    size_t num_pixels = (size_t) w * h;
+    size_t pos = HDR_LENGTH + idlen;
+
+    if (num_pixels == 0)
+    {
         TargaError = TGA_ERR_BAD_DIMENSIONS;
-        return NULL;
+        goto fail;
     }
-
-    ubyte alphabits = img_spec_img_desc & 0x0F;
-
-    /* seek past the image id, if there is one */
-    if (idlen)
+    if (num_pixels > ((size_t) -1) / 4)
     {
-        if (fseek( targafile, idlen, SEEK_CUR))
-        {
-            TargaError = TGA_ERR_UNEXPECTED_EOF;
-            return NULL;
-        }
+        TargaError = TGA_ERR_NO_MEMORY;
+        goto fail;
     }
 
     /* if this is a 'nodata' image, just jump out. */
     if (image_type == TGA_IMG_NODATA)
     {
         TargaError = TGA_ERR_NODATA_IMAGE;
-        return NULL;
+        goto fail;
     }
 
-    /* now we're starting to get into the meat of the matter. */
-
-    /* deal with the colormap, if there is one. */
-    ubyte cmap_bytes_entry = 0;
-    ubyte* colormap = NULL;
-    if (cmap_type)
+    /* check that the pixel depth is one we can convert */
+    switch (image_type & ~TGA_IMG_RLE_FLAG)
     {
-        switch (image_type)
-        {
-            case TGA_IMG_UNC_PALETTED:
-            case TGA_IMG_RLE_PALETTED:
-                break;
-
-            case TGA_IMG_UNC_TRUECOLOR:
-            case TGA_IMG_RLE_TRUECOLOR:
-                // this should really be an error, but some really old
-                // crusty targas might actually be like this (created by TrueVision, no less!)
-                // so, we'll hack our way through it.
-                break;
+        case TGA_IMG_UNC_TRUECOLOR:
+            if (!(dec.bits == 15 || dec.bits == 16 || dec.bits == 24 || dec.bits == 32))
+            {
+                TargaError = TGA_ERR_BAD_IMAGE_TYPE;
+                goto fail;
+            }
+            break;
 
-            case TGA_IMG_UNC_GRAYSCALE:
-            case TGA_IMG_RLE_GRAYSCALE:
+        case TGA_IMG_UNC_GRAYSCALE:
+            if (cmap_type)
+            {
                 TargaError = TGA_ERR_COLORMAP_FOR_GRAY;
-                return NULL;
-        }
+                goto fail;
+            }
+            if (!(dec.bits == 8 || dec.bits == 16))
+            {
+                TargaError = TGA_ERR_BAD_IMAGE_TYPE;
+                goto fail;
+            }
+            dec.grayscale = 1;
+            break;
 
+        case TGA_IMG_UNC_PALETTED:
+            if (!cmap_type || !(dec.bits == 8 || dec.bits == 16))
+            {
+                TargaError = TGA_ERR_BAD_COLORMAP;
+                goto fail;
+            }
+            break;
+
+        default:
+            TargaError = TGA_ERR_BAD_IMAGE_TYPE;
+            goto fail;
+    }
+
+    /* deal with the colormap, if there is one. */
+    if (cmap_type)
+    {
         /* ensure colormap entry size is something we support */
         if (!(cmap_entry_size == 15 ||
                 cmap_entry_size == 16 ||
@@ -235,355 +250,353 @@ void* tga_load(const char* filename, int* width, int* height, unsigned int forma
                 cmap_entry_size == 32))
         {
             TargaError = TGA_ERR_BAD_COLORMAP_ENTRY_SIZE;
-            return NULL;
+            goto fail;
         }
 
-        /* allocate memory for a colormap */
-        if (cmap_entry_size & 0x07)
+        uint32 cmap_bytes_entry = (cmap_entry_size + 7) >> 3;
+        size_t cmap_bytes = (size_t) cmap_bytes_entry * cmap_length;
+        if (pos > file_size || file_size - pos < cmap_bytes)
         {
-            cmap_bytes_entry = (((8 - (cmap_entry_size & 0x07)) + cmap_entry_size) >> 3);
+            TargaError = TGA_ERR_BAD_COLORMAP;
+            goto fail;
         }
-        else
-        {
-            cmap_bytes_entry = (cmap_entry_size >> 3);
-        }
-
-        uint32 cmap_bytes = cmap_bytes_entry*  cmap_length;
-        colormap = (ubyte*) malloc(cmap_bytes);
 
-        for (int i = 0; i < cmap_length; i++)
+        if ((image_type & ~TGA_IMG_RLE_FLAG) == TGA_IMG_UNC_PALETTED)
         {
-            /* seek ahead to first entry used */
-            if (cmap_first != 0)
+            /* the palette covers every possible index, so no index can
+               read outside of it; unused entries are left transparent. */
+            size_t entries = (size_t) 1 << dec.bits;
+            palette = (ubyte*) calloc(entries, 4);
+            if (palette == NULL)
             {
-                fseek(targafile, cmap_first*  cmap_bytes_entry, SEEK_CUR);
+                TargaError = TGA_ERR_NO_MEMORY;
+                goto fail;
             }
 
-            uint32 tmp_int32 = 0;
-            for (int j = 0; j < cmap_bytes_entry; j++)
-            {
-                ubyte tmp_byte = 0;
-                if (!fread(&tmp_byte, 1, 1, targafile))
-                {
-                    free(colormap);
-                    TargaError = TGA_ERR_BAD_COLORMAP;
-                    return NULL;
-                }
-                tmp_int32 += tmp_byte << (j * 8);
-            }
-
-            // byte order correct.
-            tmp_int32 = ttohl(tmp_int32);
+            size_t count = cmap_length;
+            if (cmap_first >= entries) count = 0;
+            else if (count > entries - cmap_first) count = entries - cmap_first;
+            tga_convert_colors(&palette[cmap_first * 4], &file[pos], (uint32) count, cmap_entry_size, dec.alphabits);
 
-            for (int j = 0; j < cmap_bytes_entry; j++)
-            {
-                colormap[i * cmap_bytes_entry + j] = (tmp_int32 >> (8 * j)) & 0xFF;
-            }
+            dec.palette = palette;
         }
+
+        /* truecolor images may carry a colormap, which is skipped */
+        pos += cmap_bytes;
     }
 
-    // compute number of bytes in an image data unit (either index or BGR triple)
-    ubyte bytes_per_pix;
-    if (img_spec_pix_depth & 0x07)
+    if (pos > file_size)
     {
-        bytes_per_pix = (((8 - (img_spec_pix_depth & 0x07)) + img_spec_pix_depth) >> 3);
+        TargaError = TGA_ERR_UNEXPECTED_EOF;
+        goto fail;
     }
-    else
+
+    /* get the pixel stream, in file order. a file that can't possibly hold
+       the whole image is refused, rather than trusting the header's size. */
+    size_t stream_size = num_pixels * dec.bytes_per_pix;
+    const ubyte* pixels = &file[pos];
+    size_t available = file_size - pos;
+    if (image_type & TGA_IMG_RLE_FLAG)
     {
-        bytes_per_pix = (img_spec_pix_depth >> 3);
+        /* a packet of at least two bytes expands to at most 128 pixels */
+        if (available / 2 < (num_pixels + 127) / 128)
+        {
+            TargaError = TGA_ERR_UNEXPECTED_EOF;
+            goto fail;
+        }
     }
-
-    /* assume that there's one byte per pixel */
-    if (bytes_per_pix == 0)
+    else if (available < stream_size)
     {
-        bytes_per_pix = 1;
+        TargaError = TGA_ERR_UNEXPECTED_EOF;
+        goto fail;
     }
 
-    /* compute how many bytes of storage we need for the image */
-    uint32 bytes_total = img_spec_width * img_spec_height * format;
-
-    ubyte* image_data = (ubyte*) malloc(bytes_total);
-
-    /* compute the true number of bits per pixel */
-    ubyte true_bits_per_pixel = cmap_type ? cmap_entry_size : img_spec_pix_depth;
-
-    switch (image_type)
+    /* RLE data is expanded first; pixels that the packets don't cover are
+       left as zero. */
+    if (image_type & TGA_IMG_RLE_FLAG)
     {
-        case TGA_IMG_UNC_TRUECOLOR:
-        case TGA_IMG_UNC_GRAYSCALE:
-        case TGA_IMG_UNC_PALETTED:
-
-            /* FIXME: support grayscale */
-
-            for (int i = 0; i < num_pixels; i++)
-            {
-                // get the color value.
-                uint32 tmp_col;
-                tmp_col = tga_get_pixel(targafile, bytes_per_pix, colormap, cmap_bytes_entry);
-                tmp_col = tga_convert_color(tmp_col, true_bits_per_pixel, alphabits, format);
-
-                // now write the data out.
-                tga_write_pixel_to_mem(image_data, img_spec_img_desc,
-                        i, img_spec_width, img_spec_height, tmp_col, format);
-            }
-            break;
-
-        case TGA_IMG_RLE_TRUECOLOR:
-        case TGA_IMG_RLE_GRAYSCALE:
-        case TGA_IMG_RLE_PALETTED:
-
-            // FIXME: handle grayscale..
-
-            for (int i = 0; i < num_pixels;)
-            {
-
-                /* a bit of work to do to read the data.. */
-                ubyte packet_header = 0;
-                if (fread(&packet_header, 1, 1, targafile) < 1)
-                {
-                    // well, just let them fill the rest with null pixels then...
-                    packet_header = 1;
-                }
-
-                ubyte repcount;
-                if (packet_header & 0x80)
-                {
-                    /* run length packet */
-
-                    uint32 tmp_col;
-                    tmp_col = tga_get_pixel(targafile, bytes_per_pix, colormap, cmap_bytes_entry);
-                    tmp_col = tga_convert_color(tmp_col, true_bits_per_pixel, alphabits, format);
-
-                    repcount = (packet_header & 0x7F) + 1;
-
-                    /* write all the data out */
-                    for (int j = 0; j < repcount; j++)
-                    {
-                        tga_write_pixel_to_mem(image_data, img_spec_img_desc,
-                                i + j, img_spec_width, img_spec_height, tmp_col, format);
-                    }
-
-                    i += repcount;
-
-                } else {
-                    /* raw packet */
-                    /* get pixel from file */
-
-                    repcount = (packet_header & 0x7F) + 1;
+        stream = (ubyte*) calloc(stream_size, 1);
+        if (stream == NULL)
+        {
+            TargaError = TGA_ERR_NO_MEMORY;
+            goto fail;
+        }
 
-                    for (int j = 0; j < repcount; j++)
-                    {
-                        uint32 tmp_col;
-                        tmp_col = tga_get_pixel(targafile, bytes_per_pix, colormap, cmap_bytes_entry);
-                        tmp_col = tga_convert_color(tmp_col, true_bits_per_pixel, alphabits, format);
+        tga_decode_rle(stream, stream_size, pixels, available, dec.bytes_per_pix);
+        pixels = stream;
+    }
 
-                        tga_write_pixel_to_mem(image_data, img_spec_img_desc,
-                                i + j, img_spec_width, img_spec_height, tmp_col, format);
-                    }
+    /* compute how many bytes of storage we need for the image */
+    size_t row_bytes = (size_t) w * format;
+    image_data = (ubyte*) malloc(row_bytes * h);
+    row = (ubyte*) malloc((size_t) w * 4);
+    if (image_data == NULL || row == NULL)
+    {
+        TargaError = TGA_ERR_NO_MEMORY;
+        goto fail;
+    }
 
-                    i += repcount;
-                }
-            }
+    /* convert a scanline at a time; the output starts in the lower left. */
+    int upper = (img_spec_img_desc & TGA_ORIGIN_UPPER) != 0;
+    int right = (img_spec_img_desc & TGA_ORIGIN_RIGHT) != 0;
+    for (uint32 y = 0; y < h; y++)
+    {
+        const ubyte* src = &pixels[(size_t) y * w * dec.bytes_per_pix];
+        ubyte* dst = &image_data[(size_t) (upper ? h - 1 - y : y) * row_bytes];
 
-            break;
+        if (format == TGA_TRUECOLOR_32 && !right)
+        {
+            tga_convert_row(dst, src, w, &dec);
+            continue;
+        }
 
-        default:
-            TargaError = TGA_ERR_BAD_IMAGE_TYPE;
-            return NULL;
+        tga_convert_row(row, src, w, &dec);
+        if (right)
+        {
+            for (uint32 x = 0; x < w; x++)
+                memcpy(&dst[x * format], &row[(w - 1 - x) * 4], format);
+        }
+        else
+        {
+            for (uint32 x = 0; x < w; x++)
+                memcpy(&dst[x * format], &row[x * 4], format);
+        }
     }
 
-    fclose(targafile);
+    free(row);
+    free(stream);
+    free(palette);
+    free(file);
 
     *width = img_spec_width;
     *height = img_spec_height;
 
+    TargaError = TGA_ERR_NONE;
     return (void*) image_data;
+
+fail:
+    free(row);
+    free(image_data);
+    free(stream);
+    free(palette);
+    free(file);
+    return NULL;
 }
 
-static void tga_write_pixel_to_mem(ubyte* dat, ubyte img_spec, uint32 number,
-        uint32 w, uint32 h, uint32 pixel, uint32 format)
+/* reads a whole file into memory */
+static ubyte* tga_read_file(const char* filename, size_t* size)
 {
-    // write the pixel to the data regarding how the
-    // header says the data is ordered.
-
-    uint32 j;
-    uint32 x, y;
-    uint32 addy;
-
-    switch ((img_spec & 0x30) >> 4)
+    FILE* targafile = fopen(filename, "rb");
+    if (targafile == NULL)
     {
-        case TGA_LOWER_RIGHT:
-            x = w - 1 - (number % w);
-            y = number / h;
-            break;
-
-        case TGA_UPPER_LEFT:
-            x = number % w;
-            y = h - 1 - (number / w);
-            break;
+        TargaError = TGA_ERR_OPEN_FAILS;
+        return NULL;
+    }
 
-        case TGA_UPPER_RIGHT:
-            x = w - 1 - (number % w);
-            y = h - 1 - (number / w);
-            break;
+    long length = -1;
+    if (fseek(targafile, 0, SEEK_END) == 0)
+    {
+        length = ftell(targafile);
+        if (fseek(targafile, 0, SEEK_SET) != 0) length = -1;
+    }
+    if (length < 0)
+    {
+        fclose(targafile);
+        TargaError = TGA_ERR_READ_FAILS;
+        return NULL;
+    }
 
-        case TGA_LOWER_LEFT:
-        default:
-            x = number % w;
-            y = number / w;
+    /* always allocate at least one byte, so an empty file isn't an error here */
+    ubyte* data = (ubyte*) malloc(length + 1);
+    if (data == NULL)
+    {
+        fclose(targafile);
+        TargaError = TGA_ERR_NO_MEMORY;
+        return NULL;
     }
 
-    addy = (y * w + x) * format;
-    for (j = 0; j < format; j++)
+    size_t n = fread(data, 1, (size_t) length, targafile);
+    fclose(targafile);
+    if (n != (size_t) length)
     {
-        dat[addy + j] = (ubyte) ((pixel >> (j * 8)) & 0xFF);
+        free(data);
+        TargaError = TGA_ERR_READ_FAILS;
+        return NULL;
     }
+
+    *size = n;
+    return data;
 }
 
-static uint32 tga_get_pixel(FILE* tga, ubyte bytes_per_pix, ubyte* colormap, ubyte cmap_bytes_entry)
+/* expands run length encoded packets into out, which has room for out_size
+   bytes; anything the packets don't cover is left untouched. */
+static void tga_decode_rle(ubyte* out, size_t out_size, const ubyte* in, size_t in_size, uint32 bytes_per_pix)
 {
-    /* get the image data value out */
+    ubyte* out_end = out + out_size;
+    const ubyte* in_end = in + in_size;
 
-    uint32 tmp_int32 = 0;
-    for (uint32 j = 0; j < bytes_per_pix; j++)
+    while (out < out_end && in < in_end)
     {
-        ubyte tmp_byte;
-        if (fread(&tmp_byte, 1, 1, tga) < 1)
+        ubyte packet_header = *in++;
+        size_t n = (size_t) ((packet_header & 0x7F) + 1) * bytes_per_pix;
+        if (n > (size_t) (out_end - out)) n = out_end - out;
+
+        if (packet_header & 0x80)
         {
-            tmp_int32 = 0;
+            /* run length packet: one pixel, repeated */
+            if ((size_t) (in_end - in) < bytes_per_pix) break;
+            if (bytes_per_pix == 1)
+            {
+                memset(out, *in, n);
+            }
+            else
+            {
+                /* copy the pixel once, then keep doubling the copied span */
+                size_t done = n < bytes_per_pix ? n : bytes_per_pix;
+                memcpy(out, in, done);
+                while (done < n)
+                {
+                    size_t chunk = done < n - done ? done : n - done;
+                    memcpy(out + done, out, chunk);
+                    done += chunk;
+                }
+            }
+            in += bytes_per_pix;
         }
         else
         {
-            tmp_int32 += tmp_byte << (j * 8);
+            /* raw packet: pixels copied straight from the file */
+            if (n > (size_t) (in_end - in)) n = in_end - in;
+            memcpy(out, in, n);
+            in += n;
         }
+
+        out += n;
     }
+}
 
-    /* byte-order correct the thing */
-    switch (bytes_per_pix)
+/* premultiplies a colour channel by alpha, i.e. (c * a) / 255 rounded down */
+#define TGA_PREMULTIPLY(c, a) ((((uint32) (c) * (uint32) (a)) * 0x8081u) >> 23)
+
+/* expands 5 and 6 bit colour channels to 8 bits, rounding to nearest */
+#define TGA_EXPAND5(c) ((((uint32) (c)) * 527u + 23u) >> 6)
+#define TGA_EXPAND6(c) ((((uint32) (c)) * 259u + 33u) >> 6)
+
+/* converts a row of pixels from the file to premultiplied RGBA */
+static void tga_convert_row(ubyte* dst, const ubyte* src, uint32 count, const tga_decoder* dec)
+{
+    if (dec->palette != NULL)
     {
-        case 2:
-            tmp_int32 = ttohs((uint16) tmp_int32);
-            break;
-        case 3:
-        case 4:
-            tmp_int32 = ttohl(tmp_int32);
-            break;
+        const ubyte* palette = dec->palette;
+        if (dec->bytes_per_pix == 1)
+        {
+            for (uint32 i = 0; i < count; i++)
+                memcpy(&dst[i * 4], &palette[src[i] * 4], 4);
+        }
+        else
+        {
+            for (uint32 i = 0; i < count; i++)
+                memcpy(&dst[i * 4], &palette[get16(&src[i * 2]) * 4], 4);
+        }
     }
-
-    uint32 tmp_col;
-    if (colormap != NULL)
+    else if (dec->grayscale)
     {
-        /* need to look up value to get real color */
-        tmp_col = 0;
-        for (uint32 j = 0; j < cmap_bytes_entry; j++)
+        if (dec->bits == 8)
         {
-            tmp_col += colormap[cmap_bytes_entry * tmp_int32 + j] << (8 * j);
+            for (uint32 i = 0; i < count; i++)
+            {
+                ubyte v = src[i];
+                dst[i * 4 + 0] = v;
+                dst[i * 4 + 1] = v;
+                dst[i * 4 + 2] = v;
+                dst[i * 4 + 3] = 0xFF;
+            }
+        }
+        else
+        {
+            for (uint32 i = 0; i < count; i++)
+            {
+                ubyte v = (ubyte) TGA_PREMULTIPLY(src[i * 2], src[i * 2 + 1]);
+                dst[i * 4 + 0] = v;
+                dst[i * 4 + 1] = v;
+                dst[i * 4 + 2] = v;
+                dst[i * 4 + 3] = src[i * 2 + 1];
+            }
         }
     }
     else
     {
-        tmp_col = tmp_int32;
+        tga_convert_colors(dst, src, count, dec->bits, dec->alphabits);
     }
-
-    return tmp_col;
 }
 
-static uint32 tga_convert_color(uint32 pixel, uint32 bpp_in, ubyte alphabits, uint32 format_out)
+/* converts truecolor values from the file, which are BGR(A) or packed 5-5-5
+   or 5-6-5, to premultiplied RGBA. this is also used for colormap entries. */
+static void tga_convert_colors(ubyte* dst, const ubyte* src, uint32 count, uint32 bits, ubyte alphabits)
 {
-    // this is not only responsible for converting from different depths
-    // to other depths, it also switches BGR to RGB.
-
-    // this thing will also premultiply alpha, on a pixel by pixel basis.
-
-    ubyte r, g, b, a;
-
-    switch (bpp_in)
+    switch (bits)
     {
         case 32:
-            if (alphabits == 0)
+            if (alphabits != 0)
             {
-                goto is_24_bit_in_disguise;
+                for (uint32 i = 0; i < count; i++)
+                {
+                    uint32 a = src[i * 4 + 3];
+                    dst[i * 4 + 0] = (ubyte) TGA_PREMULTIPLY(src[i * 4 + 2], a);
+                    dst[i * 4 + 1] = (ubyte) TGA_PREMULTIPLY(src[i * 4 + 1], a);
+                    dst[i * 4 + 2] = (ubyte) TGA_PREMULTIPLY(src[i * 4 + 0], a);
+                    dst[i * 4 + 3] = (ubyte) a;
+                }
+                break;
+            }
+            // 32-bit with no alpha bits is 24-bit in disguise.
+            for (uint32 i = 0; i < count; i++)
+            {
+                dst[i * 4 + 0] = src[i * 4 + 2];
+                dst[i * 4 + 1] = src[i * 4 + 1];
+                dst[i * 4 + 2] = src[i * 4 + 0];
+                dst[i * 4 + 3] = 0xFF;
             }
-            // 32-bit to 32-bit -- nop.
             break;
 
         case 24:
-            is_24_bit_in_disguise:
-                    // 24-bit to 32-bit; (only force alpha to full)
-                    pixel |= 0xFF000000;
-            break;
-
-        case 15:
-            is_15_bit_in_disguise:
-                    r = (ubyte)(((float)((pixel & 0x7C00) >> 10)) * 8.2258f);
-            g = (ubyte)(((float)((pixel & 0x03E0) >> 5 )) * 8.2258f);
-            b = (ubyte)(((float)(pixel & 0x001F)) * 8.2258f);
-            // 15-bit to 32-bit; (force alpha to full)
-            pixel = 0xFF000000 + (r << 16) + (g << 8) + b;
+            // 24-bit to 32-bit; (only force alpha to full)
+            for (uint32 i = 0; i < count; i++)
+            {
+                dst[i * 4 + 0] = src[i * 3 + 2];
+                dst[i * 4 + 1] = src[i * 3 + 1];
+                dst[i * 4 + 2] = src[i * 3 + 0];
+                dst[i * 4 + 3] = 0xFF;
+            }
             break;
 
         case 16:
-            if (alphabits == 1)
+            if (alphabits != 1)
             {
-                goto is_15_bit_in_disguise;
+                // 5-6-5 to 32-bit; (force alpha to full)
+                for (uint32 i = 0; i < count; i++)
+                {
+                    uint32 pixel = get16(&src[i * 2]);
+                    dst[i * 4 + 0] = (ubyte) TGA_EXPAND5((pixel >> 11) & 0x1F);
+                    dst[i * 4 + 1] = (ubyte) TGA_EXPAND6((pixel >> 5) & 0x3F);
+                    dst[i * 4 + 2] = (ubyte) TGA_EXPAND5(pixel & 0x1F);
+                    dst[i * 4 + 3] = 0xFF;
+                }
+                break;
             }
-            // 16-bit to 32-bit; (force alpha to full)
-            r = (ubyte) (((float) ((pixel & 0xF800) >> 11)) * 8.2258f);
-            g = (ubyte) (((float) ((pixel & 0x07E0) >> 5 )) * 4.0476f);
-            b = (ubyte) (((float)  (pixel & 0x001F)) * 8.2258f);
-            pixel = 0xFF000000 + (r << 16) + (g << 8) + b;
-            break;
-    }
+            // 16-bit with one alpha bit is 15-bit in disguise.
+            // fall through
 
-    // convert the 32-bit pixel from BGR to RGB.
-    pixel = (pixel & 0xFF00FF00) + ((pixel & 0xFF) << 16) + ((pixel & 0xFF0000) >> 16);
-
-    r =  pixel & 0x000000FF;
-    g = (pixel & 0x0000FF00) >> 8;
-    b = (pixel & 0x00FF0000) >> 16;
-    a = (pixel & 0xFF000000) >> 24;
-
-    // not premultiplied alpha -- multiply.
-    r = (ubyte) (((float) r / 255.0f) * ((float) a / 255.0f) * 255.0f);
-    g = (ubyte) (((float) g / 255.0f) * ((float) a / 255.0f) * 255.0f);
-    b = (ubyte) (((float) b / 255.0f) * ((float) a / 255.0f) * 255.0f);
-
-    pixel = r + (g << 8) + (b << 16) + (a << 24);
-
-    /* now convert from 32-bit to whatever they want. */
-
-    switch (format_out)
-    {
-        case TGA_TRUECOLOR_32:
-            // 32 to 32 -- nop.
-            break;
-
-        case TGA_TRUECOLOR_24:
-            // 32 to 24 -- discard alpha.
-            pixel &= 0x00FFFFFF;
+        case 15:
+            // 5-5-5 to 32-bit; (force alpha to full)
+            for (uint32 i = 0; i < count; i++)
+            {
+                uint32 pixel = get16(&src[i * 2]);
+                dst[i * 4 + 0] = (ubyte) TGA_EXPAND5((pixel >> 10) & 0x1F);
+                dst[i * 4 + 1] = (ubyte) TGA_EXPAND5((pixel >> 5) & 0x1F);
+                dst[i * 4 + 2] = (ubyte) TGA_EXPAND5(pixel & 0x1F);
+                dst[i * 4 + 3] = 0xFF;
+            }
             break;
     }
-
-    return pixel;
-}
-
-static int16 ttohs(int16 val)
-{
-#ifdef WORDS_BIGENDIAN
-    return ((val & 0xFF) << 8) + (val >> 8);
-#else
-    return val;
-#endif
-}
-
-static int32 ttohl(int32 val)
-{
-#ifdef WORDS_BIGENDIAN
-    return ((val & 0x000000FF) << 24) +
-           ((val & 0x0000FF00) << 8)  +
-           ((val & 0x00FF0000) >> 8)  +
-           ((val & 0xFF000000) >> 24);
-#else
-    return val;
-#endif
 }
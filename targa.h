@@ -54,7 +54,16 @@ index size      palette entry   breakdown   components
 ------------------------------------------------------
 8               <any of above>  <same as above> ..
 16              <any of above>  <same as above> ..
-24              <any of above>  <same as above> ..
+
+Grayscale images supported:
+
+bits            breakdown   components
+--------------------------------------
+8               8           Gray
+16              8-8         Gray, Alpha
+
+Uncompressed and RLE compressed versions of each are supported, with any of
+the four image origins.
 */
 
 // The 'format' argument to tga_create:
@@ -0,0 +1,321 @@
+///////////////////////////////////////////////////////////////////////////////
+// This file stores the voxel world as a set of fixed size chunks of dense
+// block types. Chunks are found with an open addressing hash table keyed on
+// chunk coordinates, so getting or setting a block at any world position is
+// a hash probe followed by an array index. The last chunk found is cached, as
+// neighbouring lookups nearly always land in the same chunk.
+///////////////////////////////////////////////////////////////////////////////
+
+// Enable or disable debugging in this file.
+//#define DEBUG_THIS
+
+#ifdef DEBUG_THIS
+#include "debug.h"
+#endif
+
+#include "world.h"
+#include "profiler.h" // mxProfileNow
+
+#include <stdlib.h> // malloc, calloc, free
+#include <string.h> // memset
+
+// Initial number of hash table slots. Must be a power of two.
+#define INITIAL_CAPACITY 256
+
+// The hash table is grown when more than this fraction of slots are in use.
+#define MAX_LOAD_NUM 1
+#define MAX_LOAD_DEN 2
+
+// Hash table slots, each pointing at a chunk or NULL when unused.
+static MX_CHUNK_T** _table;
+static unsigned int _table_mask;
+
+// Dense list of chunks, for iteration. Removing a chunk moves the last one
+// into its place.
+static MX_CHUNK_T** _chunks;
+static int _chunks_count;
+static int _chunks_capacity;
+
+// The chunk found by the most recent lookup.
+static MX_CHUNK_T* _last;
+
+///////////////////////////////////////////////////////////////////////////////
+static unsigned int hash(int cx, int cy, int cz)
+{
+    unsigned int h = (unsigned int) cx * 73856093u
+                   ^ (unsigned int) cy * 19349663u
+                   ^ (unsigned int) cz * 83492791u;
+    return h ^ (h >> 16);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static void table_insert(MX_CHUNK_T* chunk)
+{
+    unsigned int i = hash(chunk->cx, chunk->cy, chunk->cz) & _table_mask;
+    while (_table[i] != NULL) i = (i + 1) & _table_mask;
+    _table[i] = chunk;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static bool table_grow()
+{
+    unsigned int capacity = (_table_mask + 1) * 2;
+    MX_CHUNK_T** table = (MX_CHUNK_T**) calloc(capacity, sizeof(MX_CHUNK_T*));
+    if (table == NULL) return false;
+
+    free(_table);
+    _table = table;
+    _table_mask = capacity - 1;
+    for (int i = 0; i < _chunks_count; i++) table_insert(_chunks[i]);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool mxWorldSetup()
+{
+    _table = (MX_CHUNK_T**) calloc(INITIAL_CAPACITY, sizeof(MX_CHUNK_T*));
+    if (_table == NULL) return false;
+    _table_mask = INITIAL_CAPACITY - 1;
+
+    _chunks_capacity = INITIAL_CAPACITY;
+    _chunks = (MX_CHUNK_T**) malloc(_chunks_capacity * sizeof(MX_CHUNK_T*));
+    if (_chunks == NULL) return false;
+    _chunks_count = 0;
+    _last = NULL;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the chunk at the given chunk coordinates, or NULL if not created.
+///////////////////////////////////////////////////////////////////////////////
+MX_CHUNK_T* mxWorldGetChunk(int cx, int cy, int cz)
+{
+    MX_CHUNK_T* chunk = _last;
+    if (chunk != NULL && chunk->cx == cx && chunk->cy == cy && chunk->cz == cz)
+        return chunk;
+
+    unsigned int i = hash(cx, cy, cz) & _table_mask;
+    while ((chunk = _table[i]) != NULL)
+    {
+        if (chunk->cx == cx && chunk->cy == cy && chunk->cz == cz)
+        {
+            _last = chunk;
+            return chunk;
+        }
+        i = (i + 1) & _table_mask;
+    }
+    return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Allocates an empty chunk without adding it to the world, so that it can be
+// filled on another thread and then added with mxWorldAddChunk. Returns NULL
+// if out of memory.
+///////////////////////////////////////////////////////////////////////////////
+MX_CHUNK_T* mxWorldAllocChunk(int cx, int cy, int cz)
+{
+    MX_CHUNK_T* chunk = (MX_CHUNK_T*) malloc(sizeof(MX_CHUNK_T));
+    if (chunk == NULL) return NULL;
+    chunk->cx = cx;
+    chunk->cy = cy;
+    chunk->cz = cz;
+    chunk->solid_count = 0;
+    chunk->dirty = true;
+    chunk->edits = 0;
+    chunk->saved_edits = 0;
+    chunk->edit_time = 0;
+    chunk->render = NULL;
+    memset(chunk->blocks, MX_BLOCK_AIR, sizeof(chunk->blocks));
+    return chunk;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Adds a chunk from mxWorldAllocChunk to the world, which then owns it. There
+// must not already be a chunk at the same position. Returns false if out of
+// memory.
+///////////////////////////////////////////////////////////////////////////////
+bool mxWorldAddChunk(MX_CHUNK_T* chunk)
+{
+    if ((_chunks_count + 1) * MAX_LOAD_DEN > (int) (_table_mask + 1) * MAX_LOAD_NUM)
+    {
+        if (!table_grow()) return false;
+    }
+
+    if (_chunks_count == _chunks_capacity)
+    {
+        int capacity = _chunks_capacity * 2;
+        MX_CHUNK_T** chunks = (MX_CHUNK_T**) realloc(_chunks, capacity * sizeof(MX_CHUNK_T*));
+        if (chunks == NULL) return false;
+        _chunks = chunks;
+        _chunks_capacity = capacity;
+    }
+
+#ifdef DEBUG_THIS
+    mxDebug("Added chunk %d, %d, %d", chunk->cx, chunk->cy, chunk->cz);
+#endif
+
+    _chunks[_chunks_count++] = chunk;
+    table_insert(chunk);
+    _last = chunk;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Removes the chunk from the world without freeing it, so that the caller can
+// keep it or free it. Returns false if it isn't in the world.
+///////////////////////////////////////////////////////////////////////////////
+bool mxWorldRemoveChunk(MX_CHUNK_T* chunk)
+{
+    unsigned int i = hash(chunk->cx, chunk->cy, chunk->cz) & _table_mask;
+    while (_table[i] != chunk)
+    {
+        if (_table[i] == NULL) return false;
+        i = (i + 1) & _table_mask;
+    }
+
+    // Move later chunks in the same run of slots back into the gap, if that
+    // doesn't put them before their home slot, so that lookups never stop
+    // early at an empty slot.
+    unsigned int gap = i;
+    for (unsigned int j = (i + 1) & _table_mask; _table[j] != NULL; j = (j + 1) & _table_mask)
+    {
+        unsigned int home = hash(_table[j]->cx, _table[j]->cy, _table[j]->cz) & _table_mask;
+        if (((j - home) & _table_mask) >= ((j - gap) & _table_mask))
+        {
+            _table[gap] = _table[j];
+            gap = j;
+        }
+    }
+    _table[gap] = NULL;
+
+    for (int k = 0; k < _chunks_count; k++)
+    {
+        if (_chunks[k] != chunk) continue;
+        _chunks[k] = _chunks[--_chunks_count];
+        break;
+    }
+    if (_last == chunk) _last = NULL;
+
+    // Edits to a chunk that has gone are never shown, so aren't timed.
+    chunk->edit_time = 0;
+
+#ifdef DEBUG_THIS
+    mxDebug("Removed chunk %d, %d, %d", chunk->cx, chunk->cy, chunk->cz);
+#endif
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the chunk at the given chunk coordinates, creating an empty chunk
+// if there isn't one already. Returns NULL if out of memory.
+///////////////////////////////////////////////////////////////////////////////
+MX_CHUNK_T* mxWorldCreateChunk(int cx, int cy, int cz)
+{
+    MX_CHUNK_T* chunk = mxWorldGetChunk(cx, cy, cz);
+    if (chunk != NULL) return chunk;
+
+    chunk = mxWorldAllocChunk(cx, cy, cz);
+    if (chunk == NULL) return NULL;
+    if (!mxWorldAddChunk(chunk))
+    {
+        free(chunk);
+        return NULL;
+    }
+    return chunk;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Returns the block type at the given world coordinates. Space that is not
+// covered by any chunk is empty.
+///////////////////////////////////////////////////////////////////////////////
+MX_BLOCK_T mxWorldGetBlock(int x, int y, int z)
+{
+    MX_CHUNK_T* chunk = mxWorldGetChunk(x >> MX_CHUNK_BITS, y >> MX_CHUNK_BITS, z >> MX_CHUNK_BITS);
+    if (chunk == NULL) return MX_BLOCK_AIR;
+    return chunk->blocks[MX_BLOCK_INDEX(x & MX_CHUNK_MASK, y & MX_CHUNK_MASK, z & MX_CHUNK_MASK)];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Marks a chunk as changed by an edit made at the given time.
+///////////////////////////////////////////////////////////////////////////////
+static void mark_edited(MX_CHUNK_T* chunk, uint64_t now)
+{
+    chunk->dirty = true;
+    if (chunk->edit_time == 0) chunk->edit_time = now;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sets the block type at the given world coordinates, creating the chunk that
+// contains it if necessary. The chunk is marked for meshing, as are any
+// neighbouring chunks whose meshes depend on the block, which are those it
+// borders on, including diagonally. Any number of edits can be made in a
+// frame, and each chunk is only meshed again once.
+///////////////////////////////////////////////////////////////////////////////
+void mxWorldSetBlock(int x, int y, int z, MX_BLOCK_T type)
+{
+    int cx = x >> MX_CHUNK_BITS;
+    int cy = y >> MX_CHUNK_BITS;
+    int cz = z >> MX_CHUNK_BITS;
+    MX_CHUNK_T* chunk = mxWorldGetChunk(cx, cy, cz);
+    if (chunk == NULL)
+    {
+        // Don't create chunks just to fill them with nothing.
+        if (type == MX_BLOCK_AIR) return;
+        chunk = mxWorldCreateChunk(cx, cy, cz);
+        if (chunk == NULL) return;
+    }
+
+    int lx = x & MX_CHUNK_MASK;
+    int ly = y & MX_CHUNK_MASK;
+    int lz = z & MX_CHUNK_MASK;
+    MX_BLOCK_T* block = &chunk->blocks[MX_BLOCK_INDEX(lx, ly, lz)];
+    if (*block == type) return;
+    chunk->solid_count += (type != MX_BLOCK_AIR) - (*block != MX_BLOCK_AIR);
+    *block = type;
+    chunk->edits++;
+
+    uint64_t now = mxProfileNow();
+    mark_edited(chunk, now);
+
+    // Blocks on a border are in the padding of the chunks across it.
+    int lo_x = lx == 0 ? -1 : 0, hi_x = lx == MX_CHUNK_MASK ? 1 : 0;
+    int lo_y = ly == 0 ? -1 : 0, hi_y = ly == MX_CHUNK_MASK ? 1 : 0;
+    int lo_z = lz == 0 ? -1 : 0, hi_z = lz == MX_CHUNK_MASK ? 1 : 0;
+    for (int dy = lo_y; dy <= hi_y; dy++)
+    {
+        for (int dz = lo_z; dz <= hi_z; dz++)
+        {
+            for (int dx = lo_x; dx <= hi_x; dx++)
+            {
+                if (dx == 0 && dy == 0 && dz == 0) continue;
+                MX_CHUNK_T* neighbour = mxWorldGetChunk(cx + dx, cy + dy, cz + dz);
+                if (neighbour != NULL) mark_edited(neighbour, now);
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+int mxWorldChunkCount()
+{
+    return _chunks_count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+MX_CHUNK_T* mxWorldChunk(int index)
+{
+    return _chunks[index];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void mxWorldCleanup()
+{
+    for (int i = 0; i < _chunks_count; i++) free(_chunks[i]);
+    free(_chunks);
+    free(_table);
+    _chunks = NULL;
+    _table = NULL;
+    _chunks_count = 0;
+    _chunks_capacity = 0;
+    _last = NULL;
+}
@@ -0,0 +1,72 @@
+#ifndef MX_WORLD_H
+#define MX_WORLD_H
+
+#include <stdbool.h> // bool
+#include <stdint.h> // uint64_t
+
+// Chunks are cubes of 2^MX_CHUNK_BITS blocks along each axis. The size can be
+// changed at compile time, e.g. -DMX_CHUNK_BITS=5 for 32x32x32 chunks.
+#ifndef MX_CHUNK_BITS
+#define MX_CHUNK_BITS 4
+#endif
+
+#define MX_CHUNK_SIZE   (1 << MX_CHUNK_BITS)
+#define MX_CHUNK_MASK   (MX_CHUNK_SIZE - 1)
+#define MX_CHUNK_VOLUME (MX_CHUNK_SIZE * MX_CHUNK_SIZE * MX_CHUNK_SIZE)
+
+// Blocks are this many units wide. Positions in the game, such as the
+// player's, are in these units, with each block centred on its coordinates.
+#define MX_BLOCK_SIZE   (20)
+
+// Blocks are stored with x varying fastest, then z, then y.
+#define MX_BLOCK_INDEX(x, y, z) \
+        ((((y) << (2 * MX_CHUNK_BITS)) | ((z) << MX_CHUNK_BITS) | (x)))
+
+// Block types. Zero is always empty space.
+#define MX_BLOCK_AIR    (0)
+#define MX_BLOCK_GRASS  (1)
+#define MX_BLOCK_DIRT   (2)
+
+typedef unsigned char MX_BLOCK_T;
+
+typedef struct
+{
+    // Chunk coordinates, i.e. world block coordinates >> MX_CHUNK_BITS.
+    int cx;
+    int cy;
+    int cz;
+
+    // Number of blocks in this chunk that are not MX_BLOCK_AIR.
+    int solid_count;
+
+    // Set when the blocks change and the chunk needs to be meshed again.
+    bool dirty;
+
+    // Number of changes made by mxWorldSetBlock, and the number there had
+    // been when the chunk was last saved. It needs saving while they differ.
+    unsigned int edits;
+    unsigned int saved_edits;
+
+    // When the chunk was first changed by mxWorldSetBlock since it was last
+    // meshed, or 0. Such chunks are meshed ahead of others.
+    uint64_t edit_time;
+
+    // Renderer data for this chunk, owned by the graphics engine.
+    void* render;
+
+    MX_BLOCK_T blocks[MX_CHUNK_VOLUME];
+} MX_CHUNK_T;
+
+bool mxWorldSetup();
+MX_BLOCK_T mxWorldGetBlock(int x, int y, int z);
+void mxWorldSetBlock(int x, int y, int z, MX_BLOCK_T type);
+MX_CHUNK_T* mxWorldGetChunk(int cx, int cy, int cz);
+MX_CHUNK_T* mxWorldAllocChunk(int cx, int cy, int cz);
+bool mxWorldAddChunk(MX_CHUNK_T* chunk);
+bool mxWorldRemoveChunk(MX_CHUNK_T* chunk);
+MX_CHUNK_T* mxWorldCreateChunk(int cx, int cy, int cz);
+int mxWorldChunkCount();
+MX_CHUNK_T* mxWorldChunk(int index);
+void mxWorldCleanup();
+
+#endif /* MX_WORLD_H */